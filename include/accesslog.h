@@ -0,0 +1,46 @@
+#ifndef ACCESSLOG_H
+#define ACCESSLOG_H
+
+#include <stdint.h>
+#include "client.h"
+#include "stats.h"
+
+#define ACCESS_LOG_MAGIC "HTAL"
+#define ACCESS_LOG_VERSION 1
+#define ACCESS_LOG_BATCH 256
+#define ACCESS_LOG_KEEP 5
+
+typedef struct
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t record_size;
+    uint64_t created_us;
+} access_log_header_t;
+
+/* Fixed-size on-disk record; every field is written in host byte order. */
+typedef struct
+{
+    uint64_t timestamp_us;
+    uint64_t bytes;
+    int64_t range_start;
+    int64_t range_end;
+    uint32_t path_id;
+    int32_t fd;
+    uint16_t status;
+    uint16_t peer_family;
+    uint16_t peer_port;
+    uint16_t worker_id;
+    uint8_t peer_addr[16];
+    uint32_t phase_us[PHASE_COUNT];
+    uint32_t reserved;
+} access_record_t;
+
+void init_access_log(const char *path, unsigned long long rotate_bytes, int worker_count);
+int is_access_log_enabled(void);
+uint32_t access_log_path_id(const char *path);
+void access_log_request(const client_t *client, const char *path, int status,
+                        unsigned long long bytes, long range_start, long range_end);
+void close_access_log(void);
+
+#endif
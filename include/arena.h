@@ -0,0 +1,57 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <string.h>
+
+#define ARENA_ALIGN 8
+
+/* Bump-pointer allocator over caller-owned memory; reset is O(1). */
+typedef struct
+{
+    char *base;
+    size_t used;
+    size_t cap;
+    size_t peak;
+} arena_t;
+
+static inline void arena_init(arena_t *arena, void *mem, size_t cap)
+{
+    arena->base = (char *)mem;
+    arena->used = 0;
+    arena->cap = cap;
+    arena->peak = 0;
+}
+
+static inline void *arena_alloc(arena_t *arena, size_t size)
+{
+    size_t offset = (arena->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (offset + size > arena->cap)
+    {
+        return NULL;
+    }
+    arena->used = offset + size;
+    return arena->base + offset;
+}
+
+static inline char *arena_strndup(arena_t *arena, const char *src, size_t len)
+{
+    char *dst = (char *)arena_alloc(arena, len + 1);
+    if (dst)
+    {
+        memcpy(dst, src, len);
+        dst[len] = '\0';
+    }
+    return dst;
+}
+
+static inline void arena_reset(arena_t *arena)
+{
+    if (arena->used > arena->peak)
+    {
+        arena->peak = arena->used;
+    }
+    arena->used = 0;
+}
+
+#endif
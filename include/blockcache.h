@@ -0,0 +1,44 @@
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define BLOCK_CACHE_BLOCK_SIZE (256 * 1024)
+#define BLOCK_CACHE_SHARDS 16
+#define BLOCK_CACHE_PROTECTED_PCT 80
+
+/* Identifies one version of a file: a rewrite changes size or mtime, so stale blocks just age out. */
+typedef struct
+{
+    dev_t dev;
+    ino_t ino;
+    long size;
+    long long mtime_ns;
+} block_file_t;
+
+/* Where a missing block comes from: the open file, or the cluster peer that owns the path. */
+typedef struct
+{
+    int fd;
+    int drop_behind;
+    int peer;
+    const char *path;
+} block_source_t;
+
+typedef struct block block_t;
+
+void init_block_cache(size_t bytes);
+int is_block_cache_enabled(void);
+
+/*
+ * Pins block `index` of the file, filling it from the source on a miss (peer first when set, then
+ * the fd; drop_behind evicts what was read from the page cache). Returns NULL when the block
+ * cannot be cached right now (being loaded by another request, or every candidate is pinned);
+ * the caller reads the file itself.
+ */
+block_t *block_cache_acquire(const block_file_t *file, long index, const block_source_t *source, const char **data,
+                             size_t *len);
+void block_cache_release(block_t *block);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "client.h"
+
+#define CAPTURE_LINE_MAX 1024
+
+void init_capture(const char *path, unsigned int sample_every);
+int is_capture_enabled(void);
+void capture_request(const client_t *client, const char *method, const char *path, const char *range);
+void close_capture(void);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include <sys/socket.h>
+#include "trace.h"
+
+typedef struct
+{
+    int fd;
+    int worker_id;
+    unsigned long conn_id;
+    int queue_group;
+    int requests_served;
+    struct sockaddr_storage peer;
+    socklen_t peer_len;
+    int tls;
+    int proxy;
+    int ktls_send;
+    int alpn_h2;
+    void *ssl;
+    request_trace_t trace;
+} client_t;
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#define CLUSTER_MAX_PEERS 32
+#define CLUSTER_VNODES 64
+#define CLUSTER_HOT_REPLICAS 3
+#define CLUSTER_HOT_SLOTS 4096
+#define CLUSTER_IDLE_MAX 16
+#define CLUSTER_FETCH_TIMEOUT_MS 2000
+#define CLUSTER_PEER_HEADER "X-HappyTree-Peer"
+#define CLUSTER_SECRET_MIN 16
+#define CLUSTER_SECRET_MAX 128
+
+/* peers is "host:port,host:port,..." and self must be one of its entries; secret is sent in the peer
+ * header and must be the same on every instance. Exits on a bad list or secret. */
+void init_cluster(const char *peers, const char *self, const char *secret, int hot_threshold);
+int is_cluster_enabled(void);
+
+/*
+ * Peer whose slice of the consistent-hash ring holds this path, or -1 to read local storage (peer
+ * mode off, or this instance owns it). A path requested more than hot_threshold times per second
+ * is spread over CLUSTER_HOT_REPLICAS owners, and each instance sticks to one of them.
+ */
+int cluster_route(const char *path);
+
+/* A request gets peer treatment only if its peer header carries the shared secret and it comes from
+ * a peer's IP (the port is ephemeral, so it is not compared). */
+int cluster_is_peer_request(const struct sockaddr_storage *addr, const char *header);
+
+/* Fetches [offset, offset + len) of path from the peer into buf; 0 on success. */
+int cluster_fetch(int peer, const char *path, long file_size, off_t offset, char *buf, size_t len);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef CONN_H
+#define CONN_H
+
+#include <stddef.h>
+#include "arena.h"
+#include "client.h"
+
+#define CONN_IO_BUFFER_SIZE 8192
+#define CONN_BODY_BUFFER_SIZE 16384
+#define CONN_ARENA_SIZE 16384
+#define CONN_POOL_MAX 1024
+
+/* Per-connection state: the request head accumulates in io_buf across reads (and keeps
+ * pipelined leftovers between requests), parsed data lives in the arena, and
+ * body_buf is reused for file reads. */
+typedef struct conn
+{
+    struct conn *next_free;
+    client_t client;
+    arena_t arena;
+    size_t io_len;
+    char io_buf[CONN_IO_BUFFER_SIZE];
+    char body_buf[CONN_BODY_BUFFER_SIZE];
+    char arena_mem[CONN_ARENA_SIZE];
+} conn_t;
+
+/* Free-list of connection objects owned by one worker; no locking needed. */
+typedef struct
+{
+    conn_t *free_list;
+    int allocated;
+    int in_use;
+} conn_pool_t;
+
+void conn_pool_init(conn_pool_t *pool);
+conn_t *conn_acquire(conn_pool_t *pool, const client_t *client);
+void conn_release(conn_pool_t *pool, conn_t *conn);
+void conn_reset_request(conn_t *conn);
+
+#endif
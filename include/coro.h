@@ -0,0 +1,36 @@
+#ifndef CORO_H
+#define CORO_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "io.h"
+
+#define CORO_STACK_SIZE (128 * 1024)
+#define CORO_EVENTS_MAX 256
+#define CORO_FILE_THREADS 4
+
+typedef struct coro_sched coro_sched_t;
+
+/*
+ * One scheduler per worker thread: up to max_coros coroutines on pooled mmap'd stacks (with a guard
+ * page), parked on an epoll set while they wait for their socket, a deadline or an offloaded file
+ * read. queue_fd is an eventfd that signals new work; it is only watched while there is room.
+ */
+coro_sched_t *coro_sched_create(int max_coros, int queue_fd);
+int coro_sched_has_room(const coro_sched_t *sched);
+int coro_sched_active(const coro_sched_t *sched);
+int coro_spawn(coro_sched_t *sched, void (*fn)(void *), void *arg);
+
+/* Runs every ready coroutine, then waits once for sockets, timers, file completions or the queue. */
+void coro_sched_run(coro_sched_t *sched);
+
+/* The calling coroutine's I/O context, or NULL on a plain thread. */
+io_context_t *coro_io_context(void);
+
+/* Parks the calling coroutine until fd is ready or deadline_ns (0 = none) passes (-1, ETIMEDOUT). */
+int coro_wait_fd(int fd, short events, uint64_t deadline_ns);
+
+/* pread(2) on a helper thread while the calling coroutine yields. */
+ssize_t coro_pread(int fd, void *buf, size_t len, off_t offset);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef DASHBOARD_H
+#define DASHBOARD_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define DASHBOARD_REFRESH_MS 500
+
+typedef enum
+{
+    WORKER_IDLE = 0,
+    WORKER_HANDSHAKE,
+    WORKER_READING,
+    WORKER_SENDING,
+    WORKER_KEEPALIVE,
+    WORKER_HTTP2,
+    WORKER_STATE_COUNT
+} worker_state_t;
+
+/* One cache line per worker so publishing never contends with another worker. */
+typedef struct
+{
+    _Alignas(64) atomic_int state;
+    atomic_int fd;
+    atomic_ullong request_start_ns;
+    atomic_ulong served;
+} worker_slot_t;
+
+extern worker_slot_t *g_worker_slots;
+
+void init_worker_slots(int worker_count);
+void init_dashboard(void);
+int is_dashboard_enabled(void);
+
+static inline void dashboard_publish(int worker_id, worker_state_t state, int fd)
+{
+    worker_slot_t *slot = &g_worker_slots[worker_id];
+    atomic_store_explicit(&slot->state, state, memory_order_relaxed);
+    atomic_store_explicit(&slot->fd, fd, memory_order_relaxed);
+}
+
+static inline void dashboard_request_start(int worker_id, int fd, uint64_t start_ns)
+{
+    worker_slot_t *slot = &g_worker_slots[worker_id];
+    atomic_store_explicit(&slot->state, WORKER_READING, memory_order_relaxed);
+    atomic_store_explicit(&slot->fd, fd, memory_order_relaxed);
+    atomic_store_explicit(&slot->request_start_ns, start_ns, memory_order_relaxed);
+}
+
+static inline void dashboard_request_done(int worker_id)
+{
+    worker_slot_t *slot = &g_worker_slots[worker_id];
+    atomic_store_explicit(&slot->served, atomic_load_explicit(&slot->served, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HPACK_MAX_TABLE_SIZE 4096
+#define HPACK_MAX_STRING 4096
+#define HPACK_ENTRY_OVERHEAD 32
+
+typedef struct
+{
+    uint16_t offset;
+    uint16_t name_len;
+    uint16_t value_len;
+} hpack_entry_t;
+
+/* Decoder dynamic table. Entries are kept oldest-first in a flat buffer. */
+typedef struct
+{
+    char data[HPACK_MAX_TABLE_SIZE];
+    size_t data_len;
+    hpack_entry_t entries[HPACK_MAX_TABLE_SIZE / HPACK_ENTRY_OVERHEAD];
+    int count;
+    size_t size;
+    size_t max_size;
+} hpack_table_t;
+
+typedef int (*hpack_header_cb)(void *ctx, const char *name, size_t name_len,
+                               const char *value, size_t value_len);
+
+/* Static table indexes used by the encoder. */
+#define HPACK_IDX_ACCEPT_RANGES 18
+#define HPACK_IDX_CONTENT_LENGTH 28
+#define HPACK_IDX_CONTENT_RANGE 30
+#define HPACK_IDX_CONTENT_TYPE 31
+#define HPACK_IDX_STATUS 8
+
+void hpack_table_init(hpack_table_t *table);
+int hpack_decode(hpack_table_t *table, const uint8_t *buf, size_t len, hpack_header_cb cb, void *ctx);
+
+size_t hpack_encode_status(uint8_t *out, size_t cap, int status);
+size_t hpack_encode_header(uint8_t *out, size_t cap, int name_index, const char *value);
+
+#endif
@@ -1,6 +1,61 @@
 #ifndef HTTP_H
 #define HTTP_H
 
-void handle_client(int client_fd);
+#include <stddef.h>
+#include "blockcache.h"
+#include "conn.h"
+#include "stats.h"
 
-#endif
\ No newline at end of file
+#define HTTP_PATH_MAX 255
+#define HTTP_BULK_HEADER_MAX 640
+#define HTTP_HEADER_GRACE_MS 1000
+
+typedef enum
+{
+    HTTP_CACHE_NORMAL = 0,
+    HTTP_CACHE_DROP_BEHIND,
+    HTTP_CACHE_DIRECT
+} http_cache_mode_t;
+
+typedef struct
+{
+    int fd;
+    http_cache_mode_t cache_mode;
+    const char *mime;
+    long file_size;
+    long start;
+    long end;
+    long content_length;
+    int cacheable;
+    block_file_t cache_file;
+    int peer;
+    const char *path;
+} http_resource_t;
+
+/* A response whose header is built and file is open, waiting for a bulk worker to stream it. */
+typedef struct
+{
+    client_t client;
+    http_resource_t res;
+    int keep_alive;
+    int status;
+    size_t header_len;
+    char header[HTTP_BULK_HEADER_MAX];
+    char path[HTTP_PATH_MAX + 16];
+} http_bulk_job_t;
+
+int handle_client(conn_t *conn);
+int http_serve_bulk(http_bulk_job_t *job, char *buf, size_t buf_cap);
+void http_set_keepalive(int timeout_ms, int max_requests);
+void http_set_bulk_threshold(long bytes);
+void http_set_uncached(long threshold_bytes, int use_direct);
+void http_set_header_limits(int timeout_ms, int min_rate, int max_bytes);
+size_class_t http_size_class(const char *mime, long content_length);
+
+const char *get_mime_type(const char *path);
+int http_normalize_path(char *file_path, size_t cap);
+int http_open_resource(const char *file_path, const char *range_spec, int from_peer, http_resource_t *res);
+ssize_t http_read_resource(const http_resource_t *res, void *buf, size_t len, off_t offset);
+void http_close_resource(http_resource_t *res);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef HTTP2_H
+#define HTTP2_H
+
+#include <stddef.h>
+#include "client.h"
+#include "parser.h"
+
+int http2_is_preface(const char *buf, size_t len);
+/* The buffer so far matches the start of the preface, which contains "\r\n\r\n" at byte 14. */
+int http2_is_partial_preface(const char *buf, size_t len);
+int http2_is_upgrade(const http_request_t *req);
+void http2_serve(client_t *client, const char *initial, size_t initial_len);
+void http2_upgrade(client_t *client, const http_request_t *request, const char *file_path,
+                   const char *leftover, size_t leftover_len);
+
+#endif
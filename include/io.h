@@ -0,0 +1,38 @@
+#ifndef IO_H
+#define IO_H
+
+#include <poll.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "client.h"
+#include "stats.h"
+
+#define IO_WAIT_TIMEOUT_MS 30000
+#define IO_COALESCE_MAX 16384
+#define IO_DIRECT_ALIGN 4096
+#define IO_DIRECT_BUFFER_SIZE (256 * 1024)
+#define IO_DROP_CHUNK (2 * 1024 * 1024)
+
+/* Wait deadline and O_DIRECT buffer: one per worker thread, or one per coroutine when they are on. */
+typedef struct
+{
+    uint64_t deadline_ns;
+    void *direct_buffer;
+} io_context_t;
+
+int io_wait(client_t *client, short events, int timeout_ms);
+uint64_t io_set_deadline(uint64_t deadline_ns);
+ssize_t io_read(client_t *client, void *buf, size_t len);
+int io_send_all(client_t *client, const void *buf, size_t len);
+int io_send_more(client_t *client, const void *buf, size_t len);
+int io_send_pair(client_t *client, const void *head, size_t head_len, const void *body, size_t body_len);
+int io_readable(client_t *client, int timeout_ms);
+ssize_t io_pread(int fd, void *buf, size_t len, off_t offset);
+ssize_t io_sendfile(client_t *client, int file_fd, off_t offset, size_t len);
+void *io_direct_buffer(void);
+void io_drop_cache(int file_fd, off_t offset, off_t len);
+
+void io_count_syscalls(syscall_kind_t kind, unsigned long count);
+void io_flush_syscall_stats(void);
+
+#endif
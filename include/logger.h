@@ -1,10 +1,72 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include <errno.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
 #define ID_PRODUCER -1
 
+/* Numeric so they work in #if: statements above LOG_COMPILE_LEVEL are not compiled at all. */
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_LINE_MAX 512
+#define LOG_RING_SIZE 256
+#define LOG_RATE_PER_SITE 10
+
+/* Per call site: at most LOG_RATE_PER_SITE warnings/errors per second, the rest are counted. */
+typedef struct
+{
+    atomic_ulong window;
+    atomic_uint count;
+    atomic_ulong suppressed;
+} log_site_t;
+
 void init_logger(int worker_count, const char *logfile);
 int is_logging_enabled(void);
+void mute_console(void);
 void log_event(int entity_id, int client_fd, const char *state, const char *comment);
 
+void init_log_writer(int runtime_level);
+int parse_log_level(const char *name);
+void log_flush(void);
+void log_write(int fd, const char *line, size_t len);
+void log_message(log_site_t *site, int level, int err, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+
+#define LOG_AT(level, err, ...)                                  \
+    do                                                           \
+    {                                                            \
+        static log_site_t log_site_;                             \
+        log_message(&log_site_, (level), (err), __VA_ARGS__);   \
+    } while (0)
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_DEBUG
+#define log_debug(...) LOG_AT(LOG_LEVEL_DEBUG, 0, __VA_ARGS__)
+#else
+#define log_debug(...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_INFO
+#define log_info(...) LOG_AT(LOG_LEVEL_INFO, 0, __VA_ARGS__)
+#else
+#define log_info(...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_WARN
+#define log_warn(...) LOG_AT(LOG_LEVEL_WARN, 0, __VA_ARGS__)
+#else
+#define log_warn(...) ((void)0)
+#endif
+
+#define log_error(...) LOG_AT(LOG_LEVEL_ERROR, 0, __VA_ARGS__)
+/* perror() replacement for the request path: same "what: strerror" line, through the ring. */
+#define log_errno(what) LOG_AT(LOG_LEVEL_ERROR, errno, "%s", (what))
+
 #endif
@@ -1,8 +1,29 @@
 #ifndef PARSER_H
 #define PARSER_H
 
-void sanitize_path(char *path);
+#include <stddef.h>
+#include "arena.h"
 
-void parse_http_request(char *request, char *method, char *file_path);
+#define HTTP_MAX_HEADERS 64
+
+typedef struct
+{
+    const char *name;
+    const char *value;
+} http_header_t;
+
+typedef struct
+{
+    const char *method;
+    const char *path;
+    const char *version;
+    http_header_t *headers;
+    int header_count;
+    int keep_alive;
+} http_request_t;
+
+int parse_http_request(const char *request, size_t len, arena_t *arena, http_request_t *req);
+
+const char *http_request_header(const http_request_t *req, const char *name);
 
 #endif
@@ -0,0 +1,15 @@
+#ifndef PREFORK_H
+#define PREFORK_H
+
+#define PREFORK_MAX_PROCESSES 64
+#define PREFORK_RESPAWN_BACKOFF_MS 1000
+#define PREFORK_STOP_GRACE_MS 5000
+
+/*
+ * Forks `processes` children that inherit the listening sockets. Returns the child's index
+ * (0..processes-1) inside each child, including children respawned after a crash. In the
+ * supervisor it only returns -1, once should_stop() is true and every child has been reaped.
+ */
+int prefork_run(int processes, int (*should_stop)(void));
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/*
+ * USDT probes under the "happytree" provider (see tools/probes/). With <sys/sdt.h> each probe is a
+ * single nop plus an ELF note that bpftrace or perf patch only while attached. Without the header,
+ * or with `make PROBES=0`, they compile to nothing. Arguments are evaluated whenever probes are
+ * compiled in, so pass values that are already at hand.
+ */
+#if !defined(NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef HAVE_PROBES
+#define PROBE1(name, a) DTRACE_PROBE1(happytree, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(happytree, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(happytree, name, a, b, c)
+#define PROBE4(name, a, b, c, d) DTRACE_PROBE4(happytree, name, a, b, c, d)
+#else
+#define PROBE1(name, a) ((void)sizeof(a))
+#define PROBE2(name, a, b) ((void)sizeof(a), (void)sizeof(b))
+#define PROBE3(name, a, b, c) ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c))
+#define PROBE4(name, a, b, c, d) ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c), (void)sizeof(d))
+#endif
+
+#endif
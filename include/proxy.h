@@ -0,0 +1,25 @@
+#ifndef PROXY_H
+#define PROXY_H
+
+#include <sys/socket.h>
+#include "client.h"
+
+/* v1 lines are at most 107 bytes; v2 receivers are expected to accept at least 536. */
+#define PROXY_V1_MAX 107
+#define PROXY_HEADER_MAX 536
+
+/*
+ * Parses a PROXY protocol v1 or v2 header at the start of buf. Returns the header length once it
+ * is complete, 0 if more bytes are needed and -1 if it is malformed. The source address replaces
+ * *peer only for proxied TCP over IPv4/IPv6; LOCAL and UNKNOWN headers keep the socket peer.
+ */
+long proxy_parse(const unsigned char *buf, size_t len, struct sockaddr_storage *peer, socklen_t *peer_len);
+
+/*
+ * Reads the header off the client socket, consuming exactly its bytes. Returns 1 when done, -1 on
+ * a bad header, EOF or the io_wait deadline, and 0 if it has not fully arrived and may_wait is 0
+ * (nothing is consumed in that case, so a worker can retry with may_wait set).
+ */
+int proxy_accept(client_t *client, int may_wait);
+
+#endif
@@ -1,12 +1,54 @@
 #ifndef SERVER_H
 #define SERVER_H
 
-int create_socket_and_listen(int port);
+#include "client.h"
+#include "http.h"
 
-int accept_connection(int listen_fd);
+#define CLIENT_QUEUE_CAPACITY 64
+#define CLIENT_GROUPS 1024
+#define CLIENT_REPORT_TOP 10
+#define BULK_QUEUE_CAPACITY 64
 
-void init_thread_pool(int worker_count);
+typedef struct
+{
+    int enabled;
+    int prefix_bits;
+    int client_cap;
+    int per_client_queue;
+    int quantum;
+} fair_queue_options_t;
 
-void enqueue_client(int client_fd);
+typedef struct
+{
+    int backlog;
+    int defer_accept_s;
+    int fastopen_qlen;
+} listen_options_t;
+
+void set_listen_options(const listen_options_t *options);
+
+int create_socket_and_listen(const char *address, int port);
+
+int create_unix_listener(const char *path);
+
+int accept_connection(int listen_fd, client_t *client);
+
+void set_coroutines(int per_worker);
+
+void init_thread_pool(int worker_count, int bulk_worker_count);
+
+int is_bulk_pool_enabled(void);
+
+int dispatch_bulk(const http_bulk_job_t *job);
+
+void set_fair_queue_options(const fair_queue_options_t *options);
+
+int enqueue_client(const client_t *client);
+
+void reject_client(const client_t *client);
+
+void print_client_queue_stats(const char *outfile);
+
+int client_queue_depth(void);
 
 #endif
\ No newline at end of file
@@ -4,6 +4,52 @@
 #include <stdatomic.h>
 #include <time.h>
 
+#define LATENCY_BUCKETS 32
+
+typedef enum
+{
+    PHASE_ENQUEUE = 0,
+    PHASE_QUEUE_WAIT,
+    PHASE_READ_PARSE,
+    PHASE_OPEN,
+    PHASE_FIRST_BYTE,
+    PHASE_TRANSFER,
+    PHASE_TOTAL,
+    PHASE_COUNT
+} phase_t;
+
+typedef enum
+{
+    SYSCALL_READ = 0,
+    SYSCALL_WRITE,
+    SYSCALL_FILE,
+    SYSCALL_WAIT,
+    SYSCALL_KIND_COUNT
+} syscall_kind_t;
+
+typedef enum
+{
+    BLOCK_LOOKUP_HIT = 0,
+    BLOCK_LOOKUP_MISS,
+    BLOCK_LOOKUP_BYPASS,
+    BLOCK_LOOKUP_COUNT
+} block_lookup_t;
+
+typedef enum
+{
+    SIZE_CLASS_SMALL = 0,
+    SIZE_CLASS_BULK,
+    SIZE_CLASS_COUNT
+} size_class_t;
+
+/* Bucket i counts samples in [2^(i-1), 2^i) microseconds; bucket 0 is < 1us. */
+typedef struct
+{
+    atomic_ullong buckets[LATENCY_BUCKETS];
+    atomic_ullong count;
+    atomic_ullong sum_us;
+} latency_histogram_t;
+
 typedef struct
 {
     atomic_ulong total_requests;
@@ -13,10 +59,43 @@ typedef struct
     atomic_ullong bytes_sent;
     atomic_ullong total_turnaround_time_us;
     atomic_ullong total_response_time_us;
+    atomic_ulong tls_handshakes;
+    atomic_ulong tls_resumed;
+    atomic_ulong tls_ktls;
+    atomic_ulong tls_failed;
+    atomic_ulong conn_objects;
+    atomic_ullong conn_bytes;
+    atomic_ulong arena_peak;
+    atomic_ulong accept_wakeups;
+    atomic_ulong accepted_connections;
+    atomic_ulong header_timeouts;
+    atomic_ulong header_slow;
+    atomic_ulong process_respawns;
+    atomic_ulong coro_peak;
+    atomic_ulong coro_offloads;
+    atomic_ulong block_lookups[BLOCK_LOOKUP_COUNT];
+    atomic_ulong block_evictions;
+    atomic_ulong peer_fetches;
+    atomic_ulong peer_fetch_failures;
+    atomic_ullong peer_fetch_bytes;
+    atomic_ulong peer_requests;
+    atomic_ulong hot_routes;
+    atomic_ullong syscalls[SYSCALL_KIND_COUNT];
+    latency_histogram_t phases[PHASE_COUNT];
+    latency_histogram_t turnaround;
+    latency_histogram_t size_classes[SIZE_CLASS_COUNT];
     time_t start_time;
 } server_stats_t;
 
-void init_stats(void);
+typedef struct
+{
+    unsigned long requests;
+    unsigned long long bytes_sent;
+    unsigned long long turnaround_buckets[LATENCY_BUCKETS];
+} stats_snapshot_t;
+
+void init_stats(int shards);
+void stats_use_shard(int index);
 void increment_requests(void);
 void increment_successful(void);
 void increment_failed(void);
@@ -24,6 +103,25 @@ void increment_aborted(void);
 void add_bytes_sent(unsigned long bytes);
 void add_turnaround_time(unsigned long long microseconds);
 void add_response_time(unsigned long long microseconds);
+void record_tls_handshake(int resumed, int ktls);
+void increment_tls_failed(void);
+void add_conn_objects(unsigned long count, unsigned long long bytes_each);
+void update_arena_peak(unsigned long bytes);
+void record_accept_batch(unsigned long accepted);
+void record_header_timeout(int below_min_rate);
+void record_respawn(void);
+void update_coro_peak(unsigned long active);
+void increment_coro_offloads(void);
+void record_block_lookup(block_lookup_t outcome);
+void record_block_eviction(void);
+void record_peer_fetch(int ok, unsigned long bytes);
+void record_peer_request(void);
+void record_hot_route(void);
+void add_syscalls(const unsigned long counts[SYSCALL_KIND_COUNT]);
+void add_phase_sample(phase_t phase, unsigned long long microseconds);
+void add_size_class_sample(size_class_t size_class, unsigned long long microseconds);
+void stats_snapshot(stats_snapshot_t *snap);
+unsigned long long histogram_percentile(const unsigned long long *buckets, unsigned long long count, double pct);
 void print_stats(const char *outfile);
 
 #endif
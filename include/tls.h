@@ -0,0 +1,16 @@
+#ifndef TLS_H
+#define TLS_H
+
+#include <sys/types.h>
+#include "client.h"
+
+int init_tls(const char *cert_file, const char *key_file);
+int is_tls_enabled(void);
+int tls_accept(client_t *client);
+int tls_pending(client_t *client);
+ssize_t tls_read(client_t *client, void *buf, size_t len);
+ssize_t tls_write(client_t *client, const void *buf, size_t len);
+ssize_t tls_sendfile(client_t *client, int file_fd, off_t offset, size_t len);
+void tls_close(client_t *client);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "stats.h"
+
+typedef enum
+{
+    TRACE_ACCEPT = 0,
+    TRACE_ENQUEUE,
+    TRACE_DEQUEUE,
+    TRACE_PARSE_DONE,
+    TRACE_FILE_OPEN,
+    TRACE_FIRST_BYTE,
+    TRACE_LAST_BYTE,
+    TRACE_POINT_COUNT
+} trace_point_t;
+
+typedef struct
+{
+    uint64_t ts_ns[TRACE_POINT_COUNT];
+} request_trace_t;
+
+uint64_t trace_now_ns(void);
+
+static inline void trace_mark(request_trace_t *trace, trace_point_t point)
+{
+    trace->ts_ns[point] = trace_now_ns();
+}
+
+unsigned long long trace_phase_us(const request_trace_t *trace, phase_t phase);
+void init_trace(unsigned long slow_threshold_us, unsigned int sample_every);
+void trace_finish(const request_trace_t *trace, int client_fd, const char *path);
+
+#endif
@@ -0,0 +1,335 @@
+#include "accesslog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "logger.h"
+#include "trace.h"
+
+#define PATH_TABLE_SIZE 4096
+#define BATCH_MAX_AGE_US 1000000ULL
+#define FLUSHER_INTERVAL_US 250000
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    access_record_t records[ACCESS_LOG_BATCH];
+    int count;
+    uint64_t first_us;
+} access_batch_t;
+
+static int g_enabled = 0;
+static char *g_path = NULL;
+static unsigned long long g_rotate_bytes = 0;
+static int g_fd = -1;
+static int g_paths_fd = -1;
+static unsigned long long g_file_size = 0;
+static pthread_mutex_t g_file_mutex = PTHREAD_MUTEX_INITIALIZER;
+static access_batch_t *g_batches = NULL;
+static int g_batch_count = 0;
+static _Atomic uint32_t g_path_table[PATH_TABLE_SIZE];
+
+static uint64_t wall_clock_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000ULL + (uint64_t)tv.tv_usec;
+}
+
+static int write_full(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Opens the log (writing the header to a new file); -1 leaves g_fd untouched. */
+static int open_log_file(void)
+{
+    int fd = open(g_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    struct stat st;
+    g_fd = fd;
+    g_file_size = (fstat(g_fd, &st) == 0) ? (unsigned long long)st.st_size : 0;
+    if (g_file_size == 0)
+    {
+        access_log_header_t header = {0};
+        memcpy(header.magic, ACCESS_LOG_MAGIC, sizeof(header.magic));
+        header.version = ACCESS_LOG_VERSION;
+        header.record_size = sizeof(access_record_t);
+        header.created_us = wall_clock_us();
+        if (write_full(g_fd, &header, sizeof(header)) == 0)
+        {
+            g_file_size = sizeof(header);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Shifts path -> path.1 -> ... -> path.N, dropping the oldest. Caller holds g_file_mutex. This runs
+ * on a worker or the flusher, so a failure never stops the server: the old fd keeps receiving
+ * records and the next attempt waits for another rotate_bytes.
+ */
+static void rotate_log_file(void)
+{
+    char from[1024], to[1024];
+    for (int i = ACCESS_LOG_KEEP - 1; i >= 1; i--)
+    {
+        snprintf(from, sizeof(from), "%s.%d", g_path, i);
+        snprintf(to, sizeof(to), "%s.%d", g_path, i + 1);
+        if (rename(from, to) != 0 && errno != ENOENT)
+        {
+            log_errno("Failed to shift rotated access log");
+        }
+    }
+    snprintf(to, sizeof(to), "%s.1", g_path);
+    if (rename(g_path, to) != 0)
+    {
+        log_errno("Failed to rotate access log; appending to the current file");
+        g_file_size = 0;
+        return;
+    }
+
+    int old_fd = g_fd;
+    if (open_log_file() != 0)
+    {
+        log_errno("Failed to reopen access log; appending to the rotated file");
+        g_file_size = 0;
+        return;
+    }
+    close(old_fd);
+}
+
+static void flush_batch_locked(access_batch_t *batch)
+{
+    if (batch->count == 0)
+    {
+        return;
+    }
+    size_t len = (size_t)batch->count * sizeof(access_record_t);
+
+    pthread_mutex_lock(&g_file_mutex);
+    if (write_full(g_fd, batch->records, len) == 0)
+    {
+        g_file_size += len;
+    }
+    if (g_rotate_bytes > 0 && g_file_size >= g_rotate_bytes)
+    {
+        rotate_log_file();
+    }
+    pthread_mutex_unlock(&g_file_mutex);
+
+    batch->count = 0;
+}
+
+/* Idle workers never reach the age check in access_log_request; this sweeps their batches. */
+static void *flusher_main(void *arg)
+{
+    (void)arg;
+    for (;;)
+    {
+        usleep(FLUSHER_INTERVAL_US);
+        uint64_t now = wall_clock_us();
+        for (int i = 0; i < g_batch_count; i++)
+        {
+            access_batch_t *batch = &g_batches[i];
+            pthread_mutex_lock(&batch->mutex);
+            if (batch->count > 0 && now - batch->first_us >= BATCH_MAX_AGE_US)
+            {
+                flush_batch_locked(batch);
+            }
+            pthread_mutex_unlock(&batch->mutex);
+        }
+    }
+    return NULL;
+}
+
+void init_access_log(const char *path, unsigned long long rotate_bytes, int worker_count)
+{
+    g_path = strdup(path);
+    g_rotate_bytes = rotate_bytes;
+    g_batch_count = worker_count;
+    g_batches = calloc((size_t)worker_count, sizeof(access_batch_t));
+    if (!g_path || !g_batches)
+    {
+        perror("Failed to allocate access log buffers");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < worker_count; i++)
+    {
+        pthread_mutex_init(&g_batches[i].mutex, NULL);
+    }
+    for (int i = 0; i < PATH_TABLE_SIZE; i++)
+    {
+        atomic_init(&g_path_table[i], 0);
+    }
+
+    if (open_log_file() != 0)
+    {
+        perror("Failed to open access log");
+        exit(EXIT_FAILURE);
+    }
+
+    char paths_file[1024];
+    snprintf(paths_file, sizeof(paths_file), "%s.paths", g_path);
+    g_paths_fd = open(paths_file, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    pthread_t flusher;
+    if (pthread_create(&flusher, NULL, flusher_main, NULL) != 0)
+    {
+        perror("pthread_create access log flusher");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(flusher);
+
+    g_enabled = 1;
+}
+
+int is_access_log_enabled(void)
+{
+    return g_enabled;
+}
+
+uint32_t access_log_path_id(const char *path)
+{
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++)
+    {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
+/* Appends "id\tpath" to the sidecar dictionary the first time an id is seen. */
+static void remember_path(uint32_t id, const char *path)
+{
+    if (g_paths_fd < 0)
+    {
+        return;
+    }
+    for (uint32_t i = 0; i < PATH_TABLE_SIZE; i++)
+    {
+        _Atomic uint32_t *slot = &g_path_table[(id + i) % PATH_TABLE_SIZE];
+        uint32_t current = atomic_load_explicit(slot, memory_order_relaxed);
+        if (current == id)
+        {
+            return;
+        }
+        if (current == 0)
+        {
+            uint32_t expected = 0;
+            if (atomic_compare_exchange_strong(slot, &expected, id))
+            {
+                char line[512];
+                int len = snprintf(line, sizeof(line), "%08x\t%s\n", id, path);
+                if (len >= (int)sizeof(line))
+                {
+                    /* Very long paths are kept truncated rather than left as a bare hash. */
+                    len = (int)sizeof(line) - 1;
+                    line[len - 1] = '\n';
+                }
+                if (len > 0)
+                {
+                    write_full(g_paths_fd, line, (size_t)len);
+                }
+                return;
+            }
+            if (expected == id)
+            {
+                return;
+            }
+        }
+    }
+}
+
+void access_log_request(const client_t *client, const char *path, int status,
+                        unsigned long long bytes, long range_start, long range_end)
+{
+    if (!g_enabled || client->worker_id < 0 || client->worker_id >= g_batch_count)
+    {
+        return;
+    }
+
+    access_batch_t *batch = &g_batches[client->worker_id];
+    uint64_t now = wall_clock_us();
+    uint32_t path_id = access_log_path_id(path);
+    remember_path(path_id, path);
+
+    pthread_mutex_lock(&batch->mutex);
+    if (batch->count == 0)
+    {
+        batch->first_us = now;
+    }
+
+    access_record_t *r = &batch->records[batch->count++];
+    memset(r, 0, sizeof(*r));
+    r->timestamp_us = now;
+    r->bytes = bytes;
+    r->range_start = range_start;
+    r->range_end = range_end;
+    r->path_id = path_id;
+    r->fd = client->fd;
+    r->status = (uint16_t)status;
+    r->worker_id = (uint16_t)client->worker_id;
+    r->peer_family = client->peer.ss_family;
+    if (client->peer.ss_family == AF_INET)
+    {
+        const struct sockaddr_in *in = (const struct sockaddr_in *)&client->peer;
+        r->peer_port = ntohs(in->sin_port);
+        memcpy(r->peer_addr, &in->sin_addr, sizeof(in->sin_addr));
+    }
+    else if (client->peer.ss_family == AF_INET6)
+    {
+        const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)&client->peer;
+        r->peer_port = ntohs(in6->sin6_port);
+        memcpy(r->peer_addr, &in6->sin6_addr, sizeof(in6->sin6_addr));
+    }
+    for (int p = 0; p < PHASE_COUNT; p++)
+    {
+        unsigned long long us = trace_phase_us(&client->trace, (phase_t)p);
+        r->phase_us[p] = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+    }
+
+    if (batch->count == ACCESS_LOG_BATCH || now - batch->first_us >= BATCH_MAX_AGE_US)
+    {
+        flush_batch_locked(batch);
+    }
+    pthread_mutex_unlock(&batch->mutex);
+}
+
+void close_access_log(void)
+{
+    if (!g_enabled)
+    {
+        return;
+    }
+    for (int i = 0; i < g_batch_count; i++)
+    {
+        pthread_mutex_lock(&g_batches[i].mutex);
+        flush_batch_locked(&g_batches[i]);
+        pthread_mutex_unlock(&g_batches[i].mutex);
+    }
+    fsync(g_fd);
+}
@@ -0,0 +1,363 @@
+#include "blockcache.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "cluster.h"
+#include "io.h"
+#include "stats.h"
+
+typedef enum
+{
+    BLOCK_FREE = 0,
+    BLOCK_LOADING,
+    BLOCK_READY
+} block_state_t;
+
+typedef enum
+{
+    SEGMENT_NONE = 0,
+    SEGMENT_PROBATION,
+    SEGMENT_PROTECTED
+} block_segment_t;
+
+struct block
+{
+    block_file_t file;
+    long index;
+    char *data;
+    size_t len;
+    int refs;
+    block_state_t state;
+    block_segment_t segment;
+    struct block *hash_next;
+    struct block *prev;
+    struct block *next;
+    struct shard *shard;
+};
+
+/* Most recently used at the head. */
+typedef struct
+{
+    block_t *head;
+    block_t *tail;
+    int count;
+} block_list_t;
+
+/*
+ * Segmented LRU per shard: a block enters probation and only a second hit moves it to the protected
+ * segment, so one pass over a large file recycles probation without flushing blocks that are
+ * actually shared. Protected overflow is demoted back to the head of probation.
+ */
+typedef struct shard
+{
+    pthread_mutex_t mutex;
+    block_t **buckets;
+    size_t bucket_mask;
+    block_list_t probation;
+    block_list_t protected;
+    block_t *free_list;
+    int protected_max;
+} cache_shard_t;
+
+static cache_shard_t *g_shards = NULL;
+static int g_shard_count = 0;
+static int g_enabled = 0;
+
+static uint64_t block_hash(const block_file_t *file, long index)
+{
+    uint64_t h = (uint64_t)file->ino * 0x9E3779B97F4A7C15ULL;
+    h ^= (uint64_t)file->dev + 0x632BE59BD9B4E019ULL + (h << 6) + (h >> 2);
+    h ^= (uint64_t)file->mtime_ns + (h << 6) + (h >> 2);
+    h ^= (uint64_t)index * 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static int same_block(const block_t *b, const block_file_t *file, long index)
+{
+    return b->index == index && b->file.ino == file->ino && b->file.dev == file->dev &&
+           b->file.size == file->size && b->file.mtime_ns == file->mtime_ns;
+}
+
+static void list_remove(block_list_t *list, block_t *b)
+{
+    if (b->prev)
+        b->prev->next = b->next;
+    else
+        list->head = b->next;
+    if (b->next)
+        b->next->prev = b->prev;
+    else
+        list->tail = b->prev;
+    b->prev = b->next = NULL;
+    list->count--;
+}
+
+static void list_push_head(block_list_t *list, block_t *b)
+{
+    b->prev = NULL;
+    b->next = list->head;
+    if (list->head)
+        list->head->prev = b;
+    else
+        list->tail = b;
+    list->head = b;
+    list->count++;
+}
+
+static block_list_t *segment_list(cache_shard_t *s, block_segment_t segment)
+{
+    return segment == SEGMENT_PROTECTED ? &s->protected : &s->probation;
+}
+
+static void hash_insert(cache_shard_t *s, block_t *b, uint64_t h)
+{
+    block_t **bucket = &s->buckets[h & s->bucket_mask];
+    b->hash_next = *bucket;
+    *bucket = b;
+}
+
+static void hash_remove(cache_shard_t *s, block_t *b)
+{
+    block_t **link = &s->buckets[block_hash(&b->file, b->index) & s->bucket_mask];
+    while (*link && *link != b)
+    {
+        link = &(*link)->hash_next;
+    }
+    if (*link)
+    {
+        *link = b->hash_next;
+    }
+    b->hash_next = NULL;
+}
+
+/* A hit in probation earns protection; a hit in protected just refreshes its position. */
+static void touch(cache_shard_t *s, block_t *b)
+{
+    list_remove(segment_list(s, b->segment), b);
+    b->segment = SEGMENT_PROTECTED;
+    list_push_head(&s->protected, b);
+    while (s->protected.count > s->protected_max)
+    {
+        block_t *demoted = s->protected.tail;
+        list_remove(&s->protected, demoted);
+        demoted->segment = SEGMENT_PROBATION;
+        list_push_head(&s->probation, demoted);
+    }
+}
+
+static block_t *unpinned_tail(block_list_t *list)
+{
+    for (block_t *b = list->tail; b; b = b->prev)
+    {
+        if (b->refs == 0)
+        {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/* Probation first; protected blocks are only taken when everything in probation is in flight. */
+static block_t *take_victim(cache_shard_t *s)
+{
+    block_t *b = s->free_list;
+    if (b)
+    {
+        s->free_list = b->next;
+        b->next = NULL;
+        return b;
+    }
+    if (!(b = unpinned_tail(&s->probation)) && !(b = unpinned_tail(&s->protected)))
+    {
+        return NULL;
+    }
+    list_remove(segment_list(s, b->segment), b);
+    hash_remove(s, b);
+    record_block_eviction();
+    return b;
+}
+
+static void discard(cache_shard_t *s, block_t *b)
+{
+    list_remove(segment_list(s, b->segment), b);
+    hash_remove(s, b);
+    b->state = BLOCK_FREE;
+    b->segment = SEGMENT_NONE;
+    b->refs = 0;
+    b->next = s->free_list;
+    s->free_list = b;
+}
+
+void init_block_cache(size_t bytes)
+{
+    size_t blocks = bytes / BLOCK_CACHE_BLOCK_SIZE;
+    if (blocks == 0)
+    {
+        return;
+    }
+    g_shard_count = blocks < BLOCK_CACHE_SHARDS ? (int)blocks : BLOCK_CACHE_SHARDS;
+
+    /* Page-aligned blocks double as O_DIRECT buffers. */
+    char *memory = mmap(NULL, blocks * BLOCK_CACHE_BLOCK_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    block_t *descriptors = calloc(blocks, sizeof(block_t));
+    g_shards = calloc((size_t)g_shard_count, sizeof(cache_shard_t));
+    if (memory == MAP_FAILED || !descriptors || !g_shards)
+    {
+        perror("Failed to allocate block cache");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < g_shard_count; i++)
+    {
+        cache_shard_t *s = &g_shards[i];
+        size_t share = blocks / (size_t)g_shard_count + ((size_t)i < blocks % (size_t)g_shard_count);
+        size_t buckets = 1;
+        while (buckets < share * 2)
+        {
+            buckets <<= 1;
+        }
+        s->buckets = calloc(buckets, sizeof(block_t *));
+        if (!s->buckets || pthread_mutex_init(&s->mutex, NULL) != 0)
+        {
+            perror("Failed to initialise block cache shard");
+            exit(EXIT_FAILURE);
+        }
+        s->bucket_mask = buckets - 1;
+        s->protected_max = (int)(share * BLOCK_CACHE_PROTECTED_PCT / 100);
+        if (s->protected_max < 1)
+        {
+            s->protected_max = 1;
+        }
+    }
+
+    for (size_t i = 0; i < blocks; i++)
+    {
+        block_t *b = &descriptors[i];
+        cache_shard_t *s = &g_shards[i % (size_t)g_shard_count];
+        b->data = memory + i * BLOCK_CACHE_BLOCK_SIZE;
+        b->shard = s;
+        b->next = s->free_list;
+        s->free_list = b;
+    }
+    g_enabled = 1;
+}
+
+int is_block_cache_enabled(void)
+{
+    return g_enabled;
+}
+
+/* Reads the whole block; O_DIRECT descriptors get an aligned length and simply stop at EOF.
+ * A peer that fails or disagrees about the file falls back to local storage. */
+static int load_block(block_t *b, const block_source_t *source)
+{
+    off_t offset = (off_t)b->index * BLOCK_CACHE_BLOCK_SIZE;
+    size_t want = (size_t)(b->file.size - offset);
+    if (want > BLOCK_CACHE_BLOCK_SIZE)
+    {
+        want = BLOCK_CACHE_BLOCK_SIZE;
+    }
+    if (source->peer >= 0 && cluster_fetch(source->peer, source->path, b->file.size, offset, b->data, want) == 0)
+    {
+        b->len = want;
+        return 0;
+    }
+    size_t read_len = (want + IO_DIRECT_ALIGN - 1) & ~(size_t)(IO_DIRECT_ALIGN - 1);
+
+    size_t got = 0;
+    while (got < want)
+    {
+        ssize_t n = io_pread(source->fd, b->data + got, read_len - got, offset + (off_t)got);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        got += (size_t)n;
+    }
+    b->len = want;
+    if (source->drop_behind)
+    {
+        io_drop_cache(source->fd, offset, (off_t)want);
+    }
+    return 0;
+}
+
+block_t *block_cache_acquire(const block_file_t *file, long index, const block_source_t *source, const char **data,
+                             size_t *len)
+{
+    uint64_t h = block_hash(file, index);
+    cache_shard_t *s = &g_shards[(h >> 32) % (uint64_t)g_shard_count];
+
+    pthread_mutex_lock(&s->mutex);
+    block_t *b = s->buckets[h & s->bucket_mask];
+    while (b && !same_block(b, file, index))
+    {
+        b = b->hash_next;
+    }
+
+    /* Never wait for another loader: under coroutines it may be parked on this very thread. */
+    if (b && b->state == BLOCK_LOADING)
+    {
+        pthread_mutex_unlock(&s->mutex);
+        record_block_lookup(BLOCK_LOOKUP_BYPASS);
+        return NULL;
+    }
+    if (b)
+    {
+        b->refs++;
+        touch(s, b);
+        pthread_mutex_unlock(&s->mutex);
+        record_block_lookup(BLOCK_LOOKUP_HIT);
+        *data = b->data;
+        *len = b->len;
+        return b;
+    }
+
+    if (!(b = take_victim(s)))
+    {
+        pthread_mutex_unlock(&s->mutex);
+        record_block_lookup(BLOCK_LOOKUP_BYPASS);
+        return NULL;
+    }
+    b->file = *file;
+    b->index = index;
+    b->len = 0;
+    b->refs = 1;
+    b->state = BLOCK_LOADING;
+    b->segment = SEGMENT_PROBATION;
+    list_push_head(&s->probation, b);
+    hash_insert(s, b, h);
+    pthread_mutex_unlock(&s->mutex);
+
+    int failed = load_block(b, source) != 0;
+
+    pthread_mutex_lock(&s->mutex);
+    if (failed)
+    {
+        discard(s, b);
+        pthread_mutex_unlock(&s->mutex);
+        record_block_lookup(BLOCK_LOOKUP_BYPASS);
+        return NULL;
+    }
+    b->state = BLOCK_READY;
+    pthread_mutex_unlock(&s->mutex);
+    record_block_lookup(BLOCK_LOOKUP_MISS);
+    *data = b->data;
+    *len = b->len;
+    return b;
+}
+
+void block_cache_release(block_t *block)
+{
+    cache_shard_t *s = block->shard;
+    pthread_mutex_lock(&s->mutex);
+    block->refs--;
+    pthread_mutex_unlock(&s->mutex);
+}
@@ -0,0 +1,105 @@
+#include "capture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "logger.h"
+#include "trace.h"
+
+static int g_fd = -1;
+static unsigned int g_sample_every = 1;
+static uint64_t g_start_ns = 0;
+static uint64_t g_last_ns = 0;
+static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void init_capture(const char *path, unsigned int sample_every)
+{
+    g_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (g_fd < 0)
+    {
+        perror("Failed to open capture file");
+        exit(EXIT_FAILURE);
+    }
+    g_sample_every = sample_every > 0 ? sample_every : 1;
+    g_start_ns = trace_now_ns();
+    g_last_ns = g_start_ns;
+}
+
+int is_capture_enabled(void)
+{
+    return g_fd >= 0;
+}
+
+static size_t json_string(char *out, size_t cap, const char *s)
+{
+    size_t n = 0;
+    if (!s)
+    {
+        return (size_t)snprintf(out, cap, "null");
+    }
+
+    out[n++] = '"';
+    for (; *s && n + 8 < cap; s++)
+    {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+        {
+            out[n++] = '\\';
+            out[n++] = (char)c;
+        }
+        else if (c < 0x20)
+        {
+            n += (size_t)snprintf(out + n, cap - n, "\\u%04x", c);
+        }
+        else
+        {
+            out[n++] = (char)c;
+        }
+    }
+    out[n++] = '"';
+    out[n] = '\0';
+    return n;
+}
+
+/* Sampling is per connection so a replayed connection always has its full request sequence. */
+void capture_request(const client_t *client, const char *method, const char *path, const char *range)
+{
+    if (g_fd < 0 || client->conn_id % g_sample_every != 0)
+    {
+        return;
+    }
+
+    char line[CAPTURE_LINE_MAX];
+    char method_json[64];
+    char path_json[CAPTURE_LINE_MAX / 2];
+    char range_json[128];
+    json_string(method_json, sizeof(method_json), method);
+    json_string(path_json, sizeof(path_json), path);
+    json_string(range_json, sizeof(range_json), range);
+
+    pthread_mutex_lock(&g_mutex);
+    uint64_t now_ns = trace_now_ns();
+    uint64_t gap_ns = now_ns - g_last_ns;
+    g_last_ns = now_ns;
+    int len = snprintf(line, sizeof(line),
+                       "{\"t_us\":%llu,\"gap_us\":%llu,\"conn\":%lu,\"method\":%s,\"path\":%s,\"range\":%s}\n",
+                       (unsigned long long)((now_ns - g_start_ns) / 1000ULL),
+                       (unsigned long long)(gap_ns / 1000ULL), client->conn_id,
+                       method_json, path_json, range_json);
+    if (len > 0 && (size_t)len < sizeof(line) && write(g_fd, line, (size_t)len) < 0)
+    {
+        log_errno("capture write");
+    }
+    pthread_mutex_unlock(&g_mutex);
+}
+
+void close_capture(void)
+{
+    if (g_fd >= 0)
+    {
+        close(g_fd);
+        g_fd = -1;
+    }
+}
@@ -0,0 +1,479 @@
+#define _GNU_SOURCE
+#include "cluster.h"
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "io.h"
+#include "logger.h"
+#include "stats.h"
+#include "trace.h"
+
+#define CLUSTER_HEAD_MAX 1024
+
+typedef struct
+{
+    char label[128];
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    pthread_mutex_t mutex;
+    int idle[CLUSTER_IDLE_MAX];
+    int idle_count;
+} cluster_peer_t;
+
+typedef struct
+{
+    uint64_t hash;
+    int peer;
+} ring_point_t;
+
+/* Per-path request rate over the current and previous second; collisions just share a counter. */
+typedef struct
+{
+    atomic_ullong key;
+    atomic_uint window;
+    atomic_uint count;
+    atomic_uint prev_count;
+} hot_slot_t;
+
+static cluster_peer_t g_peers[CLUSTER_MAX_PEERS];
+static int g_peer_count = 0;
+static int g_self = -1;
+static ring_point_t *g_ring = NULL;
+static int g_ring_size = 0;
+static int g_hot_threshold = 0;
+static hot_slot_t g_hot[CLUSTER_HOT_SLOTS];
+static char g_secret[CLUSTER_SECRET_MAX + 1];
+static int g_enabled = 0;
+
+static uint64_t hash_string(const char *s)
+{
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (; *s; s++)
+    {
+        h ^= (unsigned char)*s;
+        h *= 0x100000001B3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static int compare_points(const void *a, const void *b)
+{
+    uint64_t x = ((const ring_point_t *)a)->hash, y = ((const ring_point_t *)b)->hash;
+    return x < y ? -1 : x > y;
+}
+
+static void add_peer(const char *entry)
+{
+    if (g_peer_count == CLUSTER_MAX_PEERS)
+    {
+        fprintf(stderr, "--peers admite hasta %d instancias\n", CLUSTER_MAX_PEERS);
+        exit(EXIT_FAILURE);
+    }
+    cluster_peer_t *p = &g_peers[g_peer_count];
+    snprintf(p->label, sizeof(p->label), "%s", entry);
+
+    char host[128];
+    const char *colon = strrchr(entry, ':');
+    if (!colon || colon == entry || (size_t)(colon - entry) >= sizeof(host))
+    {
+        fprintf(stderr, "Peer inválido (se espera host:puerto): %s\n", entry);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(host, entry, (size_t)(colon - entry));
+    host[colon - entry] = '\0';
+    char *h = host;
+    if (h[0] == '[' && h[strlen(h) - 1] == ']')
+    {
+        h[strlen(h) - 1] = '\0';
+        h++;
+    }
+
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *res = NULL;
+    int rc = getaddrinfo(h, colon + 1, &hints, &res);
+    if (rc != 0)
+    {
+        fprintf(stderr, "Peer %s: %s\n", entry, gai_strerror(rc));
+        exit(EXIT_FAILURE);
+    }
+    memcpy(&p->addr, res->ai_addr, res->ai_addrlen);
+    p->addr_len = res->ai_addrlen;
+    freeaddrinfo(res);
+
+    pthread_mutex_init(&p->mutex, NULL);
+    g_peer_count++;
+}
+
+void init_cluster(const char *peers, const char *self, const char *secret, int hot_threshold)
+{
+    if (strlen(secret) < CLUSTER_SECRET_MIN || strlen(secret) > CLUSTER_SECRET_MAX ||
+        strspn(secret, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_.") != strlen(secret))
+    {
+        fprintf(stderr, "--peer-secret debe tener entre %d y %d caracteres [A-Za-z0-9-_.]\n", CLUSTER_SECRET_MIN,
+                CLUSTER_SECRET_MAX);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(g_secret, secret);
+
+    char *list = strdup(peers);
+    if (!list)
+    {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+    char *save = NULL;
+    for (char *entry = strtok_r(list, ",", &save); entry; entry = strtok_r(NULL, ",", &save))
+    {
+        add_peer(entry);
+        if (strcmp(entry, self) == 0)
+        {
+            g_self = g_peer_count - 1;
+        }
+    }
+    free(list);
+    if (g_self < 0)
+    {
+        fprintf(stderr, "--peer-self %s no está en --peers\n", self);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Virtual nodes even out the slices, and adding a peer only moves about 1/N of the paths. */
+    g_ring_size = g_peer_count * CLUSTER_VNODES;
+    g_ring = malloc((size_t)g_ring_size * sizeof(ring_point_t));
+    if (!g_ring)
+    {
+        perror("Failed to allocate cluster ring");
+        exit(EXIT_FAILURE);
+    }
+    for (int p = 0; p < g_peer_count; p++)
+    {
+        for (int v = 0; v < CLUSTER_VNODES; v++)
+        {
+            char point[160];
+            snprintf(point, sizeof(point), "%s#%d", g_peers[p].label, v);
+            g_ring[p * CLUSTER_VNODES + v] = (ring_point_t){hash_string(point), p};
+        }
+    }
+    qsort(g_ring, (size_t)g_ring_size, sizeof(ring_point_t), compare_points);
+
+    g_hot_threshold = hot_threshold;
+    g_enabled = 1;
+    if (!is_logging_enabled())
+    {
+        printf("Cluster: %d peers, this instance is %s\n", g_peer_count, g_peers[g_self].label);
+    }
+}
+
+int is_cluster_enabled(void)
+{
+    return g_enabled;
+}
+
+/* The first `want` distinct peers clockwise from the path's point on the ring. */
+static int ring_owners(uint64_t h, int *owners, int want)
+{
+    int lo = 0, hi = g_ring_size;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (g_ring[mid].hash < h)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    int count = 0;
+    for (int i = 0; i < g_ring_size && count < want; i++)
+    {
+        int peer = g_ring[(lo + i) % g_ring_size].peer;
+        int seen = 0;
+        for (int k = 0; k < count; k++)
+        {
+            seen |= owners[k] == peer;
+        }
+        if (!seen)
+        {
+            owners[count++] = peer;
+        }
+    }
+    return count;
+}
+
+static int note_request(uint64_t h)
+{
+    if (g_hot_threshold <= 0)
+    {
+        return 0;
+    }
+    hot_slot_t *slot = &g_hot[h & (CLUSTER_HOT_SLOTS - 1)];
+    unsigned now = (unsigned)(trace_now_ns() / 1000000000ULL);
+    unsigned window = atomic_load_explicit(&slot->window, memory_order_relaxed);
+    if (atomic_load_explicit(&slot->key, memory_order_relaxed) != h)
+    {
+        atomic_store_explicit(&slot->key, h, memory_order_relaxed);
+        atomic_store_explicit(&slot->prev_count, 0, memory_order_relaxed);
+        atomic_store_explicit(&slot->count, 0, memory_order_relaxed);
+        atomic_store_explicit(&slot->window, now, memory_order_relaxed);
+    }
+    else if (window != now)
+    {
+        unsigned last = atomic_exchange_explicit(&slot->count, 0, memory_order_relaxed);
+        atomic_store_explicit(&slot->prev_count, window + 1 == now ? last : 0, memory_order_relaxed);
+        atomic_store_explicit(&slot->window, now, memory_order_relaxed);
+    }
+    unsigned count = atomic_fetch_add_explicit(&slot->count, 1, memory_order_relaxed) + 1;
+    return count >= (unsigned)g_hot_threshold ||
+           atomic_load_explicit(&slot->prev_count, memory_order_relaxed) >= (unsigned)g_hot_threshold;
+}
+
+int cluster_route(const char *path)
+{
+    if (!g_enabled)
+    {
+        return -1;
+    }
+    uint64_t h = hash_string(path);
+    int hot = note_request(h);
+    int owners[CLUSTER_HOT_REPLICAS];
+    int count = ring_owners(h, owners, hot ? CLUSTER_HOT_REPLICAS : 1);
+    if (hot && count > 1)
+    {
+        record_hot_route();
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (owners[i] == g_self)
+        {
+            return -1;
+        }
+    }
+    return owners[g_self % count];
+}
+
+static int take_idle(cluster_peer_t *p)
+{
+    int fd = -1;
+    pthread_mutex_lock(&p->mutex);
+    if (p->idle_count > 0)
+    {
+        fd = p->idle[--p->idle_count];
+    }
+    pthread_mutex_unlock(&p->mutex);
+    return fd;
+}
+
+static void put_idle(cluster_peer_t *p, int fd)
+{
+    pthread_mutex_lock(&p->mutex);
+    if (p->idle_count < CLUSTER_IDLE_MAX)
+    {
+        p->idle[p->idle_count++] = fd;
+        fd = -1;
+    }
+    pthread_mutex_unlock(&p->mutex);
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+/* Nonblocking like client sockets, so io_wait() applies (and a coroutine yields) while connecting. */
+static int connect_peer(cluster_peer_t *p)
+{
+    int fd = socket(p->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr *)&p->addr, p->addr_len) != 0)
+    {
+        client_t c = {.fd = fd};
+        int err = 0;
+        socklen_t err_len = sizeof(err);
+        if (errno != EINPROGRESS || io_wait(&c, POLLOUT, CLUSTER_FETCH_TIMEOUT_MS) != 0 ||
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len) != 0 || err != 0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+/* One ranged GET on an open connection; the reply must cover exactly the asked range of a file of
+ * the same size, or the caller falls back to its own storage. */
+static int fetch_on(int fd, const char *label, const char *path, long file_size, off_t offset, char *buf, size_t len,
+                    int *keep)
+{
+    client_t c = {.fd = fd};
+    char head[CLUSTER_HEAD_MAX];
+    int n = snprintf(head, sizeof(head),
+                     "GET %s HTTP/1.1\r\n"
+                     "Host: %s\r\n"
+                     "Range: bytes=%lld-%lld\r\n" CLUSTER_PEER_HEADER ": %s\r\n"
+                     "\r\n",
+                     path, label, (long long)offset, (long long)offset + (long long)len - 1, g_secret);
+    if (n < 0 || (size_t)n >= sizeof(head) || io_send_all(&c, head, (size_t)n) != 0)
+    {
+        return -1;
+    }
+
+    size_t got = 0;
+    char *end = NULL;
+    while (!end)
+    {
+        if (got == sizeof(head) - 1)
+        {
+            return -1;
+        }
+        ssize_t r = io_read(&c, head + got, sizeof(head) - 1 - got);
+        if (r <= 0)
+        {
+            return -1;
+        }
+        got += (size_t)r;
+        head[got] = '\0';
+        end = strstr(head, "\r\n\r\n");
+    }
+    size_t header_len = (size_t)(end + 4 - head);
+    *end = '\0';
+
+    long long first, last, total;
+    const char *range = strcasestr(head, "\r\nContent-Range:");
+    if (strncmp(head, "HTTP/1.1 206 ", 13) != 0 || !range ||
+        sscanf(range + strlen("\r\nContent-Range:"), " bytes %lld-%lld/%lld", &first, &last, &total) != 3 ||
+        first != (long long)offset || last != (long long)offset + (long long)len - 1 || total != file_size)
+    {
+        return -1;
+    }
+    *keep = !strcasestr(head, "\r\nConnection: close");
+
+    size_t body = got - header_len;
+    if (body > len)
+    {
+        return -1;
+    }
+    memcpy(buf, head + header_len, body);
+    while (body < len)
+    {
+        ssize_t r = io_read(&c, buf + body, len - body);
+        if (r <= 0)
+        {
+            return -1;
+        }
+        body += (size_t)r;
+    }
+    return 0;
+}
+
+/* IPv4 in its v4-mapped form, so a dual-stack listener still matches a peer given as a.b.c.d. */
+static int host_bytes(const struct sockaddr_storage *addr, uint8_t out[16])
+{
+    if (addr->ss_family == AF_INET)
+    {
+        const struct sockaddr_in *in = (const struct sockaddr_in *)addr;
+        memset(out, 0, 10);
+        out[10] = out[11] = 0xff;
+        memcpy(out + 12, &in->sin_addr, 4);
+        return 0;
+    }
+    if (addr->ss_family == AF_INET6)
+    {
+        memcpy(out, &((const struct sockaddr_in6 *)addr)->sin6_addr, 16);
+        return 0;
+    }
+    return -1;
+}
+
+/* Length-independent compare, so the header cannot be guessed byte by byte from timing. */
+static int secret_matches(const char *value)
+{
+    size_t len = strlen(g_secret);
+    unsigned char diff = strlen(value) != len;
+    for (size_t i = 0; i < len; i++)
+    {
+        diff |= (unsigned char)(value[i] ^ g_secret[i]);
+        if (value[i] == '\0')
+        {
+            break;
+        }
+    }
+    return diff == 0;
+}
+
+int cluster_is_peer_request(const struct sockaddr_storage *addr, const char *header)
+{
+    uint8_t host[16], peer[16];
+    if (!header || !secret_matches(header) || host_bytes(addr, host) != 0)
+    {
+        return 0;
+    }
+    for (int i = 0; i < g_peer_count; i++)
+    {
+        if (host_bytes(&g_peers[i].addr, peer) == 0 && memcmp(host, peer, sizeof(host)) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int cluster_fetch(int peer, const char *path, long file_size, off_t offset, char *buf, size_t len)
+{
+    cluster_peer_t *p = &g_peers[peer];
+    /* The fetch runs inside a request: keep the caller's deadline if it is the tighter one. */
+    uint64_t deadline_ns = trace_now_ns() + (uint64_t)CLUSTER_FETCH_TIMEOUT_MS * 1000000ULL;
+    uint64_t saved_deadline = io_set_deadline(deadline_ns);
+    if (saved_deadline && saved_deadline < deadline_ns)
+    {
+        io_set_deadline(saved_deadline);
+    }
+
+    /* An idle connection may have been closed by the peer's keep-alive timeout: retry once fresh. */
+    int rc = -1;
+    for (int attempt = 0; attempt < 2 && rc != 0; attempt++)
+    {
+        int fd = attempt == 0 ? take_idle(p) : -1;
+        int reused = fd >= 0;
+        if (!reused && (fd = connect_peer(p)) < 0)
+        {
+            break;
+        }
+        int keep = 0;
+        rc = fetch_on(fd, p->label, path, file_size, offset, buf, len, &keep);
+        if (rc == 0 && keep)
+        {
+            put_idle(p, fd);
+        }
+        else
+        {
+            close(fd);
+        }
+        if (!reused)
+        {
+            break;
+        }
+    }
+
+    io_set_deadline(saved_deadline);
+    record_peer_fetch(rc == 0, rc == 0 ? len : 0);
+    if (rc != 0)
+    {
+        log_warn("Peer %s failed for %s; reading local storage", p->label, path);
+    }
+    return rc;
+}
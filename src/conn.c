@@ -0,0 +1,55 @@
+#include "conn.h"
+#include <stdlib.h>
+#include "stats.h"
+
+void conn_pool_init(conn_pool_t *pool)
+{
+    pool->free_list = NULL;
+    pool->allocated = 0;
+    pool->in_use = 0;
+}
+
+conn_t *conn_acquire(conn_pool_t *pool, const client_t *client)
+{
+    conn_t *conn = pool->free_list;
+    if (conn)
+    {
+        pool->free_list = conn->next_free;
+    }
+    else
+    {
+        if (pool->allocated >= CONN_POOL_MAX)
+        {
+            return NULL;
+        }
+        conn = malloc(sizeof(*conn));
+        if (!conn)
+        {
+            return NULL;
+        }
+        arena_init(&conn->arena, conn->arena_mem, sizeof(conn->arena_mem));
+        pool->allocated++;
+        add_conn_objects(1, sizeof(*conn));
+    }
+
+    conn->next_free = NULL;
+    conn->client = *client;
+    conn->io_len = 0;
+    conn->arena.used = 0;
+    pool->in_use++;
+    return conn;
+}
+
+void conn_reset_request(conn_t *conn)
+{
+    arena_reset(&conn->arena);
+    update_arena_peak(conn->arena.peak);
+}
+
+void conn_release(conn_pool_t *pool, conn_t *conn)
+{
+    conn_reset_request(conn);
+    conn->next_free = pool->free_list;
+    pool->free_list = conn;
+    pool->in_use--;
+}
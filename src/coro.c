@@ -0,0 +1,482 @@
+#define _GNU_SOURCE
+#include "coro.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include "stats.h"
+#include "trace.h"
+
+typedef enum
+{
+    CORO_FREE = 0,
+    CORO_READY,
+    CORO_RUNNING,
+    CORO_WAITING,
+    CORO_DONE
+} coro_state_t;
+
+typedef struct coro
+{
+    ucontext_t ctx;
+    char *stack;
+    void (*fn)(void *);
+    void *arg;
+    coro_state_t state;
+    int woken;
+    uint64_t deadline_ns;
+    int heap_index;
+    struct coro *next;
+    struct coro_sched *sched;
+    io_context_t io;
+    int file_fd;
+    void *file_buf;
+    size_t file_len;
+    off_t file_offset;
+    ssize_t file_result;
+    int file_errno;
+} coro_t;
+
+struct coro_sched
+{
+    ucontext_t main_ctx;
+    int epfd;
+    int wake_fd;
+    int queue_fd;
+    int queue_watched;
+    coro_t *slots;
+    int max;
+    int active;
+    coro_t *free_list;
+    coro_t *ready_head;
+    coro_t *ready_tail;
+    coro_t **timers;
+    int timer_count;
+    pthread_mutex_t done_mutex;
+    coro_t *done_list;
+};
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    coro_t *head;
+    coro_t *tail;
+} file_queue_t;
+
+static __thread coro_sched_t *t_sched;
+static __thread coro_t *t_current;
+
+static file_queue_t g_files = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL};
+static pthread_once_t g_files_once = PTHREAD_ONCE_INIT;
+static size_t g_page_size;
+
+/* epoll data for the two fds that are not a coroutine's socket. */
+static char g_wake_marker;
+static char g_queue_marker;
+
+/* Min-heap of waiting coroutines by deadline; heap_index lets a woken one leave in O(log n). */
+static void timer_swap(coro_t **heap, int a, int b)
+{
+    coro_t *tmp = heap[a];
+    heap[a] = heap[b];
+    heap[b] = tmp;
+    heap[a]->heap_index = a;
+    heap[b]->heap_index = b;
+}
+
+static void timer_sift(coro_sched_t *s, int i)
+{
+    while (i > 0 && s->timers[(i - 1) / 2]->deadline_ns > s->timers[i]->deadline_ns)
+    {
+        timer_swap(s->timers, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    while (1)
+    {
+        int smallest = i;
+        int l = 2 * i + 1, r = 2 * i + 2;
+        if (l < s->timer_count && s->timers[l]->deadline_ns < s->timers[smallest]->deadline_ns)
+            smallest = l;
+        if (r < s->timer_count && s->timers[r]->deadline_ns < s->timers[smallest]->deadline_ns)
+            smallest = r;
+        if (smallest == i)
+            break;
+        timer_swap(s->timers, i, smallest);
+        i = smallest;
+    }
+}
+
+static void timer_push(coro_sched_t *s, coro_t *c)
+{
+    c->heap_index = s->timer_count;
+    s->timers[s->timer_count++] = c;
+    timer_sift(s, c->heap_index);
+}
+
+static void timer_remove(coro_sched_t *s, coro_t *c)
+{
+    int i = c->heap_index;
+    if (i < 0)
+    {
+        return;
+    }
+    c->heap_index = -1;
+    s->timer_count--;
+    if (i != s->timer_count)
+    {
+        s->timers[i] = s->timers[s->timer_count];
+        s->timers[i]->heap_index = i;
+        timer_sift(s, i);
+    }
+}
+
+static void make_ready(coro_sched_t *s, coro_t *c)
+{
+    c->state = CORO_READY;
+    c->next = NULL;
+    if (s->ready_tail)
+    {
+        s->ready_tail->next = c;
+    }
+    else
+    {
+        s->ready_head = c;
+    }
+    s->ready_tail = c;
+}
+
+static void *file_thread_main(void *arg)
+{
+    (void)arg;
+    while (1)
+    {
+        pthread_mutex_lock(&g_files.mutex);
+        while (!g_files.head)
+        {
+            pthread_cond_wait(&g_files.not_empty, &g_files.mutex);
+        }
+        coro_t *c = g_files.head;
+        g_files.head = c->next;
+        if (!g_files.head)
+        {
+            g_files.tail = NULL;
+        }
+        pthread_mutex_unlock(&g_files.mutex);
+
+        c->file_result = pread(c->file_fd, c->file_buf, c->file_len, c->file_offset);
+        c->file_errno = errno;
+
+        coro_sched_t *s = c->sched;
+        pthread_mutex_lock(&s->done_mutex);
+        c->next = s->done_list;
+        s->done_list = c;
+        pthread_mutex_unlock(&s->done_mutex);
+        eventfd_write(s->wake_fd, 1);
+    }
+    return NULL;
+}
+
+static void start_file_threads(void)
+{
+    g_page_size = (size_t)sysconf(_SC_PAGESIZE);
+    for (int i = 0; i < CORO_FILE_THREADS; i++)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, file_thread_main, NULL) != 0)
+        {
+            perror("pthread_create coroutine file thread");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(thread);
+    }
+}
+
+static void watch_fd(coro_sched_t *s, int fd, void *marker)
+{
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = marker};
+    if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+    {
+        perror("epoll_ctl coroutine scheduler");
+        exit(EXIT_FAILURE);
+    }
+}
+
+coro_sched_t *coro_sched_create(int max_coros, int queue_fd)
+{
+    pthread_once(&g_files_once, start_file_threads);
+
+    coro_sched_t *s = calloc(1, sizeof(*s));
+    if (!s || !(s->slots = calloc((size_t)max_coros, sizeof(coro_t))) ||
+        !(s->timers = calloc((size_t)max_coros, sizeof(coro_t *))))
+    {
+        perror("Failed to allocate coroutine scheduler");
+        exit(EXIT_FAILURE);
+    }
+    s->epfd = epoll_create1(EPOLL_CLOEXEC);
+    s->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (s->epfd < 0 || s->wake_fd < 0)
+    {
+        perror("Failed to create coroutine scheduler fds");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&s->done_mutex, NULL);
+    watch_fd(s, s->wake_fd, &g_wake_marker);
+    s->queue_fd = queue_fd;
+    if (queue_fd >= 0)
+    {
+        watch_fd(s, queue_fd, &g_queue_marker);
+        s->queue_watched = 1;
+    }
+
+    s->max = max_coros;
+    for (int i = max_coros - 1; i >= 0; i--)
+    {
+        s->slots[i].sched = s;
+        s->slots[i].heap_index = -1;
+        s->slots[i].next = s->free_list;
+        s->free_list = &s->slots[i];
+    }
+    t_sched = s;
+    return s;
+}
+
+int coro_sched_has_room(const coro_sched_t *sched)
+{
+    return sched->active < sched->max;
+}
+
+int coro_sched_active(const coro_sched_t *sched)
+{
+    return sched->active;
+}
+
+static void coro_entry(void)
+{
+    coro_t *c = t_current;
+    c->fn(c->arg);
+    c->state = CORO_DONE;
+}
+
+/* Stacks are mapped on first use and kept with their slot; the lowest page is the guard. */
+int coro_spawn(coro_sched_t *s, void (*fn)(void *), void *arg)
+{
+    coro_t *c = s->free_list;
+    if (!c)
+    {
+        return -1;
+    }
+    if (!c->stack)
+    {
+        char *stack = mmap(NULL, CORO_STACK_SIZE + g_page_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+        if (stack == MAP_FAILED)
+        {
+            return -1;
+        }
+        mprotect(stack, g_page_size, PROT_NONE);
+        c->stack = stack;
+    }
+    s->free_list = c->next;
+
+    getcontext(&c->ctx);
+    c->ctx.uc_stack.ss_sp = c->stack + g_page_size;
+    c->ctx.uc_stack.ss_size = CORO_STACK_SIZE;
+    c->ctx.uc_link = &s->main_ctx;
+    makecontext(&c->ctx, coro_entry, 0);
+    c->fn = fn;
+    c->arg = arg;
+    c->io.deadline_ns = 0;
+
+    s->active++;
+    update_coro_peak((unsigned long)s->active);
+    make_ready(s, c);
+    return 0;
+}
+
+static void resume(coro_sched_t *s, coro_t *c)
+{
+    c->state = CORO_RUNNING;
+    t_current = c;
+    swapcontext(&s->main_ctx, &c->ctx);
+    t_current = NULL;
+    if (c->state == CORO_DONE)
+    {
+        c->state = CORO_FREE;
+        c->next = s->free_list;
+        s->free_list = c;
+        s->active--;
+    }
+}
+
+static void yield(coro_t *c)
+{
+    c->state = CORO_WAITING;
+    c->woken = 0;
+    swapcontext(&c->ctx, &c->sched->main_ctx);
+}
+
+io_context_t *coro_io_context(void)
+{
+    return t_current ? &t_current->io : NULL;
+}
+
+int coro_wait_fd(int fd, short events, uint64_t deadline_ns)
+{
+    coro_t *c = t_current;
+    coro_sched_t *s = c->sched;
+    if (deadline_ns && trace_now_ns() >= deadline_ns)
+    {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    /* One-shot keeps a socket from waking anyone once its coroutine has moved on. */
+    struct epoll_event ev = {.events = EPOLLONESHOT, .data.ptr = c};
+    if (events & POLLIN)
+        ev.events |= EPOLLIN | EPOLLRDHUP;
+    if (events & POLLOUT)
+        ev.events |= EPOLLOUT;
+    if (epoll_ctl(s->epfd, EPOLL_CTL_MOD, fd, &ev) != 0 &&
+        (errno != ENOENT || epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &ev) != 0))
+    {
+        return -1;
+    }
+
+    c->deadline_ns = deadline_ns;
+    if (deadline_ns)
+    {
+        timer_push(s, c);
+    }
+    yield(c);
+
+    if (!c->woken)
+    {
+        struct epoll_event off = {.events = EPOLLONESHOT, .data.ptr = c};
+        epoll_ctl(s->epfd, EPOLL_CTL_MOD, fd, &off);
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return 0;
+}
+
+ssize_t coro_pread(int fd, void *buf, size_t len, off_t offset)
+{
+    coro_t *c = t_current;
+    c->file_fd = fd;
+    c->file_buf = buf;
+    c->file_len = len;
+    c->file_offset = offset;
+    c->next = NULL;
+    increment_coro_offloads();
+
+    pthread_mutex_lock(&g_files.mutex);
+    if (g_files.tail)
+    {
+        g_files.tail->next = c;
+    }
+    else
+    {
+        g_files.head = c;
+    }
+    g_files.tail = c;
+    pthread_cond_signal(&g_files.not_empty);
+    pthread_mutex_unlock(&g_files.mutex);
+
+    /* The helper can only queue the completion; nothing resumes us before we are parked. */
+    yield(c);
+    errno = c->file_errno;
+    return c->file_result;
+}
+
+static void set_queue_watch(coro_sched_t *s, int want)
+{
+    if (s->queue_fd < 0 || s->queue_watched == want)
+    {
+        return;
+    }
+    struct epoll_event ev = {.events = want ? EPOLLIN : 0, .data.ptr = &g_queue_marker};
+    epoll_ctl(s->epfd, EPOLL_CTL_MOD, s->queue_fd, &ev);
+    s->queue_watched = want;
+}
+
+void coro_sched_run(coro_sched_t *s)
+{
+    while (s->ready_head)
+    {
+        coro_t *c = s->ready_head;
+        s->ready_head = c->next;
+        if (!s->ready_head)
+        {
+            s->ready_tail = NULL;
+        }
+        resume(s, c);
+    }
+
+    /* A full scheduler stops listening for new work so the queue event wakes a worker with room. */
+    set_queue_watch(s, coro_sched_has_room(s));
+
+    int timeout_ms = -1;
+    if (s->timer_count > 0)
+    {
+        uint64_t now_ns = trace_now_ns();
+        uint64_t next_ns = s->timers[0]->deadline_ns;
+        timeout_ms = next_ns <= now_ns ? 0 : (int)((next_ns - now_ns + 999999) / 1000000);
+    }
+
+    struct epoll_event events[CORO_EVENTS_MAX];
+    int n = epoll_wait(s->epfd, events, CORO_EVENTS_MAX, timeout_ms);
+    for (int i = 0; i < n; i++)
+    {
+        void *ptr = events[i].data.ptr;
+        if (ptr == &g_wake_marker)
+        {
+            eventfd_t value;
+            eventfd_read(s->wake_fd, &value);
+            pthread_mutex_lock(&s->done_mutex);
+            coro_t *done = s->done_list;
+            s->done_list = NULL;
+            pthread_mutex_unlock(&s->done_mutex);
+            while (done)
+            {
+                coro_t *next = done->next;
+                done->woken = 1;
+                make_ready(s, done);
+                done = next;
+            }
+        }
+        else if (ptr == &g_queue_marker)
+        {
+            eventfd_t value;
+            eventfd_read(s->queue_fd, &value);
+        }
+        else
+        {
+            coro_t *c = ptr;
+            if (c->state == CORO_WAITING && !c->woken)
+            {
+                c->woken = 1;
+                timer_remove(s, c);
+                make_ready(s, c);
+            }
+        }
+    }
+
+    if (s->timer_count > 0)
+    {
+        uint64_t now_ns = trace_now_ns();
+        while (s->timer_count > 0 && s->timers[0]->deadline_ns <= now_ns)
+        {
+            coro_t *c = s->timers[0];
+            timer_remove(s, c);
+            make_ready(s, c);
+        }
+    }
+}
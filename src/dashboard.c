@@ -0,0 +1,135 @@
+#include "dashboard.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "server.h"
+#include "stats.h"
+#include "trace.h"
+
+#define DASHBOARD_BUFFER 16384
+
+worker_slot_t *g_worker_slots = NULL;
+
+static int g_worker_count = 0;
+static int g_enabled = 0;
+static pthread_t g_renderer;
+
+static const char *state_names[WORKER_STATE_COUNT] = {
+    "idle", "handshake", "reading", "sending", "keepalive", "http2"};
+
+void init_worker_slots(int worker_count)
+{
+    g_worker_slots = aligned_alloc(64, (size_t)worker_count * sizeof(worker_slot_t));
+    if (!g_worker_slots)
+    {
+        perror("Failed to allocate worker slots");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < worker_count; i++)
+    {
+        atomic_init(&g_worker_slots[i].state, WORKER_IDLE);
+        atomic_init(&g_worker_slots[i].fd, -1);
+        atomic_init(&g_worker_slots[i].request_start_ns, 0);
+        atomic_init(&g_worker_slots[i].served, 0);
+    }
+    g_worker_count = worker_count;
+}
+
+int is_dashboard_enabled(void)
+{
+    return g_enabled;
+}
+
+static size_t render(char *out, size_t cap, const stats_snapshot_t *prev, const stats_snapshot_t *cur,
+                     double interval_s, time_t started)
+{
+    unsigned long long window[LATENCY_BUCKETS];
+    unsigned long long window_count = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        window[b] = cur->turnaround_buckets[b] - prev->turnaround_buckets[b];
+        window_count += window[b];
+    }
+
+    size_t n = 0;
+    n += (size_t)snprintf(out + n, cap - n, "\033[H\033[2J");
+    n += (size_t)snprintf(out + n, cap - n,
+                          " HappyTree  uptime %lds   cola %d/%d   %.1f req/s   %.2f MB/s   p99 %.3f ms\n\n",
+                          (long)difftime(time(NULL), started), client_queue_depth(), CLIENT_QUEUE_CAPACITY,
+                          (cur->requests - prev->requests) / interval_s,
+                          (cur->bytes_sent - prev->bytes_sent) / interval_s / (1024.0 * 1024.0),
+                          histogram_percentile(window, window_count, 99) / 1000.0);
+    n += (size_t)snprintf(out + n, cap - n, " %-8s %-10s %6s %12s %10s\n", "worker", "estado", "fd", "en curso", "servidas");
+
+    uint64_t now_ns = trace_now_ns();
+    for (int i = 0; i < g_worker_count && n < cap - 128; i++)
+    {
+        worker_slot_t *slot = &g_worker_slots[i];
+        int state = atomic_load_explicit(&slot->state, memory_order_relaxed);
+        int fd = atomic_load_explicit(&slot->fd, memory_order_relaxed);
+        uint64_t start_ns = atomic_load_explicit(&slot->request_start_ns, memory_order_relaxed);
+        unsigned long served = atomic_load_explicit(&slot->served, memory_order_relaxed);
+
+        char elapsed[32] = "-";
+        if (state == WORKER_READING || state == WORKER_SENDING)
+        {
+            snprintf(elapsed, sizeof(elapsed), "%.1f ms", start_ns && now_ns > start_ns ? (now_ns - start_ns) / 1e6 : 0.0);
+        }
+        char fd_str[16] = "-";
+        if (fd >= 0)
+        {
+            snprintf(fd_str, sizeof(fd_str), "%d", fd);
+        }
+        n += (size_t)snprintf(out + n, cap - n, " %-8d %-10s %6s %12s %10lu\n", i,
+                              state >= 0 && state < WORKER_STATE_COUNT ? state_names[state] : "?",
+                              fd_str, elapsed, served);
+    }
+    n += (size_t)snprintf(out + n, cap - n, "\n Presiona 'q' para salir\n");
+    return n < cap ? n : cap - 1;
+}
+
+static void *renderer_main(void *arg)
+{
+    (void)arg;
+    char *buffer = malloc(DASHBOARD_BUFFER);
+    if (!buffer)
+    {
+        return NULL;
+    }
+
+    time_t started = time(NULL);
+    stats_snapshot_t prev, cur;
+    stats_snapshot(&prev);
+    uint64_t prev_ns = trace_now_ns();
+
+    while (1)
+    {
+        usleep(DASHBOARD_REFRESH_MS * 1000);
+        stats_snapshot(&cur);
+        uint64_t now_ns = trace_now_ns();
+
+        size_t len = render(buffer, DASHBOARD_BUFFER, &prev, &cur, (now_ns - prev_ns) / 1e9, started);
+        if (write(STDOUT_FILENO, buffer, len) < 0)
+        {
+            break;
+        }
+        prev = cur;
+        prev_ns = now_ns;
+    }
+    free(buffer);
+    return NULL;
+}
+
+void init_dashboard(void)
+{
+    g_enabled = 1;
+    if (pthread_create(&g_renderer, NULL, renderer_main, NULL) != 0)
+    {
+        perror("pthread_create dashboard");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(g_renderer);
+}
@@ -0,0 +1,527 @@
+#include "hpack.h"
+#include <string.h>
+#include <pthread.h>
+
+typedef struct
+{
+    const char *name;
+    const char *value;
+} static_entry_t;
+
+/* RFC 7541 Appendix A, 1-based. */
+static const static_entry_t static_table[] = {
+    {"", ""},
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+#define STATIC_TABLE_COUNT ((int)(sizeof(static_table) / sizeof(static_table[0])) - 1)
+
+/* RFC 7541 Appendix B: canonical Huffman code for symbols 0..255 and EOS (256). */
+static const uint32_t huffman_codes[257] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5,
+    0xfffffe6, 0xfffffe7, 0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9,
+    0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec, 0xfffffed, 0xfffffee,
+    0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9,
+    0xffffffa, 0xffffffb, 0x14, 0x3f8, 0x3f9, 0xffa,
+    0x1ff9, 0x15, 0xf8, 0x7fa, 0x3fa, 0x3fb,
+    0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b,
+    0x1c, 0x1d, 0x1e, 0x1f, 0x5c, 0xfb,
+    0x7ffc, 0x20, 0xffb, 0x3fc, 0x1ffa, 0x21,
+    0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e,
+    0x6f, 0x70, 0x71, 0x72, 0xfc, 0x73,
+    0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5,
+    0x25, 0x26, 0x27, 0x6, 0x74, 0x75,
+    0x28, 0x29, 0x2a, 0x7, 0x2b, 0x76,
+    0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd,
+    0x1ffd, 0xffffffc, 0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8,
+    0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9, 0x3fffd6, 0x7fffda,
+    0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1,
+    0x7fffe2, 0x7fffe3, 0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5,
+    0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef, 0x3fffda, 0x1fffdd,
+    0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf,
+    0x7fffeb, 0x7fffec, 0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2,
+    0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef, 0xfffea, 0x3fffe2,
+    0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2,
+    0x3fffe8, 0x1ffffec, 0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde,
+    0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed, 0x7fff2, 0x1fffe3,
+    0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3,
+    0x7ffffe4, 0x7ffffe5, 0xfffec, 0xfffff3, 0xfffed, 0x1fffe6,
+    0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3, 0x3fffea, 0x3fffeb,
+    0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8,
+    0x7ffffe9, 0x7ffffea, 0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed,
+    0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee, 0x3fffffff,
+};
+
+static const uint8_t huffman_lengths[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+/* Binary decode trie built once from the code table: node 0 is the root,
+ * children[n][bit] is the next node, leaves hold symbol + 1 in symbol[n]. */
+#define HUFFMAN_NODES (2 * 257)
+
+static int16_t huffman_children[HUFFMAN_NODES][2];
+static int16_t huffman_symbol[HUFFMAN_NODES];
+static pthread_once_t huffman_once = PTHREAD_ONCE_INIT;
+
+static void build_huffman_trie(void)
+{
+    int next = 1;
+    memset(huffman_children, 0, sizeof(huffman_children));
+    memset(huffman_symbol, 0, sizeof(huffman_symbol));
+
+    for (int sym = 0; sym < 257; sym++)
+    {
+        int node = 0;
+        for (int bit = huffman_lengths[sym] - 1; bit >= 0; bit--)
+        {
+            int b = (huffman_codes[sym] >> bit) & 1;
+            if (huffman_children[node][b] == 0)
+            {
+                huffman_children[node][b] = (int16_t)next++;
+            }
+            node = huffman_children[node][b];
+        }
+        huffman_symbol[node] = (int16_t)(sym + 1);
+    }
+}
+
+static int huffman_decode(const uint8_t *src, size_t len, char *dst, size_t cap, size_t *out_len)
+{
+    pthread_once(&huffman_once, build_huffman_trie);
+
+    int node = 0;
+    int depth = 0;
+    int all_ones = 1;
+    size_t n = 0;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        for (int bit = 7; bit >= 0; bit--)
+        {
+            int b = (src[i] >> bit) & 1;
+            node = huffman_children[node][b];
+            depth++;
+            all_ones &= b;
+            if (node == 0)
+            {
+                return -1;
+            }
+            if (huffman_symbol[node])
+            {
+                int sym = huffman_symbol[node] - 1;
+                if (sym == 256 || n >= cap)
+                {
+                    return -1;
+                }
+                dst[n++] = (char)sym;
+                node = 0;
+                depth = 0;
+                all_ones = 1;
+            }
+        }
+    }
+
+    /* Padding must be a prefix of EOS (all ones) and shorter than 8 bits. */
+    if (depth > 7 || !all_ones)
+    {
+        return -1;
+    }
+    *out_len = n;
+    return 0;
+}
+
+static int decode_integer(const uint8_t **pos, const uint8_t *end, int prefix_bits, uint32_t *out)
+{
+    if (*pos >= end)
+    {
+        return -1;
+    }
+    uint32_t max_prefix = (1u << prefix_bits) - 1;
+    uint32_t value = **pos & max_prefix;
+    (*pos)++;
+    if (value < max_prefix)
+    {
+        *out = value;
+        return 0;
+    }
+
+    int shift = 0;
+    while (*pos < end)
+    {
+        uint8_t byte = **pos;
+        (*pos)++;
+        if (shift > 21)
+        {
+            return -1;
+        }
+        value += (uint32_t)(byte & 0x7f) << shift;
+        shift += 7;
+        if (!(byte & 0x80))
+        {
+            *out = value;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int decode_string(const uint8_t **pos, const uint8_t *end, char *dst, size_t cap, size_t *out_len)
+{
+    if (*pos >= end)
+    {
+        return -1;
+    }
+    int huffman = (**pos & 0x80) != 0;
+    uint32_t len;
+    if (decode_integer(pos, end, 7, &len) != 0 || len > (size_t)(end - *pos))
+    {
+        return -1;
+    }
+
+    if (huffman)
+    {
+        if (huffman_decode(*pos, len, dst, cap, out_len) != 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        if (len > cap)
+        {
+            return -1;
+        }
+        memcpy(dst, *pos, len);
+        *out_len = len;
+    }
+    *pos += len;
+    return 0;
+}
+
+void hpack_table_init(hpack_table_t *table)
+{
+    table->data_len = 0;
+    table->count = 0;
+    table->size = 0;
+    table->max_size = HPACK_MAX_TABLE_SIZE;
+}
+
+static void evict_oldest(hpack_table_t *table)
+{
+    hpack_entry_t *oldest = &table->entries[0];
+    size_t bytes = (size_t)oldest->name_len + oldest->value_len;
+
+    memmove(table->data, table->data + bytes, table->data_len - bytes);
+    table->data_len -= bytes;
+    table->size -= bytes + HPACK_ENTRY_OVERHEAD;
+
+    memmove(&table->entries[0], &table->entries[1], (size_t)(table->count - 1) * sizeof(hpack_entry_t));
+    table->count--;
+    for (int i = 0; i < table->count; i++)
+    {
+        table->entries[i].offset = (uint16_t)(table->entries[i].offset - bytes);
+    }
+}
+
+static void table_resize(hpack_table_t *table, size_t max_size)
+{
+    table->max_size = max_size;
+    while (table->count > 0 && table->size > table->max_size)
+    {
+        evict_oldest(table);
+    }
+}
+
+static void table_insert(hpack_table_t *table, const char *name, size_t name_len,
+                         const char *value, size_t value_len)
+{
+    size_t entry_size = name_len + value_len + HPACK_ENTRY_OVERHEAD;
+    while (table->count > 0 && table->size + entry_size > table->max_size)
+    {
+        evict_oldest(table);
+    }
+    if (entry_size > table->max_size)
+    {
+        return;
+    }
+
+    hpack_entry_t *entry = &table->entries[table->count++];
+    entry->offset = (uint16_t)table->data_len;
+    entry->name_len = (uint16_t)name_len;
+    entry->value_len = (uint16_t)value_len;
+    memcpy(table->data + table->data_len, name, name_len);
+    memcpy(table->data + table->data_len + name_len, value, value_len);
+    table->data_len += name_len + value_len;
+    table->size += entry_size;
+}
+
+static int table_lookup(const hpack_table_t *table, uint32_t index,
+                        const char **name, size_t *name_len, const char **value, size_t *value_len)
+{
+    if (index == 0)
+    {
+        return -1;
+    }
+    if (index <= (uint32_t)STATIC_TABLE_COUNT)
+    {
+        *name = static_table[index].name;
+        *name_len = strlen(*name);
+        *value = static_table[index].value;
+        *value_len = strlen(*value);
+        return 0;
+    }
+
+    uint32_t dynamic = index - (uint32_t)STATIC_TABLE_COUNT - 1;
+    if (dynamic >= (uint32_t)table->count)
+    {
+        return -1;
+    }
+    const hpack_entry_t *entry = &table->entries[table->count - 1 - (int)dynamic];
+    *name = table->data + entry->offset;
+    *name_len = entry->name_len;
+    *value = table->data + entry->offset + entry->name_len;
+    *value_len = entry->value_len;
+    return 0;
+}
+
+int hpack_decode(hpack_table_t *table, const uint8_t *buf, size_t len, hpack_header_cb cb, void *ctx)
+{
+    const uint8_t *pos = buf;
+    const uint8_t *end = buf + len;
+    char name_buf[HPACK_MAX_STRING];
+    char value_buf[HPACK_MAX_STRING];
+
+    while (pos < end)
+    {
+        uint8_t first = *pos;
+        uint32_t index;
+        const char *name, *value;
+        size_t name_len, value_len;
+
+        if (first & 0x80)
+        {
+            /* Indexed header field. */
+            if (decode_integer(&pos, end, 7, &index) != 0 ||
+                table_lookup(table, index, &name, &name_len, &value, &value_len) != 0)
+            {
+                return -1;
+            }
+        }
+        else if ((first & 0xe0) == 0x20)
+        {
+            /* Dynamic table size update. */
+            if (decode_integer(&pos, end, 5, &index) != 0 || index > HPACK_MAX_TABLE_SIZE)
+            {
+                return -1;
+            }
+            table_resize(table, index);
+            continue;
+        }
+        else
+        {
+            /* Literal: with incremental indexing (01), without (0000) or never (0001). */
+            int incremental = (first & 0xc0) == 0x40;
+            int prefix = incremental ? 6 : 4;
+            if (decode_integer(&pos, end, prefix, &index) != 0)
+            {
+                return -1;
+            }
+            if (index == 0)
+            {
+                if (decode_string(&pos, end, name_buf, sizeof(name_buf), &name_len) != 0)
+                {
+                    return -1;
+                }
+                name = name_buf;
+            }
+            else
+            {
+                const char *unused;
+                size_t unused_len;
+                if (table_lookup(table, index, &name, &name_len, &unused, &unused_len) != 0)
+                {
+                    return -1;
+                }
+            }
+            if (decode_string(&pos, end, value_buf, sizeof(value_buf), &value_len) != 0)
+            {
+                return -1;
+            }
+            value = value_buf;
+
+            if (incremental)
+            {
+                /* Copy the name first: it may point into the table we are about to evict from. */
+                if (name != name_buf)
+                {
+                    memcpy(name_buf, name, name_len);
+                    name = name_buf;
+                }
+                table_insert(table, name, name_len, value, value_len);
+            }
+        }
+
+        if (cb(ctx, name, name_len, value, value_len) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static size_t encode_integer(uint8_t *out, size_t cap, uint8_t flags, int prefix_bits, uint32_t value)
+{
+    uint32_t max_prefix = (1u << prefix_bits) - 1;
+    size_t n = 0;
+    if (cap == 0)
+    {
+        return 0;
+    }
+    if (value < max_prefix)
+    {
+        out[n++] = (uint8_t)(flags | value);
+        return n;
+    }
+    out[n++] = (uint8_t)(flags | max_prefix);
+    value -= max_prefix;
+    while (value >= 0x80)
+    {
+        if (n >= cap)
+        {
+            return 0;
+        }
+        out[n++] = (uint8_t)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    if (n >= cap)
+    {
+        return 0;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+size_t hpack_encode_header(uint8_t *out, size_t cap, int name_index, const char *value)
+{
+    size_t value_len = strlen(value);
+    size_t n = encode_integer(out, cap, 0x00, 4, (uint32_t)name_index);
+    if (n == 0)
+    {
+        return 0;
+    }
+    size_t m = encode_integer(out + n, cap - n, 0x00, 7, (uint32_t)value_len);
+    if (m == 0 || n + m + value_len > cap)
+    {
+        return 0;
+    }
+    memcpy(out + n + m, value, value_len);
+    return n + m + value_len;
+}
+
+size_t hpack_encode_status(uint8_t *out, size_t cap, int status)
+{
+    for (int i = HPACK_IDX_STATUS; i <= 14; i++)
+    {
+        if (status == (static_table[i].value[0] - '0') * 100 +
+                          (static_table[i].value[1] - '0') * 10 +
+                          (static_table[i].value[2] - '0'))
+        {
+            return encode_integer(out, cap, 0x80, 7, (uint32_t)i);
+        }
+    }
+
+    char digits[4];
+    digits[0] = (char)('0' + (status / 100) % 10);
+    digits[1] = (char)('0' + (status / 10) % 10);
+    digits[2] = (char)('0' + status % 10);
+    digits[3] = '\0';
+    return hpack_encode_header(out, cap, HPACK_IDX_STATUS, digits);
+}
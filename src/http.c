@@ -1,39 +1,49 @@
+#define _GNU_SOURCE
 #include "http.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <sys/socket.h>
-#include <sys/time.h>
+#include <sys/stat.h>
 #include <errno.h>
 #include "parser.h"
 #include "logger.h"
 #include "stats.h"
+#include "accesslog.h"
+#include "capture.h"
+#include "cluster.h"
+#include "dashboard.h"
+#include "io.h"
+#include "tls.h"
+#include "http2.h"
+#include "probes.h"
+#include "proxy.h"
+#include "server.h"
+#include "trace.h"
 
-static int send_all(int fd, const void *buf, size_t len)
+typedef struct
 {
-    const char *p = (const char *)buf;
-    while (len > 0)
-    {
-        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
-        if (n <= 0)
-            return -1;
-        p += (size_t)n;
-        len -= (size_t)n;
-    }
-    return 0;
-}
+    int status;
+    unsigned long long bytes;
+    long range_start;
+    long range_end;
+    int http2;
+    const char *path;
+    size_class_t size_class;
+    int handed_off;
+} request_result_t;
 
-static int parse_range(const char *request, long file_size, long *out_start, long *out_end)
+static int parse_range(const char *range_spec, long file_size, long *out_start, long *out_end)
 {
-    const char *p = strstr(request, "Range: bytes=");
+    const char *p = range_spec;
     if (!p)
     {
         return 0;
     }
 
-    p += (long)strlen("Range: bytes=");
-
     long start = 0;
     long end = file_size - 1;
 
@@ -84,7 +94,7 @@ static int parse_range(const char *request, long file_size, long *out_start, lon
     return 1;
 }
 
-static const char *get_mime_type(const char *path)
+const char *get_mime_type(const char *path)
 {
     const char *ext = strrchr(path, '.');
     if (!ext || ext == path)
@@ -153,192 +163,978 @@ static const char *get_mime_type(const char *path)
     return "application/octet-stream";
 }
 
-char *not_found_response =
-    "HTTP/1.0 404 Not Found\r\n"
-    "Content-Type: text/plain\r\n"
-    "\r\n"
-    "No se encontró el recurso\n";
+static const char *base_path = "./www";
 
-void handle_client(int client_fd)
+static int g_keepalive_timeout_ms = 2000;
+static int g_keepalive_max_requests = 100;
+static long g_bulk_threshold = 256 * 1024;
+static long g_uncached_threshold = 0;
+static int g_header_timeout_ms = 10000;
+static int g_header_min_rate = 64;
+static size_t g_header_max = CONN_IO_BUFFER_SIZE;
+static int g_uncached_direct = 0;
+
+static const char not_found_body[] = "No se encontró el recurso\n";
+static const char request_timeout[] = "HTTP/1.1 408 Request Timeout\r\n"
+                                      "Content-Length: 0\r\n"
+                                      "Connection: close\r\n"
+                                      "\r\n";
+
+void http_set_keepalive(int timeout_ms, int max_requests)
 {
-    struct timeval start_time, first_response_time, end_time;
-    gettimeofday(&start_time, NULL);
+    g_keepalive_timeout_ms = timeout_ms;
+    g_keepalive_max_requests = max_requests > 0 ? max_requests : 1;
+}
 
-    increment_requests();
-    char request[1024] = {0};
-    char base_path[255] = "./www";
-    char buffer[4096];
-    FILE *file;
-    const char *read_mode = "rb";
+void http_set_bulk_threshold(long bytes)
+{
+    g_bulk_threshold = bytes;
+}
 
-    ssize_t req_bytes = read(client_fd, request, sizeof(request) - 1);
-    if (req_bytes > 0)
+void http_set_header_limits(int timeout_ms, int min_rate, int max_bytes)
+{
+    g_header_timeout_ms = timeout_ms;
+    g_header_min_rate = min_rate;
+    g_header_max = (max_bytes > 0 && max_bytes < CONN_IO_BUFFER_SIZE) ? (size_t)max_bytes : CONN_IO_BUFFER_SIZE;
+}
+
+void http_set_uncached(long threshold_bytes, int use_direct)
+{
+    g_uncached_threshold = threshold_bytes;
+    g_uncached_direct = use_direct;
+}
+
+/* Anything that fits the single-write path is small; beyond that, media and large files are bulk. */
+size_class_t http_size_class(const char *mime, long content_length)
+{
+    if (content_length <= CONN_BODY_BUFFER_SIZE)
     {
-        request[req_bytes] = '\0';
+        return SIZE_CLASS_SMALL;
     }
-    else
+    if (strncmp(mime, "video/", 6) == 0 || strncmp(mime, "audio/", 6) == 0 || content_length >= g_bulk_threshold)
     {
-        return;
+        return SIZE_CLASS_BULK;
     }
+    return SIZE_CLASS_SMALL;
+}
 
-    char method[10];
-    char file_path[255];
-
-    parse_http_request(request, method, file_path);
-
+int http_normalize_path(char *file_path, size_t cap)
+{
     if (file_path[0] != '/')
     {
-        char tmp[255];
-        tmp[0] = '/';
-        strncpy(tmp + 1, file_path, sizeof(tmp) - 2);
-        tmp[sizeof(tmp) - 1] = '\0';
-        strncpy(file_path, tmp, sizeof(file_path) - 1);
-        file_path[sizeof(file_path) - 1] = '\0';
+        size_t len = strnlen(file_path, cap - 1);
+        if (len + 2 > cap)
+        {
+            return -1;
+        }
+        memmove(file_path + 1, file_path, len + 1);
+        file_path[0] = '/';
     }
 
     if (strstr(file_path, "..") != NULL)
     {
-        write(client_fd, not_found_response, strlen(not_found_response));
-        return;
+        return -1;
     }
 
     if (strcmp(file_path, "/") == 0)
     {
+        if (cap < sizeof("/index.html"))
+        {
+            return -1;
+        }
         strcpy(file_path, "/index.html");
     }
+    return 0;
+}
 
-    char full_path[512];
+/* from_peer: a cluster peer asking the owner, served from local storage and not counted as traffic. */
+int http_open_resource(const char *file_path, const char *range_spec, int from_peer, http_resource_t *res)
+{
+    char full_path[PATH_MAX];
     snprintf(full_path, sizeof(full_path), "%s%s", base_path, file_path);
 
-    if (!is_logging_enabled())
+    log_debug("Abriendo archivo: %s", full_path);
+
+    memset(res, 0, sizeof(*res));
+    res->peer = -1;
+    res->path = file_path;
+    io_count_syscalls(SYSCALL_FILE, 2);
+    res->fd = open(full_path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (res->fd < 0 || fstat(res->fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        if (res->fd < 0 && errno != ENOENT && errno != ENOTDIR)
+        {
+            log_errno("Error while opening file");
+        }
+        else
+        {
+            log_debug("No encontrado: %s", full_path);
+        }
+        http_close_resource(res);
+        return 404;
+    }
+
+    res->file_size = (long)st.st_size;
+    res->mime = get_mime_type(file_path);
+    res->start = 0;
+    res->end = res->file_size - 1;
+
+    int has_range = parse_range(range_spec, res->file_size, &res->start, &res->end);
+    if (has_range < 0)
     {
-        printf("Abriendo archivo: %s\n", full_path);
+        http_close_resource(res);
+        return 416;
     }
 
-    file = fopen(full_path, read_mode);
+    res->content_length = (has_range == 1) ? (res->end - res->start + 1) : res->file_size;
 
-    if (file == NULL)
+    /* Files that fit the conn buffer stay on the page cache: they would waste most of a block. */
+    if (is_block_cache_enabled() && res->file_size > CONN_BODY_BUFFER_SIZE)
+    {
+        res->cacheable = 1;
+        res->cache_file.dev = st.st_dev;
+        res->cache_file.ino = st.st_ino;
+        res->cache_file.size = res->file_size;
+        res->cache_file.mtime_ns = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        res->peer = from_peer ? -1 : cluster_route(file_path);
+    }
+    return (has_range == 1) ? 206 : 200;
+}
+
+/* Large files bypass the page cache: O_DIRECT when asked for and supported by the filesystem
+ * (tmpfs is not), otherwise drop-behind on the regular descriptor. */
+static void prepare_uncached(const char *file_path, http_resource_t *res)
+{
+    if (g_uncached_threshold <= 0 || res->content_length < g_uncached_threshold ||
+        res->content_length <= CONN_BODY_BUFFER_SIZE)
     {
-        perror("Error while opening file");
-        write(client_fd, not_found_response, strlen(not_found_response));
-        increment_failed();
         return;
     }
 
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    res->cache_mode = HTTP_CACHE_DROP_BEHIND;
+    if (g_uncached_direct)
+    {
+        char full_path[PATH_MAX];
+        snprintf(full_path, sizeof(full_path), "%s%s", base_path, file_path);
+        io_count_syscalls(SYSCALL_FILE, 1);
+        int direct_fd = open(full_path, O_RDONLY | O_CLOEXEC | O_DIRECT);
+        if (direct_fd >= 0)
+        {
+            http_close_resource(res);
+            res->fd = direct_fd;
+            res->cache_mode = HTTP_CACHE_DIRECT;
+        }
+    }
+}
 
-    const char *mime = get_mime_type(file_path);
+/* pread(2) for callers that copy the body (short ranges, HTTP/2 frames), through the block cache
+ * when the file is cacheable. Misses are filled from the owning peer when the path belongs to one,
+ * otherwise from the file. */
+static block_t *acquire_block(const http_resource_t *res, long index, const char **data, size_t *len)
+{
+    block_source_t source = {res->fd, res->cache_mode == HTTP_CACHE_DROP_BEHIND, res->peer, res->path};
+    return block_cache_acquire(&res->cache_file, index, &source, data, len);
+}
 
-    long start = 0, end = file_size - 1;
-    int has_range = parse_range(request, file_size, &start, &end);
-    if (has_range < 0)
+ssize_t http_read_resource(const http_resource_t *res, void *buf, size_t len, off_t offset)
+{
+    if (!res->cacheable)
+    {
+        return io_pread(res->fd, buf, len, offset);
+    }
+
+    size_t done = 0;
+    while (done < len)
+    {
+        off_t pos = offset + (off_t)done;
+        long index = (long)(pos / BLOCK_CACHE_BLOCK_SIZE);
+        size_t skip = (size_t)(pos - (off_t)index * BLOCK_CACHE_BLOCK_SIZE);
+        size_t want = len - done;
+        const char *data;
+        size_t block_len;
+        block_t *block = acquire_block(res, index, &data, &block_len);
+        if (!block)
+        {
+            if (want > BLOCK_CACHE_BLOCK_SIZE - skip)
+            {
+                want = BLOCK_CACHE_BLOCK_SIZE - skip;
+            }
+            ssize_t n = io_pread(res->fd, (char *)buf + done, want, pos);
+            if (n <= 0)
+            {
+                return done > 0 ? (ssize_t)done : n;
+            }
+            done += (size_t)n;
+            continue;
+        }
+        if (block_len <= skip)
+        {
+            block_cache_release(block);
+            break;
+        }
+        if (want > block_len - skip)
+        {
+            want = block_len - skip;
+        }
+        memcpy((char *)buf + done, data + skip, want);
+        block_cache_release(block);
+        done += want;
+    }
+    return (ssize_t)done;
+}
+
+void http_close_resource(http_resource_t *res)
+{
+    if (res->fd >= 0)
+    {
+        io_count_syscalls(SYSCALL_FILE, 1);
+        close(res->fd);
+    }
+    res->fd = -1;
+}
+
+static void count_send_failure(const client_t *client, const char *what)
+{
+    if (errno == EPIPE || errno == ECONNRESET)
+    {
+        PROBE2(abort, client->conn_id, errno);
+        increment_aborted();
+    }
+    else
+    {
+        log_errno(what);
+        increment_failed();
+    }
+}
+
+static const char *connection_header(int keep_alive)
+{
+    return keep_alive ? "keep-alive" : "close";
+}
+
+static int send_simple_response(conn_t *conn, const char *status_line, const char *body, int keep_alive)
+{
+    size_t body_len = body ? strlen(body) : 0;
+    size_t cap = 256 + body_len;
+    char *resp = arena_alloc(&conn->arena, cap);
+    if (!resp)
     {
-        const char *resp =
-            "HTTP/1.1 416 Range Not Satisfiable\r\n"
-            "Content-Length: 0\r\n"
-            "Connection: close\r\n"
-            "\r\n";
-        send_all(client_fd, resp, strlen(resp));
-        fclose(file);
+        return -1;
+    }
+    int len = snprintf(resp, cap,
+                       "HTTP/1.1 %s\r\n"
+                       "Content-Type: text/plain; charset=utf-8\r\n"
+                       "Content-Length: %zu\r\n"
+                       "Connection: %s\r\n"
+                       "\r\n"
+                       "%s",
+                       status_line, body_len, connection_header(keep_alive), body ? body : "");
+    return io_send_all(&conn->client, resp, (size_t)len);
+}
+
+/* Waiting for the rest of the head is bounded by the header deadline and, after a grace
+ * period, by the minimum arrival rate: the bytes received so far buy time at that rate.
+ * Both become the io_wait deadline, so a trickling client costs no extra thread. */
+static uint64_t header_deadline(uint64_t start_ns, size_t received, int *below_min_rate)
+{
+    uint64_t hard_ns = g_header_timeout_ms > 0 ? start_ns + (uint64_t)g_header_timeout_ms * 1000000ULL : 0;
+    *below_min_rate = 0;
+    if (g_header_min_rate <= 0)
+    {
+        return hard_ns;
+    }
+
+    uint64_t earned_ms = (uint64_t)received * 1000ULL / (uint64_t)g_header_min_rate;
+    if (earned_ms < HTTP_HEADER_GRACE_MS)
+    {
+        earned_ms = HTTP_HEADER_GRACE_MS;
+    }
+    uint64_t rate_ns = start_ns + earned_ms * 1000000ULL;
+    if (hard_ns == 0 || rate_ns < hard_ns)
+    {
+        *below_min_rate = 1;
+        return rate_ns;
+    }
+    return hard_ns;
+}
+
+/* Returns the head length, 0 if the peer closed, -1 when it exceeds the header limit and
+ * -2 when the deadline or the minimum rate ran out. */
+static long read_request_head(conn_t *conn, int *below_min_rate)
+{
+    size_t scanned = 0;
+    size_t carried = conn->io_len;
+    uint64_t start_ns = trace_now_ns();
+    while (1)
+    {
+        if (http2_is_preface(conn->io_buf, conn->io_len))
+        {
+            io_set_deadline(0);
+            return (long)conn->io_len;
+        }
+        /* A preface split across reads already holds "\r\n\r\n": wait for all of it. */
+        size_t scan_end = http2_is_partial_preface(conn->io_buf, conn->io_len) ? 0 : conn->io_len;
+        for (size_t i = scanned; i + 3 < scan_end; i++)
+        {
+            if (memcmp(conn->io_buf + i, "\r\n\r\n", 4) == 0)
+            {
+                io_set_deadline(0);
+                return (long)(i + 4);
+            }
+        }
+        if (scan_end > 3)
+        {
+            scanned = scan_end - 3;
+        }
+
+        if (conn->io_len >= g_header_max)
+        {
+            io_set_deadline(0);
+            return -1;
+        }
+
+        io_set_deadline(header_deadline(start_ns, conn->io_len - carried, below_min_rate));
+        ssize_t n = io_read(&conn->client, conn->io_buf + conn->io_len, g_header_max - conn->io_len);
+        if (n <= 0)
+        {
+            int timed_out = n < 0 && errno == ETIMEDOUT;
+            io_set_deadline(0);
+            return timed_out ? -2 : 0;
+        }
+        conn->io_len += (size_t)n;
+    }
+}
+
+static void consume_request_head(conn_t *conn, size_t len)
+{
+    memmove(conn->io_buf, conn->io_buf + len, conn->io_len - len);
+    conn->io_len -= len;
+}
+
+/* Drops pages one chunk behind the cursor. Windows are aligned to IO_DROP_CHUNK because the
+ * kernel only evicts large folios that a range fully covers, and pages still queued on the
+ * socket are skipped; the final call therefore sweeps the whole body once more. */
+static void drop_behind(int file_fd, http_cache_mode_t mode, off_t *dropped, off_t cursor, off_t body_start)
+{
+    if (mode != HTTP_CACHE_DROP_BEHIND)
+    {
+        return;
+    }
+    if (body_start >= 0)
+    {
+        off_t from = body_start & ~(off_t)(IO_DROP_CHUNK - 1);
+        io_drop_cache(file_fd, from, cursor - from);
         return;
     }
+    off_t limit = (cursor - IO_DROP_CHUNK) & ~(off_t)(IO_DROP_CHUNK - 1);
+    if (limit > *dropped)
+    {
+        io_drop_cache(file_fd, *dropped, limit - *dropped);
+        *dropped = limit;
+    }
+}
+
+/* O_DIRECT: aligned reads into the worker's direct buffer, sending only the requested slice. */
+static int send_body_direct(client_t *client, int file_fd, long start, long content_length, long remaining,
+                            unsigned long long *bytes)
+{
+    char *buf = io_direct_buffer();
+    if (!buf)
+    {
+        log_errno("Failed to allocate direct buffer");
+        increment_failed();
+        return -1;
+    }
+
+    while (remaining > 0)
+    {
+        off_t pos = (off_t)(start + (content_length - remaining));
+        off_t aligned = pos & ~(off_t)(IO_DIRECT_ALIGN - 1);
+        size_t skip = (size_t)(pos - aligned);
+        size_t want = skip + (size_t)remaining;
+        want = (want + IO_DIRECT_ALIGN - 1) & ~(size_t)(IO_DIRECT_ALIGN - 1);
+        if (want > IO_DIRECT_BUFFER_SIZE)
+        {
+            want = IO_DIRECT_BUFFER_SIZE;
+        }
+
+        ssize_t got = io_pread(file_fd, buf, want, aligned);
+        if (got <= (ssize_t)skip)
+        {
+            log_errno("Error while reading file");
+            increment_failed();
+            return -1;
+        }
+
+        size_t chunk = (size_t)got - skip;
+        if (chunk > (size_t)remaining)
+        {
+            chunk = (size_t)remaining;
+        }
+        if (io_send_all(client, buf + skip, chunk) == -1)
+        {
+            count_send_failure(client, "send file");
+            return -1;
+        }
+
+        PROBE3(send_chunk, client->conn_id, pos, chunk);
+        add_bytes_sent((unsigned long)chunk);
+        *bytes += (unsigned long long)chunk;
+        remaining -= (long)chunk;
+    }
+    return 0;
+}
+
+/* Streams [start + (content_length - remaining), start + content_length) of the file. */
+static int send_body_from_file(client_t *client, int file_fd, http_cache_mode_t cache_mode, long start,
+                               long content_length, long remaining, char *buf, size_t buf_cap,
+                               unsigned long long *bytes)
+{
+    if (cache_mode == HTTP_CACHE_DIRECT)
+    {
+        return send_body_direct(client, file_fd, start, content_length, remaining, bytes);
+    }
+
+    off_t dropped = (off_t)(start + (content_length - remaining)) & ~(off_t)(IO_DROP_CHUNK - 1);
+    int use_sendfile = !client->tls || client->ktls_send;
+    while (use_sendfile && remaining > 0)
+    {
+        off_t offset = (off_t)(start + (content_length - remaining));
+        size_t len = (size_t)remaining;
+        if (cache_mode == HTTP_CACHE_DROP_BEHIND && len > IO_DROP_CHUNK)
+        {
+            len = IO_DROP_CHUNK;
+        }
+        ssize_t sent = io_sendfile(client, file_fd, offset, len);
+        if (sent <= 0)
+        {
+            count_send_failure(client, "sendfile");
+            return -1;
+        }
+
+        PROBE3(send_chunk, client->conn_id, offset, sent);
+        add_bytes_sent((unsigned long)sent);
+        *bytes += (unsigned long long)sent;
+        remaining -= (long)sent;
+        drop_behind(file_fd, cache_mode, &dropped, offset + sent, -1);
+    }
+
+    while (remaining > 0)
+    {
+        off_t offset = (off_t)(start + (content_length - remaining));
+        size_t to_read = (remaining < (long)buf_cap) ? (size_t)remaining : buf_cap;
+        ssize_t bytes_read = io_pread(file_fd, buf, to_read, offset);
+        if (bytes_read <= 0)
+        {
+            log_errno("Error while reading file");
+            increment_failed();
+            return -1;
+        }
+
+        if (io_send_all(client, buf, (size_t)bytes_read) == -1)
+        {
+            count_send_failure(client, "send file");
+            return -1;
+        }
+
+        PROBE3(send_chunk, client->conn_id, offset, bytes_read);
+        add_bytes_sent((unsigned long)bytes_read);
+        *bytes += (unsigned long long)bytes_read;
+        remaining -= (long)bytes_read;
+        drop_behind(file_fd, cache_mode, &dropped, offset + bytes_read, -1);
+    }
+    drop_behind(file_fd, cache_mode, &dropped, (off_t)(start + content_length), (off_t)start);
+    return 0;
+}
+
+/* Same contract, assembled from block cache slices sent straight from the pinned block. A block
+ * the cache cannot take right now is streamed from the file instead. */
+static int send_body(client_t *client, const http_resource_t *res, long remaining, char *buf, size_t buf_cap,
+                     unsigned long long *bytes)
+{
+    long start = res->start, content_length = res->content_length;
+    if (!res->cacheable)
+    {
+        return send_body_from_file(client, res->fd, res->cache_mode, start, content_length, remaining, buf, buf_cap,
+                                   bytes);
+    }
+
+    while (remaining > 0)
+    {
+        long pos = start + (content_length - remaining);
+        long index = pos / BLOCK_CACHE_BLOCK_SIZE;
+        size_t skip = (size_t)(pos - index * BLOCK_CACHE_BLOCK_SIZE);
+        const char *data;
+        size_t block_len;
+        block_t *block = acquire_block(res, index, &data, &block_len);
+        if (!block)
+        {
+            long chunk = BLOCK_CACHE_BLOCK_SIZE - (long)skip;
+            if (chunk > remaining)
+            {
+                chunk = remaining;
+            }
+            if (send_body_from_file(client, res->fd, res->cache_mode, pos, chunk, chunk, buf, buf_cap, bytes) != 0)
+            {
+                return -1;
+            }
+            remaining -= chunk;
+            continue;
+        }
+        if (block_len <= skip)
+        {
+            block_cache_release(block);
+            log_warn("File changed while serving it from the block cache");
+            increment_failed();
+            return -1;
+        }
+
+        size_t chunk = block_len - skip;
+        if (chunk > (size_t)remaining)
+        {
+            chunk = (size_t)remaining;
+        }
+        int sent = io_send_all(client, data + skip, chunk);
+        block_cache_release(block);
+        if (sent == -1)
+        {
+            count_send_failure(client, "send file");
+            return -1;
+        }
+
+        PROBE3(send_chunk, client->conn_id, pos, chunk);
+        add_bytes_sent((unsigned long)chunk);
+        *bytes += (unsigned long long)chunk;
+        remaining -= (long)chunk;
+    }
+    return 0;
+}
+
+static void finish_request(client_t *client, const request_result_t *result)
+{
+    request_trace_t *trace = &client->trace;
+    if (trace->ts_ns[TRACE_LAST_BYTE] == 0)
+    {
+        trace_mark(trace, TRACE_LAST_BYTE);
+    }
+    trace_finish(trace, client->fd, result->path);
+    PROBE4(done, client->conn_id, result->status, result->bytes,
+           trace->ts_ns[TRACE_LAST_BYTE] - trace->ts_ns[TRACE_DEQUEUE]);
+
+    /* Per-pool latency includes the queue wait, which is what the split is meant to protect. */
+    uint64_t arrived_ns = trace->ts_ns[TRACE_ENQUEUE] ? trace->ts_ns[TRACE_ENQUEUE] : trace->ts_ns[TRACE_DEQUEUE];
+    if ((result->status == 200 || result->status == 206) && arrived_ns != 0)
+    {
+        add_size_class_sample(result->size_class, (trace->ts_ns[TRACE_LAST_BYTE] - arrived_ns) / 1000ULL);
+    }
+
+    if (is_access_log_enabled())
+    {
+        access_log_request(client, result->path, result->status, result->bytes,
+                           result->range_start, result->range_end);
+    }
+
+    io_flush_syscall_stats();
+    dashboard_request_done(client->worker_id);
+}
+
+/* Serves one request from the connection. Returns 1 if another request may follow,
+ * 0 when the connection must close and -1 if nothing was read at all. */
+static int serve_request(conn_t *conn, request_result_t *result, int last_request)
+{
+    client_t *client = &conn->client;
+    request_trace_t *trace = &client->trace;
+
+    int below_min_rate = 0;
+    long head_len = read_request_head(conn, &below_min_rate);
+    if (head_len == 0)
+    {
+        return -1;
+    }
+
+    /* Slow heads are dropped without blocking on the reply: one nonblocking 408 attempt. */
+    if (head_len == -2)
+    {
+        record_header_timeout(below_min_rate);
+        result->status = 408;
+        if (!client->tls)
+        {
+            send(client->fd, request_timeout, sizeof(request_timeout) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+        }
+        return 0;
+    }
+
+    if (head_len < 0)
+    {
+        increment_requests();
+        increment_failed();
+        result->status = 431;
+        send_simple_response(conn, "431 Request Header Fields Too Large", NULL, 0);
+        return 0;
+    }
+
+    if (http2_is_preface(conn->io_buf, conn->io_len))
+    {
+        result->http2 = 1;
+        dashboard_publish(client->worker_id, WORKER_HTTP2, client->fd);
+        http2_serve(client, conn->io_buf, conn->io_len);
+        return 0;
+    }
+
+    increment_requests();
+
+    http_request_t req;
+    if (parse_http_request(conn->io_buf, (size_t)head_len, &conn->arena, &req) != 0)
+    {
+        increment_failed();
+        result->status = 400;
+        send_simple_response(conn, "400 Bad Request", NULL, 0);
+        return 0;
+    }
+    consume_request_head(conn, (size_t)head_len);
+    trace_mark(trace, TRACE_PARSE_DONE);
+    PROBE3(parse, client->conn_id, req.method, req.path);
+
+    if (is_capture_enabled())
+    {
+        capture_request(client, req.method, req.path, http_request_header(&req, "Range"));
+    }
+
+    /* Request bodies are not supported, so never try to reuse a connection that sent one. */
+    const char *content_length_header = http_request_header(&req, "Content-Length");
+    int keep_alive = req.keep_alive && !last_request && g_keepalive_timeout_ms > 0 &&
+                     !http_request_header(&req, "Transfer-Encoding") &&
+                     !(content_length_header && atol(content_length_header) > 0);
+    int head_only = strcmp(req.method, "HEAD") == 0;
+
+    size_t path_cap = strlen(req.path) + sizeof("/index.html") + 1;
+    char *file_path = arena_alloc(&conn->arena, path_cap);
+    if (!file_path)
+    {
+        increment_failed();
+        result->status = 431;
+        send_simple_response(conn, "431 Request Header Fields Too Large", NULL, 0);
+        return 0;
+    }
+    strcpy(file_path, req.path);
+    result->path = file_path;
+
+    if (http_normalize_path(file_path, path_cap) != 0)
+    {
+        result->status = 404;
+        send_simple_response(conn, "404 Not Found", head_only ? NULL : not_found_body, keep_alive);
+        return keep_alive;
+    }
+
+    if (http2_is_upgrade(&req))
+    {
+        result->http2 = 1;
+        dashboard_publish(client->worker_id, WORKER_HTTP2, client->fd);
+        http2_upgrade(client, &req, file_path, conn->io_buf, conn->io_len);
+        return 0;
+    }
+
+    dashboard_publish(client->worker_id, WORKER_SENDING, client->fd);
+
+    const char *range_spec = http_request_header(&req, "Range");
+    if (range_spec && strncmp(range_spec, "bytes=", 6) == 0)
+    {
+        range_spec += strlen("bytes=");
+    }
+    else
+    {
+        range_spec = NULL;
+    }
+
+    /* The header alone is not trusted: a client could use it to skip routing and hot-key counting. */
+    int from_peer = is_cluster_enabled() &&
+                    cluster_is_peer_request(&client->peer, http_request_header(&req, CLUSTER_PEER_HEADER));
+    if (from_peer)
+    {
+        record_peer_request();
+    }
+
+    http_resource_t res;
+    int status = http_open_resource(file_path, range_spec, from_peer, &res);
+    trace_mark(trace, TRACE_FILE_OPEN);
+    PROBE3(open, client->conn_id, file_path, status);
+    result->status = status;
+
+    if (status == 404)
+    {
+        send_simple_response(conn, "404 Not Found", head_only ? NULL : not_found_body, keep_alive);
+        increment_failed();
+        return keep_alive;
+    }
 
-    long content_length = (has_range == 1) ? (end - start + 1) : file_size;
+    if (status == 416)
+    {
+        send_simple_response(conn, "416 Range Not Satisfiable", NULL, keep_alive);
+        return keep_alive;
+    }
 
-    char header_buffer[1024];
+    if (!head_only)
+    {
+        prepare_uncached(file_path, &res);
+    }
+
+    const char *mime = res.mime;
+    long file_size = res.file_size;
+    long start = res.start, end = res.end;
+    long content_length = res.content_length;
+    int has_range = (status == 206);
+    if (has_range == 1)
+    {
+        result->range_start = start;
+        result->range_end = end;
+    }
+
+    size_t header_cap = 512 + strlen(mime);
+    char *header_buffer = arena_alloc(&conn->arena, header_cap);
+    if (!header_buffer)
+    {
+        http_close_resource(&res);
+        increment_failed();
+        result->status = 431;
+        send_simple_response(conn, "431 Request Header Fields Too Large", NULL, 0);
+        return 0;
+    }
     int header_len;
 
     if (has_range == 1)
     {
-        header_len = snprintf(header_buffer, sizeof(header_buffer),
+        header_len = snprintf(header_buffer, header_cap,
                               "HTTP/1.1 206 Partial Content\r\n"
                               "Content-Type: %s\r\n"
                               "Accept-Ranges: bytes\r\n"
                               "Content-Range: bytes %ld-%ld/%ld\r\n"
                               "Content-Length: %ld\r\n"
-                              "Connection: close\r\n"
+                              "Connection: %s\r\n"
                               "\r\n",
-                              mime, start, end, file_size, content_length);
-
-        fseek(file, start, SEEK_SET);
+                              mime, start, end, file_size, content_length, connection_header(keep_alive));
     }
     else
     {
-        header_len = snprintf(header_buffer, sizeof(header_buffer),
+        header_len = snprintf(header_buffer, header_cap,
                               "HTTP/1.1 200 OK\r\n"
                               "Content-Length: %ld\r\n"
                               "Content-Type: %s\r\n"
                               "Accept-Ranges: bytes\r\n"
-                              "Connection: close\r\n"
+                              "Connection: %s\r\n"
                               "\r\n",
-                              file_size, mime);
+                              file_size, mime, connection_header(keep_alive));
     }
 
-    if (send_all(client_fd, header_buffer, (size_t)header_len) == -1)
+    long remaining = head_only ? 0 : content_length;
+
+    /* Bulk bodies move to the bulk pool so they never hold a worker that small requests need.
+     * Pipelined bytes stay in this conn's buffer, so such connections are served inline. */
+    result->size_class = http_size_class(mime, content_length);
+    if (result->size_class == SIZE_CLASS_BULK && remaining > 0 && conn->io_len == 0 && is_bulk_pool_enabled() &&
+        (size_t)header_len < sizeof(((http_bulk_job_t *)0)->header))
     {
-        perror("send headers");
-        fclose(file);
-        increment_failed();
-        return;
+        http_bulk_job_t job;
+        job.client = *client;
+        job.res = res;
+        job.keep_alive = keep_alive;
+        job.status = status;
+        job.header_len = (size_t)header_len;
+        memcpy(job.header, header_buffer, (size_t)header_len);
+        snprintf(job.path, sizeof(job.path), "%s", file_path);
+        if (dispatch_bulk(&job) == 0)
+        {
+            PROBE2(handoff, client->conn_id, client->worker_id);
+            result->handed_off = 1;
+            return 0;
+        }
     }
 
-    gettimeofday(&first_response_time, NULL);
-    unsigned long long response_time_us =
-        (first_response_time.tv_sec - start_time.tv_sec) * 1000000ULL +
-        (first_response_time.tv_usec - start_time.tv_usec);
-    add_response_time(response_time_us);
-
-    int request_failed = 0;
-    long remaining = content_length;
-    while (remaining > 0)
+    /* Small bodies go out with the header in one write; larger ones cork the header onto sendfile. */
+    if (remaining <= (long)sizeof(conn->body_buf))
     {
-        size_t to_read = (remaining < (long)sizeof(buffer)) ? (size_t)remaining : sizeof(buffer);
-        size_t bytes_read = fread(buffer, 1, to_read, file);
-        if (bytes_read == 0)
+        if (remaining > 0 && http_read_resource(&res, conn->body_buf, (size_t)remaining, (off_t)start) != remaining)
         {
-            break;
+            log_errno("Error while reading file");
+            http_close_resource(&res);
+            increment_failed();
+            return 0;
+        }
+        if (io_send_pair(client, header_buffer, (size_t)header_len, conn->body_buf, (size_t)remaining) == -1)
+        {
+            count_send_failure(client, "send response");
+            http_close_resource(&res);
+            return 0;
         }
+        PROBE3(send_chunk, client->conn_id, start, remaining);
+        add_bytes_sent((unsigned long)remaining);
+        result->bytes += (unsigned long long)remaining;
+        remaining = 0;
+    }
+    else if (io_send_more(client, header_buffer, (size_t)header_len) == -1)
+    {
+        log_errno("send headers");
+        http_close_resource(&res);
+        increment_failed();
+        return 0;
+    }
+
+    trace_mark(trace, TRACE_FIRST_BYTE);
+    PROBE2(first_byte, client->conn_id, status);
+    add_response_time((trace->ts_ns[TRACE_FIRST_BYTE] - trace->ts_ns[TRACE_DEQUEUE]) / 1000ULL);
+
+    int request_failed = send_body(client, &res, remaining, conn->body_buf, sizeof(conn->body_buf),
+                                   &result->bytes) != 0;
+    if (!request_failed)
+    {
+        increment_successful();
+    }
+
+    http_close_resource(&res);
+
+    trace_mark(trace, TRACE_LAST_BYTE);
+    add_turnaround_time((trace->ts_ns[TRACE_LAST_BYTE] - trace->ts_ns[TRACE_DEQUEUE]) / 1000ULL);
+    return request_failed ? 0 : keep_alive;
+}
+
+/* Body transfer on a bulk worker. Returns 1 if the connection should go back for more requests. */
+int http_serve_bulk(http_bulk_job_t *job, char *buf, size_t buf_cap)
+{
+    client_t *client = &job->client;
+    request_trace_t *trace = &client->trace;
+    request_result_t result = {job->status, 0, -1, -1, 0, job->path, SIZE_CLASS_BULK, 0};
+    job->res.path = job->path;
+    if (job->status == 206)
+    {
+        result.range_start = job->res.start;
+        result.range_end = job->res.end;
+    }
+
+    dashboard_request_start(client->worker_id, client->fd, trace->ts_ns[TRACE_DEQUEUE]);
+    dashboard_publish(client->worker_id, WORKER_SENDING, client->fd);
+
+    int request_failed = 1;
+    if (io_send_more(client, job->header, job->header_len) == -1)
+    {
+        log_errno("send headers");
+        increment_failed();
+    }
+    else
+    {
+        trace_mark(trace, TRACE_FIRST_BYTE);
+        PROBE2(first_byte, client->conn_id, job->status);
+        add_response_time((trace->ts_ns[TRACE_FIRST_BYTE] - trace->ts_ns[TRACE_DEQUEUE]) / 1000ULL);
+        request_failed = send_body(client, &job->res, job->res.content_length, buf, buf_cap, &result.bytes) != 0;
+    }
+    if (!request_failed)
+    {
+        increment_successful();
+    }
+    http_close_resource(&job->res);
+
+    trace_mark(trace, TRACE_LAST_BYTE);
+    add_turnaround_time((trace->ts_ns[TRACE_LAST_BYTE] - trace->ts_ns[TRACE_DEQUEUE]) / 1000ULL);
+    finish_request(client, &result);
+
+    client->requests_served++;
+    if (!request_failed && job->keep_alive && client->requests_served < g_keepalive_max_requests)
+    {
+        return 1;
+    }
+    tls_close(client);
+    return 0;
+}
 
-        if (send_all(client_fd, buffer, bytes_read) == -1)
+/* Returns 1 when the connection was handed to the bulk pool and must stay open. */
+int handle_client(conn_t *conn)
+{
+    client_t *client = &conn->client;
+
+    if (client->proxy)
+    {
+        io_set_deadline(g_header_timeout_ms > 0 ? trace_now_ns() + (uint64_t)g_header_timeout_ms * 1000000ULL : 0);
+        errno = 0;
+        int parsed = proxy_accept(client, 1);
+        io_set_deadline(0);
+        if (parsed != 1)
         {
-            if (errno == EPIPE || errno == ECONNRESET)
+            if (errno == ETIMEDOUT)
             {
-                increment_aborted();
+                record_header_timeout(0);
             }
-            else
-            {
-                perror("send file");
-                increment_failed();
-            }
-            request_failed = 1;
-            break;
+            log_debug("Cabecera PROXY inválida o incompleta en fd %d", client->fd);
+            return 0;
         }
-
-        add_bytes_sent(bytes_read);
-        remaining -= (long)bytes_read;
+        client->proxy = 0;
     }
 
-    if (ferror(file))
+    if (client->tls && !client->ssl)
     {
-        perror("Error while reading file");
-        if (!request_failed)
+        dashboard_publish(client->worker_id, WORKER_HANDSHAKE, client->fd);
+        io_set_deadline(g_header_timeout_ms > 0 ? trace_now_ns() + (uint64_t)g_header_timeout_ms * 1000000ULL : 0);
+        int handshake = tls_accept(client);
+        io_set_deadline(0);
+        if (handshake != 0)
         {
-            increment_failed();
-            request_failed = 1;
+            if (errno == ETIMEDOUT)
+            {
+                record_header_timeout(0);
+            }
+            return 0;
         }
     }
-    else if (!request_failed)
+
+    if (client->alpn_h2)
     {
-        increment_successful();
+        dashboard_publish(client->worker_id, WORKER_HTTP2, client->fd);
+        http2_serve(client, NULL, 0);
+        io_flush_syscall_stats();
+        tls_close(client);
+        return 0;
     }
 
-    fclose(file);
+    for (; client->requests_served < g_keepalive_max_requests; client->requests_served++)
+    {
+        request_result_t result = {0, 0, -1, -1, 0, "-", SIZE_CLASS_SMALL, 0};
+
+        if (client->requests_served > 0)
+        {
+            dashboard_publish(client->worker_id, WORKER_KEEPALIVE, client->fd);
+            if (conn->io_len == 0 && !io_readable(client, g_keepalive_timeout_ms))
+            {
+                break;
+            }
+            memset(&client->trace, 0, sizeof(client->trace));
+            trace_mark(&client->trace, TRACE_DEQUEUE);
+        }
+        dashboard_request_start(client->worker_id, client->fd, client->trace.ts_ns[TRACE_DEQUEUE]);
+
+        int keep_alive = serve_request(conn, &result, client->requests_served + 1 >= g_keepalive_max_requests);
+        if (result.handed_off)
+        {
+            io_flush_syscall_stats();
+            return 1;
+        }
+
+        /* HTTP/2 streams are traced and logged individually. */
+        if (result.http2 || (keep_alive < 0 && client->requests_served > 0))
+        {
+            break;
+        }
+        if (keep_alive < 0)
+        {
+            increment_requests();
+        }
+
+        finish_request(client, &result);
+        conn_reset_request(conn);
+        if (keep_alive <= 0)
+        {
+            break;
+        }
+    }
 
-    gettimeofday(&end_time, NULL);
-    unsigned long long turnaround_time_us =
-        (end_time.tv_sec - start_time.tv_sec) * 1000000ULL +
-        (end_time.tv_usec - start_time.tv_usec);
-    add_turnaround_time(turnaround_time_us);
-}
\ No newline at end of file
+    io_flush_syscall_stats();
+    tls_close(client);
+    return 0;
+}
@@ -0,0 +1,1034 @@
+#define _GNU_SOURCE
+#include "http2.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include "http.h"
+#include "hpack.h"
+#include "io.h"
+#include "stats.h"
+#include "trace.h"
+#include "accesslog.h"
+#include "capture.h"
+
+#define H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define H2_PREFACE_LEN 24
+#define H2_FRAME_HEADER 9
+#define H2_DEFAULT_FRAME_SIZE 16384
+#define H2_MAX_FRAME_SIZE 16777215
+#define H2_DEFAULT_WINDOW 65535
+#define H2_MAX_WINDOW 0x7fffffff
+#define H2_MAX_STREAMS 100
+#define H2_HEADER_BLOCK_MAX 16384
+#define H2_IDLE_TIMEOUT_MS 30000
+#define H2_DEFAULT_WEIGHT 16
+
+#define H2_DATA 0x0
+#define H2_HEADERS 0x1
+#define H2_PRIORITY 0x2
+#define H2_RST_STREAM 0x3
+#define H2_SETTINGS 0x4
+#define H2_PING 0x6
+#define H2_GOAWAY 0x7
+#define H2_WINDOW_UPDATE 0x8
+#define H2_CONTINUATION 0x9
+
+#define H2_FLAG_END_STREAM 0x1
+#define H2_FLAG_ACK 0x1
+#define H2_FLAG_END_HEADERS 0x4
+#define H2_FLAG_PADDED 0x8
+#define H2_FLAG_PRIORITY 0x20
+
+#define H2_SETTINGS_HEADER_TABLE_SIZE 0x1
+#define H2_SETTINGS_MAX_CONCURRENT_STREAMS 0x3
+#define H2_SETTINGS_INITIAL_WINDOW_SIZE 0x4
+#define H2_SETTINGS_MAX_FRAME_SIZE 0x5
+
+#define H2_NO_ERROR 0x0
+#define H2_PROTOCOL_ERROR 0x1
+#define H2_FLOW_CONTROL_ERROR 0x3
+#define H2_FRAME_SIZE_ERROR 0x6
+#define H2_REFUSED_STREAM 0x7
+#define H2_COMPRESSION_ERROR 0x9
+#define H2_ENHANCE_YOUR_CALM 0xb
+
+typedef struct
+{
+    uint32_t id;
+    int active;
+    int status;
+    int head_only;
+    int weight;
+    int32_t window;
+    long offset;
+    long remaining;
+    unsigned long long bytes;
+    http_resource_t res;
+    request_trace_t trace;
+    char path[HTTP_PATH_MAX];
+} h2_stream_t;
+
+typedef struct
+{
+    client_t *client;
+    hpack_table_t decoder;
+
+    uint8_t in[2 * (H2_DEFAULT_FRAME_SIZE + H2_FRAME_HEADER)];
+    size_t in_len;
+    int preface_pending;
+
+    uint8_t header_block[H2_HEADER_BLOCK_MAX];
+    size_t header_len;
+    uint32_t header_stream;
+    int header_end_stream;
+    int header_weight;
+
+    h2_stream_t streams[H2_MAX_STREAMS];
+    int next_slot;
+    int first_stream_pending;
+
+    int32_t conn_window;
+    int32_t peer_initial_window;
+    uint32_t peer_max_frame;
+    uint32_t last_stream_id;
+    int goaway;
+
+    uint8_t out[H2_FRAME_HEADER + H2_DEFAULT_FRAME_SIZE];
+} h2_conn_t;
+
+typedef struct
+{
+    char method[16];
+    char path[HTTP_PATH_MAX];
+    char range[64];
+    int too_long;
+} h2_request_t;
+
+int http2_is_preface(const char *buf, size_t len)
+{
+    return len >= H2_PREFACE_LEN && memcmp(buf, H2_PREFACE, H2_PREFACE_LEN) == 0;
+}
+
+int http2_is_partial_preface(const char *buf, size_t len)
+{
+    return len < H2_PREFACE_LEN && memcmp(buf, H2_PREFACE, len) == 0;
+}
+
+int http2_is_upgrade(const http_request_t *req)
+{
+    const char *upgrade = http_request_header(req, "Upgrade");
+    return upgrade && strncasecmp(upgrade, "h2c", 3) == 0 && http_request_header(req, "HTTP2-Settings") != NULL;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put_frame_header(uint8_t *p, uint32_t len, uint8_t type, uint8_t flags, uint32_t stream_id)
+{
+    p[0] = (uint8_t)(len >> 16);
+    p[1] = (uint8_t)(len >> 8);
+    p[2] = (uint8_t)len;
+    p[3] = type;
+    p[4] = flags;
+    put_u32(p + 5, stream_id & 0x7fffffff);
+}
+
+static int send_frame(h2_conn_t *conn, uint8_t type, uint8_t flags, uint32_t stream_id,
+                      const void *payload, size_t len)
+{
+    uint8_t header[H2_FRAME_HEADER];
+    put_frame_header(header, (uint32_t)len, type, flags, stream_id);
+    if (io_send_all(conn->client, header, sizeof(header)) != 0)
+    {
+        return -1;
+    }
+    if (len > 0 && io_send_all(conn->client, payload, len) != 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+static int send_settings(h2_conn_t *conn)
+{
+    uint8_t payload[6];
+    payload[0] = 0;
+    payload[1] = H2_SETTINGS_MAX_CONCURRENT_STREAMS;
+    put_u32(payload + 2, H2_MAX_STREAMS);
+    return send_frame(conn, H2_SETTINGS, 0, 0, payload, sizeof(payload));
+}
+
+static void send_goaway(h2_conn_t *conn, uint32_t error_code)
+{
+    uint8_t payload[8];
+    put_u32(payload, conn->last_stream_id);
+    put_u32(payload + 4, error_code);
+    send_frame(conn, H2_GOAWAY, 0, 0, payload, sizeof(payload));
+    conn->goaway = 1;
+}
+
+static void send_rst_stream(h2_conn_t *conn, uint32_t stream_id, uint32_t error_code)
+{
+    uint8_t payload[4];
+    put_u32(payload, error_code);
+    send_frame(conn, H2_RST_STREAM, 0, stream_id, payload, sizeof(payload));
+}
+
+static int send_window_update(h2_conn_t *conn, uint32_t stream_id, uint32_t increment)
+{
+    uint8_t payload[4];
+    put_u32(payload, increment);
+    return send_frame(conn, H2_WINDOW_UPDATE, 0, stream_id, payload, sizeof(payload));
+}
+
+static h2_stream_t *find_stream(h2_conn_t *conn, uint32_t id)
+{
+    for (int i = 0; i < H2_MAX_STREAMS; i++)
+    {
+        if (conn->streams[i].active && conn->streams[i].id == id)
+        {
+            return &conn->streams[i];
+        }
+    }
+    return NULL;
+}
+
+static h2_stream_t *alloc_stream(h2_conn_t *conn, uint32_t id)
+{
+    for (int i = 0; i < H2_MAX_STREAMS; i++)
+    {
+        h2_stream_t *stream = &conn->streams[i];
+        if (!stream->active)
+        {
+            memset(stream, 0, sizeof(*stream));
+            stream->id = id;
+            stream->active = 1;
+            stream->weight = H2_DEFAULT_WEIGHT;
+            stream->window = conn->peer_initial_window;
+            stream->res.fd = -1;
+            return stream;
+        }
+    }
+    return NULL;
+}
+
+static void finish_stream(h2_conn_t *conn, h2_stream_t *stream, int aborted)
+{
+    client_t *client = conn->client;
+
+    trace_mark(&stream->trace, TRACE_LAST_BYTE);
+    if (aborted)
+    {
+        increment_aborted();
+    }
+    else if (stream->status == 200 || stream->status == 206)
+    {
+        increment_successful();
+        add_turnaround_time((stream->trace.ts_ns[TRACE_LAST_BYTE] - stream->trace.ts_ns[TRACE_DEQUEUE]) / 1000ULL);
+    }
+    trace_finish(&stream->trace, client->fd, stream->path);
+
+    if (is_access_log_enabled())
+    {
+        client_t view = *client;
+        view.trace = stream->trace;
+        access_log_request(&view, stream->path, stream->status, stream->bytes,
+                           stream->status == 206 ? stream->res.start : -1,
+                           stream->status == 206 ? stream->res.end : -1);
+    }
+
+    http_close_resource(&stream->res);
+    stream->active = 0;
+}
+
+static int send_response_headers(h2_conn_t *conn, h2_stream_t *stream)
+{
+    uint8_t *block = conn->out + H2_FRAME_HEADER;
+    size_t cap = sizeof(conn->out) - H2_FRAME_HEADER;
+    size_t n = hpack_encode_status(block, cap, stream->status);
+    char value[96];
+
+    if (stream->status == 200 || stream->status == 206)
+    {
+        n += hpack_encode_header(block + n, cap - n, HPACK_IDX_CONTENT_TYPE, stream->res.mime);
+        snprintf(value, sizeof(value), "%ld", stream->res.content_length);
+        n += hpack_encode_header(block + n, cap - n, HPACK_IDX_CONTENT_LENGTH, value);
+        n += hpack_encode_header(block + n, cap - n, HPACK_IDX_ACCEPT_RANGES, "bytes");
+        if (stream->status == 206)
+        {
+            snprintf(value, sizeof(value), "bytes %ld-%ld/%ld", stream->res.start, stream->res.end,
+                     stream->res.file_size);
+            n += hpack_encode_header(block + n, cap - n, HPACK_IDX_CONTENT_RANGE, value);
+        }
+    }
+    else
+    {
+        n += hpack_encode_header(block + n, cap - n, HPACK_IDX_CONTENT_LENGTH, "0");
+    }
+
+    uint8_t flags = H2_FLAG_END_HEADERS;
+    if (stream->remaining == 0)
+    {
+        flags |= H2_FLAG_END_STREAM;
+    }
+    put_frame_header(conn->out, (uint32_t)n, H2_HEADERS, flags, stream->id);
+    if (io_send_all(conn->client, conn->out, H2_FRAME_HEADER + n) != 0)
+    {
+        return -1;
+    }
+
+    trace_mark(&stream->trace, TRACE_FIRST_BYTE);
+    add_response_time((stream->trace.ts_ns[TRACE_FIRST_BYTE] - stream->trace.ts_ns[TRACE_DEQUEUE]) / 1000ULL);
+    return 0;
+}
+
+/* Resolves the request through the same file-serving path as HTTP/1 and queues the body. */
+static int start_stream(h2_conn_t *conn, h2_stream_t *stream, const h2_request_t *req, int counted)
+{
+    if (!counted)
+    {
+        increment_requests();
+    }
+    if (is_capture_enabled())
+    {
+        capture_request(conn->client, req->method, req->path, req->range[0] ? req->range : NULL);
+    }
+
+    snprintf(stream->path, sizeof(stream->path), "%s", req->path);
+    char *query = strchr(stream->path, '?');
+    if (query)
+    {
+        *query = '\0';
+    }
+    stream->head_only = strcmp(req->method, "HEAD") == 0;
+
+    if (http_normalize_path(stream->path, sizeof(stream->path)) != 0)
+    {
+        stream->status = 404;
+    }
+    else
+    {
+        const char *range_spec = NULL;
+        if (strncmp(req->range, "bytes=", 6) == 0)
+        {
+            range_spec = req->range + 6;
+        }
+        stream->status = http_open_resource(stream->path, range_spec, 0, &stream->res);
+    }
+    trace_mark(&stream->trace, TRACE_FILE_OPEN);
+
+    if (stream->status == 200 || stream->status == 206)
+    {
+        stream->offset = stream->res.start;
+        stream->remaining = stream->head_only ? 0 : stream->res.content_length;
+    }
+    else
+    {
+        if (stream->status == 404)
+        {
+            increment_failed();
+        }
+        stream->remaining = 0;
+    }
+
+    if (send_response_headers(conn, stream) != 0)
+    {
+        return -1;
+    }
+    if (stream->remaining == 0)
+    {
+        finish_stream(conn, stream, 0);
+    }
+    return 0;
+}
+
+static int collect_header(void *ctx, const char *name, size_t name_len, const char *value, size_t value_len)
+{
+    h2_request_t *req = ctx;
+    char *dst = NULL;
+    size_t cap = 0;
+
+    if (name_len == 7 && memcmp(name, ":method", 7) == 0)
+    {
+        dst = req->method;
+        cap = sizeof(req->method);
+    }
+    else if (name_len == 5 && memcmp(name, ":path", 5) == 0)
+    {
+        dst = req->path;
+        cap = sizeof(req->path);
+    }
+    else if (name_len == 5 && memcmp(name, "range", 5) == 0)
+    {
+        dst = req->range;
+        cap = sizeof(req->range);
+    }
+
+    if (dst)
+    {
+        if (value_len >= cap)
+        {
+            req->too_long = 1;
+            value_len = cap - 1;
+        }
+        memcpy(dst, value, value_len);
+        dst[value_len] = '\0';
+    }
+    return 0;
+}
+
+static int complete_header_block(h2_conn_t *conn)
+{
+    h2_request_t req;
+    memset(&req, 0, sizeof(req));
+
+    if (hpack_decode(&conn->decoder, conn->header_block, conn->header_len, collect_header, &req) != 0)
+    {
+        send_goaway(conn, H2_COMPRESSION_ERROR);
+        return -1;
+    }
+
+    uint32_t id = conn->header_stream;
+    conn->header_len = 0;
+    conn->header_stream = 0;
+
+    h2_stream_t *stream = alloc_stream(conn, id);
+    if (!stream)
+    {
+        send_rst_stream(conn, id, H2_REFUSED_STREAM);
+        return 0;
+    }
+    stream->weight = conn->header_weight;
+
+    if (conn->first_stream_pending)
+    {
+        stream->trace = conn->client->trace;
+        conn->first_stream_pending = 0;
+    }
+    else
+    {
+        trace_mark(&stream->trace, TRACE_DEQUEUE);
+    }
+    trace_mark(&stream->trace, TRACE_PARSE_DONE);
+
+    if (req.too_long || req.path[0] == '\0')
+    {
+        snprintf(req.path, sizeof(req.path), "/..");
+    }
+    return start_stream(conn, stream, &req, 0);
+}
+
+static int apply_settings(h2_conn_t *conn, const uint8_t *payload, size_t len)
+{
+    for (size_t i = 0; i + 6 <= len; i += 6)
+    {
+        uint16_t id = (uint16_t)((payload[i] << 8) | payload[i + 1]);
+        uint32_t value = get_u32(payload + i + 2);
+
+        if (id == H2_SETTINGS_INITIAL_WINDOW_SIZE)
+        {
+            if (value > H2_MAX_WINDOW)
+            {
+                send_goaway(conn, H2_FLOW_CONTROL_ERROR);
+                return -1;
+            }
+            /* The delta applies to open streams too, and must not push any past 2^31-1 (RFC 9113 6.9.2). */
+            int64_t delta = (int64_t)value - conn->peer_initial_window;
+            for (int s = 0; s < H2_MAX_STREAMS; s++)
+            {
+                int64_t window = conn->streams[s].window + delta;
+                if (conn->streams[s].active && (window > H2_MAX_WINDOW || window < -H2_MAX_WINDOW))
+                {
+                    send_goaway(conn, H2_FLOW_CONTROL_ERROR);
+                    return -1;
+                }
+            }
+            conn->peer_initial_window = (int32_t)value;
+            for (int s = 0; s < H2_MAX_STREAMS; s++)
+            {
+                if (conn->streams[s].active)
+                {
+                    conn->streams[s].window += (int32_t)delta;
+                }
+            }
+        }
+        else if (id == H2_SETTINGS_MAX_FRAME_SIZE)
+        {
+            if (value < H2_DEFAULT_FRAME_SIZE || value > H2_MAX_FRAME_SIZE)
+            {
+                send_goaway(conn, H2_PROTOCOL_ERROR);
+                return -1;
+            }
+            conn->peer_max_frame = value;
+        }
+    }
+    return 0;
+}
+
+static int handle_frame(h2_conn_t *conn, uint8_t type, uint8_t flags, uint32_t stream_id,
+                        const uint8_t *payload, size_t len)
+{
+    if (conn->header_stream != 0 && type != H2_CONTINUATION)
+    {
+        send_goaway(conn, H2_PROTOCOL_ERROR);
+        return -1;
+    }
+
+    switch (type)
+    {
+    case H2_SETTINGS:
+        if (stream_id != 0 || len % 6 != 0)
+        {
+            send_goaway(conn, H2_FRAME_SIZE_ERROR);
+            return -1;
+        }
+        if (flags & H2_FLAG_ACK)
+        {
+            return 0;
+        }
+        if (apply_settings(conn, payload, len) != 0)
+        {
+            return -1;
+        }
+        return send_frame(conn, H2_SETTINGS, H2_FLAG_ACK, 0, NULL, 0);
+
+    case H2_PING:
+        if (len != 8)
+        {
+            send_goaway(conn, H2_FRAME_SIZE_ERROR);
+            return -1;
+        }
+        if (flags & H2_FLAG_ACK)
+        {
+            return 0;
+        }
+        return send_frame(conn, H2_PING, H2_FLAG_ACK, 0, payload, len);
+
+    case H2_WINDOW_UPDATE:
+    {
+        if (len != 4)
+        {
+            send_goaway(conn, H2_FRAME_SIZE_ERROR);
+            return -1;
+        }
+        int32_t increment = (int32_t)(get_u32(payload) & 0x7fffffff);
+        if (stream_id == 0)
+        {
+            if (increment == 0)
+            {
+                send_goaway(conn, H2_PROTOCOL_ERROR);
+                return -1;
+            }
+            if ((int64_t)conn->conn_window + increment > H2_MAX_WINDOW)
+            {
+                send_goaway(conn, H2_FLOW_CONTROL_ERROR);
+                return -1;
+            }
+            conn->conn_window += increment;
+            return 0;
+        }
+
+        /* Zero increments and overflows on a stream are stream errors (RFC 9113 6.9). */
+        h2_stream_t *stream = find_stream(conn, stream_id);
+        if (increment == 0 || (stream && (int64_t)stream->window + increment > H2_MAX_WINDOW))
+        {
+            send_rst_stream(conn, stream_id, increment == 0 ? H2_PROTOCOL_ERROR : H2_FLOW_CONTROL_ERROR);
+            if (stream)
+            {
+                finish_stream(conn, stream, 1);
+            }
+            return 0;
+        }
+        if (stream)
+        {
+            stream->window += increment;
+        }
+        return 0;
+    }
+
+    case H2_PRIORITY:
+    {
+        h2_stream_t *stream = find_stream(conn, stream_id);
+        if (len == 5 && stream)
+        {
+            stream->weight = payload[4] + 1;
+        }
+        return 0;
+    }
+
+    case H2_RST_STREAM:
+    {
+        h2_stream_t *stream = find_stream(conn, stream_id);
+        if (stream)
+        {
+            finish_stream(conn, stream, 1);
+        }
+        return 0;
+    }
+
+    case H2_GOAWAY:
+        conn->goaway = 1;
+        return 0;
+
+    case H2_DATA:
+        /* Request bodies are not used; just give the flow-control credit back. */
+        if (len > 0)
+        {
+            if (send_window_update(conn, 0, (uint32_t)len) != 0)
+            {
+                return -1;
+            }
+            if (!(flags & H2_FLAG_END_STREAM) && send_window_update(conn, stream_id, (uint32_t)len) != 0)
+            {
+                return -1;
+            }
+        }
+        return 0;
+
+    case H2_HEADERS:
+    {
+        if (stream_id == 0 || (stream_id & 1) == 0 || stream_id <= conn->last_stream_id)
+        {
+            send_goaway(conn, H2_PROTOCOL_ERROR);
+            return -1;
+        }
+        conn->last_stream_id = stream_id;
+
+        size_t pad = 0;
+        if (flags & H2_FLAG_PADDED)
+        {
+            if (len < 1)
+            {
+                send_goaway(conn, H2_PROTOCOL_ERROR);
+                return -1;
+            }
+            pad = payload[0];
+            payload++;
+            len--;
+        }
+        conn->header_weight = H2_DEFAULT_WEIGHT;
+        if (flags & H2_FLAG_PRIORITY)
+        {
+            if (len < 5)
+            {
+                send_goaway(conn, H2_PROTOCOL_ERROR);
+                return -1;
+            }
+            conn->header_weight = payload[4] + 1;
+            payload += 5;
+            len -= 5;
+        }
+        if (pad > len)
+        {
+            send_goaway(conn, H2_PROTOCOL_ERROR);
+            return -1;
+        }
+        len -= pad;
+
+        if (len > sizeof(conn->header_block))
+        {
+            send_goaway(conn, H2_ENHANCE_YOUR_CALM);
+            return -1;
+        }
+        memcpy(conn->header_block, payload, len);
+        conn->header_len = len;
+        conn->header_stream = stream_id;
+        conn->header_end_stream = (flags & H2_FLAG_END_STREAM) != 0;
+
+        if (flags & H2_FLAG_END_HEADERS)
+        {
+            return complete_header_block(conn);
+        }
+        return 0;
+    }
+
+    case H2_CONTINUATION:
+        if (conn->header_stream == 0 || stream_id != conn->header_stream)
+        {
+            send_goaway(conn, H2_PROTOCOL_ERROR);
+            return -1;
+        }
+        if (conn->header_len + len > sizeof(conn->header_block))
+        {
+            send_goaway(conn, H2_ENHANCE_YOUR_CALM);
+            return -1;
+        }
+        memcpy(conn->header_block + conn->header_len, payload, len);
+        conn->header_len += len;
+        if (flags & H2_FLAG_END_HEADERS)
+        {
+            return complete_header_block(conn);
+        }
+        return 0;
+
+    default:
+        return 0;
+    }
+}
+
+static int process_input(h2_conn_t *conn)
+{
+    size_t pos = 0;
+
+    if (conn->preface_pending)
+    {
+        if (conn->in_len < H2_PREFACE_LEN)
+        {
+            return 0;
+        }
+        if (!http2_is_preface((const char *)conn->in, conn->in_len))
+        {
+            send_goaway(conn, H2_PROTOCOL_ERROR);
+            return -1;
+        }
+        conn->preface_pending = 0;
+        pos = H2_PREFACE_LEN;
+    }
+
+    while (conn->in_len - pos >= H2_FRAME_HEADER)
+    {
+        const uint8_t *h = conn->in + pos;
+        uint32_t len = ((uint32_t)h[0] << 16) | ((uint32_t)h[1] << 8) | h[2];
+        if (len > H2_DEFAULT_FRAME_SIZE)
+        {
+            send_goaway(conn, H2_FRAME_SIZE_ERROR);
+            return -1;
+        }
+        if (conn->in_len - pos < H2_FRAME_HEADER + len)
+        {
+            break;
+        }
+        if (handle_frame(conn, h[3], h[4], get_u32(h + 5) & 0x7fffffff, h + H2_FRAME_HEADER, len) != 0)
+        {
+            return -1;
+        }
+        pos += H2_FRAME_HEADER + len;
+    }
+
+    memmove(conn->in, conn->in + pos, conn->in_len - pos);
+    conn->in_len -= pos;
+    return 0;
+}
+
+static int read_input(h2_conn_t *conn)
+{
+    ssize_t n = io_read(conn->client, conn->in + conn->in_len, sizeof(conn->in) - conn->in_len);
+    if (n <= 0)
+    {
+        return -1;
+    }
+    conn->in_len += (size_t)n;
+    return process_input(conn);
+}
+
+static int stream_sendable(const h2_conn_t *conn, const h2_stream_t *stream)
+{
+    return stream->active && stream->remaining > 0 && stream->window > 0 && conn->conn_window > 0;
+}
+
+static int has_sendable(const h2_conn_t *conn)
+{
+    for (int i = 0; i < H2_MAX_STREAMS; i++)
+    {
+        if (stream_sendable(conn, &conn->streams[i]))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int has_active(const h2_conn_t *conn)
+{
+    for (int i = 0; i < H2_MAX_STREAMS; i++)
+    {
+        if (conn->streams[i].active)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* One weighted round-robin pass: a stream sends weight/16 frames (at least one) per round,
+ * bounded by the connection and stream flow-control windows. */
+static int send_round(h2_conn_t *conn)
+{
+    size_t frame_cap = sizeof(conn->out) - H2_FRAME_HEADER;
+    if (conn->peer_max_frame < frame_cap)
+    {
+        frame_cap = conn->peer_max_frame;
+    }
+
+    for (int n = 0; n < H2_MAX_STREAMS; n++)
+    {
+        h2_stream_t *stream = &conn->streams[(conn->next_slot + n) % H2_MAX_STREAMS];
+        int frames = stream->weight / H2_DEFAULT_WEIGHT;
+        if (frames < 1)
+        {
+            frames = 1;
+        }
+
+        while (frames-- > 0 && stream_sendable(conn, stream))
+        {
+            size_t len = frame_cap;
+            if ((long)len > stream->remaining)
+                len = (size_t)stream->remaining;
+            if ((int32_t)len > stream->window)
+                len = (size_t)stream->window;
+            if ((int32_t)len > conn->conn_window)
+                len = (size_t)conn->conn_window;
+
+            ssize_t got = http_read_resource(&stream->res, conn->out + H2_FRAME_HEADER, len, stream->offset);
+            if (got <= 0)
+            {
+                send_rst_stream(conn, stream->id, H2_PROTOCOL_ERROR);
+                increment_failed();
+                finish_stream(conn, stream, 0);
+                break;
+            }
+
+            stream->offset += got;
+            stream->remaining -= got;
+            stream->window -= (int32_t)got;
+            conn->conn_window -= (int32_t)got;
+
+            uint8_t flags = stream->remaining == 0 ? H2_FLAG_END_STREAM : 0;
+            put_frame_header(conn->out, (uint32_t)got, H2_DATA, flags, stream->id);
+            if (io_send_all(conn->client, conn->out, H2_FRAME_HEADER + (size_t)got) != 0)
+            {
+                finish_stream(conn, stream, 1);
+                return -1;
+            }
+            add_bytes_sent((unsigned long)got);
+            stream->bytes += (unsigned long long)got;
+
+            if (stream->remaining == 0)
+            {
+                finish_stream(conn, stream, 0);
+            }
+        }
+    }
+    conn->next_slot = (conn->next_slot + 1) % H2_MAX_STREAMS;
+    return 0;
+}
+
+static h2_conn_t *conn_new(client_t *client)
+{
+    h2_conn_t *conn = calloc(1, sizeof(*conn));
+    if (!conn)
+    {
+        return NULL;
+    }
+    conn->client = client;
+    hpack_table_init(&conn->decoder);
+    conn->conn_window = H2_DEFAULT_WINDOW;
+    conn->peer_initial_window = H2_DEFAULT_WINDOW;
+    conn->peer_max_frame = H2_DEFAULT_FRAME_SIZE;
+    conn->preface_pending = 1;
+    conn->first_stream_pending = 1;
+    return conn;
+}
+
+static void conn_run(h2_conn_t *conn)
+{
+    while (1)
+    {
+        if (has_sendable(conn))
+        {
+            while (io_readable(conn->client, 0))
+            {
+                if (read_input(conn) != 0)
+                {
+                    return;
+                }
+            }
+            if (send_round(conn) != 0)
+            {
+                return;
+            }
+            continue;
+        }
+
+        if (conn->goaway && !has_active(conn))
+        {
+            return;
+        }
+        if (!io_readable(conn->client, H2_IDLE_TIMEOUT_MS))
+        {
+            send_goaway(conn, H2_NO_ERROR);
+            return;
+        }
+        if (read_input(conn) != 0)
+        {
+            return;
+        }
+    }
+}
+
+static void conn_free(h2_conn_t *conn)
+{
+    for (int i = 0; i < H2_MAX_STREAMS; i++)
+    {
+        if (conn->streams[i].active)
+        {
+            finish_stream(conn, &conn->streams[i], 1);
+        }
+    }
+    free(conn);
+}
+
+void http2_serve(client_t *client, const char *initial, size_t initial_len)
+{
+    h2_conn_t *conn = conn_new(client);
+    if (!conn)
+    {
+        return;
+    }
+
+    if (initial_len > sizeof(conn->in))
+    {
+        initial_len = sizeof(conn->in);
+    }
+    memcpy(conn->in, initial, initial_len);
+    conn->in_len = initial_len;
+
+    if (send_settings(conn) == 0 && process_input(conn) == 0)
+    {
+        conn_run(conn);
+    }
+    conn_free(conn);
+}
+
+static int base64url_value(char c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '-' || c == '+')
+        return 62;
+    if (c == '_' || c == '/')
+        return 63;
+    return -1;
+}
+
+static size_t base64url_decode(const char *src, uint8_t *dst, size_t cap)
+{
+    uint32_t acc = 0;
+    int bits = 0;
+    size_t n = 0;
+    for (; *src; src++)
+    {
+        int v = base64url_value(*src);
+        if (v < 0)
+        {
+            break;
+        }
+        acc = (acc << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            if (n < cap)
+            {
+                dst[n++] = (uint8_t)(acc >> bits);
+            }
+        }
+    }
+    return n;
+}
+
+void http2_upgrade(client_t *client, const http_request_t *request, const char *file_path,
+                   const char *leftover, size_t leftover_len)
+{
+    static const char *switching =
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Connection: Upgrade\r\n"
+        "Upgrade: h2c\r\n"
+        "\r\n";
+
+    h2_conn_t *conn = conn_new(client);
+    if (!conn)
+    {
+        return;
+    }
+
+    const char *settings = http_request_header(request, "HTTP2-Settings");
+    if (settings)
+    {
+        uint8_t payload[64];
+        size_t len = base64url_decode(settings, payload, sizeof(payload));
+        apply_settings(conn, payload, len - len % 6);
+    }
+
+    if (io_send_all(client, switching, strlen(switching)) != 0 || send_settings(conn) != 0)
+    {
+        conn_free(conn);
+        return;
+    }
+
+    /* The upgraded request becomes stream 1, already half-closed by the client. */
+    h2_request_t req;
+    memset(&req, 0, sizeof(req));
+    snprintf(req.method, sizeof(req.method), "%s", strcmp(request->method, "HEAD") == 0 ? "HEAD" : "GET");
+    snprintf(req.path, sizeof(req.path), "%s", file_path);
+    const char *range = http_request_header(request, "Range");
+    if (range)
+    {
+        snprintf(req.range, sizeof(req.range), "%s", range);
+    }
+
+    conn->last_stream_id = 1;
+    conn->first_stream_pending = 0;
+
+    /* The client may have pipelined its preface right behind the upgrade request. */
+    if (leftover_len > sizeof(conn->in))
+    {
+        leftover_len = sizeof(conn->in);
+    }
+    memcpy(conn->in, leftover, leftover_len);
+    conn->in_len = leftover_len;
+    if (leftover_len > 0 && process_input(conn) != 0)
+    {
+        conn_free(conn);
+        return;
+    }
+
+    /* Wait for the client preface so the response is not mixed into the 101 read. */
+    while (conn->preface_pending)
+    {
+        if (!io_readable(client, H2_IDLE_TIMEOUT_MS) || read_input(conn) != 0)
+        {
+            conn_free(conn);
+            return;
+        }
+    }
+
+    h2_stream_t *stream = alloc_stream(conn, 1);
+    if (stream)
+    {
+        stream->trace = client->trace;
+        if (start_stream(conn, stream, &req, 1) == 0)
+        {
+            conn_run(conn);
+        }
+    }
+    conn_free(conn);
+}
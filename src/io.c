@@ -0,0 +1,271 @@
+#define _GNU_SOURCE
+#include "io.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include "coro.h"
+#include "tls.h"
+#include "trace.h"
+
+static __thread unsigned long t_syscalls[SYSCALL_KIND_COUNT];
+static __thread io_context_t t_io;
+
+/* Inside a coroutine the deadline and buffer follow the connection, not the thread. */
+static io_context_t *io_context(void)
+{
+    io_context_t *ctx = coro_io_context();
+    return ctx ? ctx : &t_io;
+}
+
+void io_count_syscalls(syscall_kind_t kind, unsigned long count)
+{
+    t_syscalls[kind] += count;
+}
+
+void io_flush_syscall_stats(void)
+{
+    add_syscalls(t_syscalls);
+    memset(t_syscalls, 0, sizeof(t_syscalls));
+}
+
+/* Absolute bound on every wait of this worker until cleared with 0; used for request heads.
+ * Returns the previous deadline so nested users can put it back. */
+uint64_t io_set_deadline(uint64_t deadline_ns)
+{
+    io_context_t *ctx = io_context();
+    uint64_t previous = ctx->deadline_ns;
+    ctx->deadline_ns = deadline_ns;
+    return previous;
+}
+
+/* Client sockets are nonblocking; this is the single place a worker parks until one is ready. */
+int io_wait(client_t *client, short events, int timeout_ms)
+{
+    uint64_t deadline_ns = io_context()->deadline_ns;
+    if (deadline_ns)
+    {
+        uint64_t now_ns = trace_now_ns();
+        if (now_ns >= deadline_ns)
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        int left_ms = (int)((deadline_ns - now_ns + 999999) / 1000000);
+        if (timeout_ms < 0 || left_ms < timeout_ms)
+        {
+            timeout_ms = left_ms;
+        }
+    }
+
+    if (coro_io_context())
+    {
+        t_syscalls[SYSCALL_WAIT]++;
+        return coro_wait_fd(client->fd, events,
+                            timeout_ms < 0 ? 0 : trace_now_ns() + (uint64_t)timeout_ms * 1000000ULL);
+    }
+
+    struct pollfd pfd = {.fd = client->fd, .events = events};
+    int ready;
+    do
+    {
+        t_syscalls[SYSCALL_WAIT]++;
+        ready = poll(&pfd, 1, timeout_ms);
+    } while (ready < 0 && errno == EINTR);
+
+    if (ready == 0)
+    {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return ready < 0 ? -1 : 0;
+}
+
+ssize_t io_read(client_t *client, void *buf, size_t len)
+{
+    t_syscalls[SYSCALL_READ]++;
+    if (client->tls)
+    {
+        return tls_read(client, buf, len);
+    }
+    while (1)
+    {
+        ssize_t n = read(client->fd, buf, len);
+        if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+            return n;
+        }
+        if (errno != EINTR && io_wait(client, POLLIN, IO_WAIT_TIMEOUT_MS) != 0)
+        {
+            return -1;
+        }
+        t_syscalls[SYSCALL_READ]++;
+    }
+}
+
+static int send_all_flags(client_t *client, const void *buf, size_t len, int flags)
+{
+    const char *p = (const char *)buf;
+    while (len > 0)
+    {
+        t_syscalls[SYSCALL_WRITE]++;
+        ssize_t n = client->tls ? tls_write(client, p, len)
+                                : send(client->fd, p, len, MSG_NOSIGNAL | flags);
+        if (n < 0 && !client->tls && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            if (io_wait(client, POLLOUT, IO_WAIT_TIMEOUT_MS) != 0)
+                return -1;
+            continue;
+        }
+        if (n <= 0)
+            return -1;
+        p += (size_t)n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int io_send_all(client_t *client, const void *buf, size_t len)
+{
+    return send_all_flags(client, buf, len, 0);
+}
+
+/* Headers that will be followed by sendfile(): MSG_MORE keeps them in the same segment. */
+int io_send_more(client_t *client, const void *buf, size_t len)
+{
+    return send_all_flags(client, buf, len, MSG_MORE);
+}
+
+/* Header + small body in one call. Plain sockets use sendmsg() (writev with MSG_NOSIGNAL);
+ * TLS coalesces into a single record instead of one per buffer. */
+int io_send_pair(client_t *client, const void *head, size_t head_len, const void *body, size_t body_len)
+{
+    if (client->tls)
+    {
+        char record[IO_COALESCE_MAX];
+        if (head_len + body_len > sizeof(record))
+        {
+            return io_send_all(client, head, head_len) == 0 ? io_send_all(client, body, body_len) : -1;
+        }
+        memcpy(record, head, head_len);
+        memcpy(record + head_len, body, body_len);
+        return io_send_all(client, record, head_len + body_len);
+    }
+
+    struct iovec iov[2] = {
+        {.iov_base = (void *)head, .iov_len = head_len},
+        {.iov_base = (void *)body, .iov_len = body_len},
+    };
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = body_len > 0 ? 2 : 1};
+
+    while (msg.msg_iovlen > 0)
+    {
+        t_syscalls[SYSCALL_WRITE]++;
+        ssize_t n = sendmsg(client->fd, &msg, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && io_wait(client, POLLOUT, IO_WAIT_TIMEOUT_MS) == 0)
+                continue;
+            return -1;
+        }
+
+        size_t done = (size_t)n;
+        while (msg.msg_iovlen > 0 && done >= msg.msg_iov->iov_len)
+        {
+            done -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0)
+        {
+            msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + done;
+            msg.msg_iov->iov_len -= done;
+        }
+    }
+    return 0;
+}
+
+int io_readable(client_t *client, int timeout_ms)
+{
+    if (client->tls && tls_pending(client))
+    {
+        return 1;
+    }
+    return io_wait(client, POLLIN, timeout_ms) == 0;
+}
+
+ssize_t io_pread(int fd, void *buf, size_t len, off_t offset)
+{
+    t_syscalls[SYSCALL_FILE]++;
+    if (!coro_io_context())
+    {
+        return pread(fd, buf, len, offset);
+    }
+
+    /* Page-cache hits stay inline; only the part that would block goes to a helper thread. */
+    struct iovec iov = {.iov_base = buf, .iov_len = len};
+    ssize_t n = preadv2(fd, &iov, 1, offset, RWF_NOWAIT);
+    if (n == (ssize_t)len || n == 0 || (n < 0 && errno != EAGAIN && errno != EOPNOTSUPP))
+    {
+        return n;
+    }
+    size_t done = n > 0 ? (size_t)n : 0;
+    t_syscalls[SYSCALL_FILE]++;
+    ssize_t rest = coro_pread(fd, (char *)buf + done, len - done, offset + (off_t)done);
+    if (rest < 0)
+    {
+        return done > 0 ? (ssize_t)done : -1;
+    }
+    return (ssize_t)(done + (size_t)rest);
+}
+
+/* Zero-copy body transfer: sendfile(2) on plain sockets, kTLS-backed SSL_sendfile under TLS. */
+ssize_t io_sendfile(client_t *client, int file_fd, off_t offset, size_t len)
+{
+    t_syscalls[SYSCALL_WRITE]++;
+    if (client->tls)
+    {
+        if (client->ktls_send)
+        {
+            return tls_sendfile(client, file_fd, offset, len);
+        }
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    while (1)
+    {
+        ssize_t n = sendfile(client->fd, file_fd, &offset, len);
+        if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            return n;
+        }
+        if (io_wait(client, POLLOUT, IO_WAIT_TIMEOUT_MS) != 0)
+        {
+            return -1;
+        }
+        t_syscalls[SYSCALL_WRITE]++;
+    }
+}
+
+/* O_DIRECT reads need an aligned destination; each worker (or coroutine slot) keeps one for its lifetime. */
+void *io_direct_buffer(void)
+{
+    io_context_t *ctx = io_context();
+    if (!ctx->direct_buffer && posix_memalign(&ctx->direct_buffer, IO_DIRECT_ALIGN, IO_DIRECT_BUFFER_SIZE) != 0)
+    {
+        ctx->direct_buffer = NULL;
+    }
+    return ctx->direct_buffer;
+}
+
+/* Drop-behind for read-once media, so it does not push small hot files out of the page cache. */
+void io_drop_cache(int file_fd, off_t offset, off_t len)
+{
+    t_syscalls[SYSCALL_FILE]++;
+    posix_fadvise(file_fd, offset, len, POSIX_FADV_DONTNEED);
+}
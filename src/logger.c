@@ -1,16 +1,21 @@
+#define _GNU_SOURCE
 #include "logger.h"
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/time.h>
 #include <time.h>
+#include <unistd.h>
 
 static int g_worker_count = 0;
 static char (*current_states)[32] = NULL;
 static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
 static FILE *log_output = NULL;
 static int logging_enabled = 0;
+static int console_muted = 0;
 
 void init_logger(int worker_count, const char *logfile)
 {
@@ -69,7 +74,13 @@ void init_logger(int worker_count, const char *logfile)
 
 int is_logging_enabled(void)
 {
-    return logging_enabled;
+    return logging_enabled || console_muted;
+}
+
+/* Another component owns the terminal (the dashboard); silence the per-request prints. */
+void mute_console(void)
+{
+    console_muted = 1;
 }
 
 void log_event(int entity_id, int client_fd, const char *state, const char *comment)
@@ -131,3 +142,248 @@ void log_event(int entity_id, int client_fd, const char *state, const char *comm
     fflush(log_output);
     pthread_mutex_unlock(&log_mutex);
 }
+
+/* Request-path messages go through a bounded lock-free ring (Vyukov MPMC, one consumer at a
+ * time) drained by a writer thread with write(2): producers never block on a terminal or pipe
+ * and never touch stdio. A full ring drops the line and counts it. */
+typedef struct
+{
+    atomic_size_t seq;
+    int fd;
+    size_t len;
+    char text[LOG_LINE_MAX];
+} log_slot_t;
+
+static log_slot_t g_ring[LOG_RING_SIZE];
+static atomic_size_t g_ring_head;
+static size_t g_ring_tail;
+static atomic_ulong g_ring_dropped;
+static pthread_mutex_t g_drain_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int g_writer_started = 0;
+static int g_runtime_level = LOG_LEVEL_WARN;
+
+static const char *level_names[] = {"error", "warn", "info", "debug"};
+
+static void write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0)
+        {
+            return;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+void log_write(int fd, const char *line, size_t len)
+{
+    if (!g_writer_started)
+    {
+        write_all(fd, line, len);
+        return;
+    }
+
+    size_t pos = atomic_load_explicit(&g_ring_head, memory_order_relaxed);
+    log_slot_t *slot;
+    while (1)
+    {
+        slot = &g_ring[pos % LOG_RING_SIZE];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&g_ring_head, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            atomic_fetch_add_explicit(&g_ring_dropped, 1, memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&g_ring_head, memory_order_relaxed);
+        }
+    }
+
+    slot->fd = fd;
+    slot->len = len < LOG_LINE_MAX ? len : LOG_LINE_MAX;
+    memcpy(slot->text, line, slot->len);
+    if (len > LOG_LINE_MAX)
+    {
+        slot->text[LOG_LINE_MAX - 1] = '\n';
+    }
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+}
+
+static int drain_ring(void)
+{
+    int drained = 0;
+    pthread_mutex_lock(&g_drain_mutex);
+    while (1)
+    {
+        log_slot_t *slot = &g_ring[g_ring_tail % LOG_RING_SIZE];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != g_ring_tail + 1)
+        {
+            break;
+        }
+        write_all(slot->fd, slot->text, slot->len);
+        atomic_store_explicit(&slot->seq, g_ring_tail + LOG_RING_SIZE, memory_order_release);
+        g_ring_tail++;
+        drained++;
+    }
+
+    unsigned long dropped = atomic_exchange_explicit(&g_ring_dropped, 0, memory_order_relaxed);
+    if (dropped > 0)
+    {
+        char line[64];
+        int len = snprintf(line, sizeof(line), "[log] %lu líneas descartadas\n", dropped);
+        write_all(STDERR_FILENO, line, (size_t)len);
+    }
+    pthread_mutex_unlock(&g_drain_mutex);
+    return drained;
+}
+
+static void *log_writer_main(void *arg)
+{
+    (void)arg;
+    while (1)
+    {
+        if (drain_ring() == 0)
+        {
+            usleep(20000);
+        }
+    }
+    return NULL;
+}
+
+void init_log_writer(int runtime_level)
+{
+    g_runtime_level = runtime_level;
+    for (size_t i = 0; i < LOG_RING_SIZE; i++)
+    {
+        atomic_init(&g_ring[i].seq, i);
+    }
+    atomic_init(&g_ring_head, 0);
+    g_ring_tail = 0;
+
+    pthread_t writer;
+    if (pthread_create(&writer, NULL, log_writer_main, NULL) != 0)
+    {
+        perror("pthread_create log writer");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(writer);
+    g_writer_started = 1;
+}
+
+int parse_log_level(const char *name)
+{
+    for (int i = LOG_LEVEL_ERROR; i <= LOG_LEVEL_DEBUG; i++)
+    {
+        if (strcasecmp(name, level_names[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void log_flush(void)
+{
+    drain_ring();
+}
+
+static int rate_limited(log_site_t *site, unsigned long *suppressed)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    unsigned long now = (unsigned long)ts.tv_sec;
+
+    *suppressed = 0;
+    if (atomic_exchange_explicit(&site->window, now, memory_order_relaxed) != now)
+    {
+        atomic_store_explicit(&site->count, 0, memory_order_relaxed);
+        *suppressed = atomic_exchange_explicit(&site->suppressed, 0, memory_order_relaxed);
+    }
+    if (atomic_fetch_add_explicit(&site->count, 1, memory_order_relaxed) >= LOG_RATE_PER_SITE)
+    {
+        atomic_fetch_add_explicit(&site->suppressed, 1, memory_order_relaxed);
+        return 1;
+    }
+    return 0;
+}
+
+/* Appends to a line of `cap` bytes, truncating; the byte at line[cap] stays free for '\n'. */
+static void append_va(char *line, size_t cap, size_t *len, const char *fmt, va_list args)
+{
+    if (*len >= cap)
+    {
+        return;
+    }
+    int n = vsnprintf(line + *len, cap + 1 - *len, fmt, args);
+    if (n > 0)
+    {
+        *len = *len + (size_t)n < cap ? *len + (size_t)n : cap;
+    }
+}
+
+static void append(char *line, size_t cap, size_t *len, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    append_va(line, cap, len, fmt, args);
+    va_end(args);
+}
+
+/* Debug/info go to stdout unless the log table or dashboard owns the terminal; warnings and
+ * errors always go to stderr, rate-limited per call site. */
+void log_message(log_site_t *site, int level, int err, const char *fmt, ...)
+{
+    if (level > g_runtime_level)
+    {
+        return;
+    }
+    int fd = level <= LOG_LEVEL_WARN ? STDERR_FILENO : STDOUT_FILENO;
+    if (fd == STDOUT_FILENO && is_logging_enabled())
+    {
+        return;
+    }
+
+    unsigned long suppressed = 0;
+    if (level <= LOG_LEVEL_WARN && rate_limited(site, &suppressed))
+    {
+        return;
+    }
+
+    char line[LOG_LINE_MAX];
+    size_t cap = sizeof(line) - 1;
+    size_t len = 0;
+    if (level <= LOG_LEVEL_WARN)
+    {
+        append(line, cap, &len, "[%s] ", level_names[level]);
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    append_va(line, cap, &len, fmt, args);
+    va_end(args);
+
+    if (err != 0)
+    {
+        char err_buf[128];
+        append(line, cap, &len, ": %s", strerror_r(err, err_buf, sizeof(err_buf)));
+    }
+    if (suppressed > 0)
+    {
+        append(line, cap, &len, " (%lu similares suprimidos)", suppressed);
+    }
+    line[len++] = '\n';
+    log_write(fd, line, len);
+}
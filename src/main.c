@@ -2,6 +2,16 @@
 #include "http.h"
 #include "logger.h"
 #include "stats.h"
+#include "trace.h"
+#include "accesslog.h"
+#include "blockcache.h"
+#include "capture.h"
+#include "cluster.h"
+#include "dashboard.h"
+#include "tls.h"
+#include "prefork.h"
+#include "probes.h"
+#include "proxy.h"
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,10 +21,20 @@
 #include <termios.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <poll.h>
 #include <getopt.h>
 
-static volatile int keep_running = 1;
+#define ACCEPT_BATCH_MAX 64
+#define LISTENER_MAX 3
+
+#define PROXY_ON_TCP 1
+#define PROXY_ON_UNIX 2
+
+static volatile sig_atomic_t keep_running = 1;
 static char *g_log_file = NULL;
+static int g_process_count = 1;
+static int g_is_child = 0;
+static const char *g_unix_path = NULL;
 
 static struct termios orig_termios;
 
@@ -51,11 +71,43 @@ int check_quit_key(void)
     return 0;
 }
 
+static void handle_stop(int sig)
+{
+    (void)sig;
+    keep_running = 0;
+}
+
+/* Prefork children hold no terminal and no totals: the supervisor reports the merged shards. */
+static void child_exit(void)
+{
+    close_access_log();
+    close_capture();
+    log_flush();
+    print_client_queue_stats(g_log_file);
+    fflush(NULL);
+    _exit(0);
+}
+
 void cleanup_and_exit(void)
 {
+    if (g_is_child)
+    {
+        child_exit();
+    }
     printf("\n\nShutting down server...\n");
     restore_blocking_input();
+    if (g_unix_path)
+    {
+        unlink(g_unix_path);
+    }
+    close_access_log();
+    close_capture();
+    log_flush();
     print_stats(g_log_file);
+    if (g_process_count == 1)
+    {
+        print_client_queue_stats(g_log_file);
+    }
     exit(0);
 }
 
@@ -65,14 +117,85 @@ int main(int argc, char *argv[])
     int func_opt;
     int worker_count = 4;
     int enable_logging = 0;
+    int enable_dashboard = 0;
+    unsigned long trace_slow_ms = 0;
+    unsigned int trace_sample = 1;
+    const char *access_log_path = NULL;
+    unsigned long long access_log_rotate_mb = 64;
+    int tls_port = 0;
+    const char *tls_cert = NULL;
+    const char *tls_key = NULL;
+    int keepalive_timeout_ms = 2000;
+    int keepalive_requests = 100;
+    const char *capture_path = NULL;
+    unsigned int capture_sample = 1;
+    unsigned long next_conn_id = 0;
+    int bulk_workers = 0;
+    long bulk_threshold_kb = 256;
+    long uncached_kb = 0;
+    int uncached_direct = 0;
+    int header_timeout_ms = 10000;
+    int header_min_rate = 64;
+    int header_max = CONN_IO_BUFFER_SIZE;
+    int log_level = LOG_LEVEL_WARN;
+    const char *bind_address = NULL;
+    int port = 8001;
+    int proxy_listeners = 0;
+    int coroutines = 0;
+    long block_cache_mb = 0;
+    const char *peers = NULL;
+    const char *peer_self = NULL;
+    const char *peer_secret = NULL;
+    int peer_hot = 100;
+    fair_queue_options_t fair_options = {.enabled = 0, .prefix_bits = 32, .client_cap = 0,
+                                         .per_client_queue = CLIENT_QUEUE_CAPACITY / 4, .quantum = 1};
+    listen_options_t listen_options = {.backlog = 1024, .defer_accept_s = 5, .fastopen_qlen = 256};
 
     static struct option long_options[] = {
         {"workers", required_argument, 0, 'n'},
         {"output", required_argument, 0, 'o'},
         {"log", no_argument, 0, 'l'},
+        {"trace-slow", required_argument, 0, 't'},
+        {"trace-sample", required_argument, 0, 's'},
+        {"access-log", required_argument, 0, 'a'},
+        {"access-log-rotate", required_argument, 0, 'r'},
+        {"tls-port", required_argument, 0, 'P'},
+        {"cert", required_argument, 0, 'c'},
+        {"key", required_argument, 0, 'k'},
+        {"keepalive-timeout", required_argument, 0, 'K'},
+        {"keepalive-requests", required_argument, 0, 'R'},
+        {"backlog", required_argument, 0, 'b'},
+        {"defer-accept", required_argument, 0, 'd'},
+        {"fastopen", required_argument, 0, 'f'},
+        {"capture", required_argument, 0, 'C'},
+        {"capture-sample", required_argument, 0, 'S'},
+        {"dashboard", no_argument, 0, 'D'},
+        {"fair", no_argument, 0, 'F'},
+        {"fair-prefix", required_argument, 0, 'M'},
+        {"client-cap", required_argument, 0, 'L'},
+        {"client-queue", required_argument, 0, 'Q'},
+        {"bulk-workers", required_argument, 0, 'B'},
+        {"bulk-threshold", required_argument, 0, 'T'},
+        {"uncached", required_argument, 0, 'U'},
+        {"odirect", no_argument, 0, 'O'},
+        {"header-timeout", required_argument, 0, 'H'},
+        {"header-min-rate", required_argument, 0, 'm'},
+        {"header-max", required_argument, 0, 'x'},
+        {"log-level", required_argument, 0, 'V'},
+        {"processes", required_argument, 0, 'p'},
+        {"bind", required_argument, 0, 'A'},
+        {"port", required_argument, 0, 'i'},
+        {"unix", required_argument, 0, 'u'},
+        {"proxy-protocol", required_argument, 0, 'X'},
+        {"coroutines", required_argument, 0, 'G'},
+        {"block-cache", required_argument, 0, 'Y'},
+        {"peers", required_argument, 0, 'E'},
+        {"peer-self", required_argument, 0, 'I'},
+        {"peer-hot", required_argument, 0, 'J'},
+        {"peer-secret", required_argument, 0, 'W'},
         {0, 0, 0, 0}};
 
-    while ((func_opt = getopt_long(argc, argv, "n:o:l", long_options, NULL)) != -1)
+    while ((func_opt = getopt_long(argc, argv, "n:o:lt:s:a:r:P:c:k:K:R:b:d:f:C:S:DFM:L:Q:B:T:U:OH:m:x:V:p:A:i:u:X:G:Y:E:I:J:W:", long_options, NULL)) != -1)
     {
         switch (func_opt)
         {
@@ -89,25 +212,257 @@ int main(int argc, char *argv[])
         case 'l':
             enable_logging = 1;
             break;
+        case 't':
+            trace_slow_ms = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            trace_sample = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        case 'a':
+            access_log_path = optarg;
+            break;
+        case 'r':
+            access_log_rotate_mb = strtoull(optarg, NULL, 10);
+            break;
+        case 'P':
+            tls_port = atoi(optarg);
+            break;
+        case 'c':
+            tls_cert = optarg;
+            break;
+        case 'k':
+            tls_key = optarg;
+            break;
+        case 'K':
+            keepalive_timeout_ms = atoi(optarg);
+            break;
+        case 'R':
+            keepalive_requests = atoi(optarg);
+            break;
+        case 'b':
+            listen_options.backlog = atoi(optarg);
+            break;
+        case 'd':
+            listen_options.defer_accept_s = atoi(optarg);
+            break;
+        case 'f':
+            listen_options.fastopen_qlen = atoi(optarg);
+            break;
+        case 'C':
+            capture_path = optarg;
+            break;
+        case 'S':
+            capture_sample = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        case 'D':
+            enable_dashboard = 1;
+            break;
+        case 'F':
+            fair_options.enabled = 1;
+            break;
+        case 'M':
+            fair_options.prefix_bits = atoi(optarg);
+            break;
+        case 'L':
+            fair_options.client_cap = atoi(optarg);
+            break;
+        case 'Q':
+            fair_options.per_client_queue = atoi(optarg);
+            break;
+        case 'B':
+            bulk_workers = atoi(optarg);
+            if (bulk_workers < 0)
+                bulk_workers = 0;
+            if (bulk_workers > 100)
+                bulk_workers = 100;
+            break;
+        case 'T':
+            bulk_threshold_kb = atol(optarg);
+            break;
+        case 'U':
+            uncached_kb = atol(optarg);
+            break;
+        case 'O':
+            uncached_direct = 1;
+            break;
+        case 'H':
+            header_timeout_ms = atoi(optarg);
+            break;
+        case 'm':
+            header_min_rate = atoi(optarg);
+            break;
+        case 'x':
+            header_max = atoi(optarg);
+            break;
+        case 'V':
+            log_level = parse_log_level(optarg);
+            if (log_level < 0)
+            {
+                fprintf(stderr, "Nivel de log inválido: %s (error, warn, info, debug)\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'p':
+            g_process_count = atoi(optarg);
+            if (g_process_count < 1)
+                g_process_count = 1;
+            if (g_process_count > PREFORK_MAX_PROCESSES)
+                g_process_count = PREFORK_MAX_PROCESSES;
+            break;
+        case 'A':
+            bind_address = optarg;
+            break;
+        case 'i':
+            port = atoi(optarg);
+            break;
+        case 'u':
+            g_unix_path = optarg;
+            break;
+        case 'X':
+            if (strcmp(optarg, "tcp") == 0)
+                proxy_listeners = PROXY_ON_TCP;
+            else if (strcmp(optarg, "unix") == 0)
+                proxy_listeners = PROXY_ON_UNIX;
+            else if (strcmp(optarg, "all") == 0)
+                proxy_listeners = PROXY_ON_TCP | PROXY_ON_UNIX;
+            else
+            {
+                fprintf(stderr, "--proxy-protocol espera tcp, unix o all: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'G':
+            coroutines = atoi(optarg);
+            if (coroutines < 0)
+                coroutines = 0;
+            if (coroutines > CONN_POOL_MAX)
+                coroutines = CONN_POOL_MAX;
+            break;
+        case 'Y':
+            block_cache_mb = atol(optarg);
+            if (block_cache_mb < 0)
+                block_cache_mb = 0;
+            break;
+        case 'E':
+            peers = optarg;
+            break;
+        case 'I':
+            peer_self = optarg;
+            break;
+        case 'J':
+            peer_hot = atoi(optarg);
+            break;
+        case 'W':
+            peer_secret = optarg;
+            break;
         default:
-            fprintf(stderr, "Usage: %s [-n workers] [-o output_file] [-l|--log]\n", argv[0]);
+            fprintf(stderr, "Usage: %s [-n workers] [-o output_file] [-l|--log] "
+                            "[-t|--trace-slow ms] [-s|--trace-sample N] "
+                            "[-a|--access-log file] [-r|--access-log-rotate MB] "
+                            "[-P|--tls-port port -c|--cert pem -k|--key pem] "
+                            "[-K|--keepalive-timeout ms] [-R|--keepalive-requests N] "
+                            "[-b|--backlog N] [-d|--defer-accept s] [-f|--fastopen qlen] "
+                            "[-C|--capture file.jsonl] [-S|--capture-sample N] [-D|--dashboard] "
+                            "[-F|--fair [-M|--fair-prefix bits] [-L|--client-cap N] [-Q|--client-queue N]] "
+                            "[-B|--bulk-workers N [-T|--bulk-threshold KB]] "
+                            "[-U|--uncached KB [-O|--odirect]] "
+                            "[-H|--header-timeout ms] [-m|--header-min-rate B/s] [-x|--header-max bytes] "
+                            "[-V|--log-level error|warn|info|debug] [-p|--processes N] "
+                            "[-A|--bind addr] [-i|--port N] [-u|--unix path] [-X|--proxy-protocol tcp|unix|all] "
+                            "[-G|--coroutines N] [-Y|--block-cache MB] "
+                            "[-E|--peers host:port,... -I|--peer-self host:port -W|--peer-secret token [-J|--peer-hot req/s]]\n",
+                    argv[0]);
             exit(EXIT_FAILURE);
         }
     }
 
+    if (port <= 0 && tls_port <= 0 && !g_unix_path)
+    {
+        fprintf(stderr, "Sin listeners: --port 0 requiere --unix o --tls-port\n");
+        exit(EXIT_FAILURE);
+    }
+    if (peers && (!peer_self || !peer_secret || block_cache_mb <= 0))
+    {
+        fprintf(stderr, "--peers requiere --peer-self, --peer-secret y --block-cache (los bloques traídos se "
+                        "guardan ahí)\n");
+        exit(EXIT_FAILURE);
+    }
+    if (enable_dashboard && g_process_count > 1)
+    {
+        fprintf(stderr, "--dashboard muestra los workers de un solo proceso; no se combina con --processes\n");
+        exit(EXIT_FAILURE);
+    }
     if (enable_logging)
     {
-        init_logger(worker_count, g_log_file);
+        init_logger(worker_count + bulk_workers, g_log_file);
+    }
+    if (enable_dashboard)
+    {
+        mute_console();
+    }
+
+    /* sendfile(2) and SSL writes have no MSG_NOSIGNAL; a peer hanging up must be an EPIPE, not a kill. */
+    signal(SIGPIPE, SIG_IGN);
+    init_stats(g_process_count);
+    http_set_keepalive(keepalive_timeout_ms, keepalive_requests);
+    http_set_bulk_threshold(bulk_threshold_kb * 1024L);
+    http_set_uncached(uncached_kb * 1024L, uncached_direct);
+    http_set_header_limits(header_timeout_ms, header_min_rate, header_max);
+    init_trace(trace_slow_ms * 1000UL, trace_sample);
+    if (peers)
+    {
+        init_cluster(peers, peer_self, peer_secret, peer_hot);
+    }
+    if (tls_port > 0)
+    {
+        if (!tls_cert || !tls_key || init_tls(tls_cert, tls_key) != 0)
+        {
+            fprintf(stderr, "TLS listener requires a valid --cert and --key\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    set_listen_options(&listen_options);
+    set_fair_queue_options(&fair_options);
+
+    /* Listeners are created before forking so every prefork child accepts from the same sockets. */
+    struct pollfd listeners[LISTENER_MAX];
+    int listener_tls[LISTENER_MAX] = {0};
+    int listener_proxy[LISTENER_MAX] = {0};
+    int listener_count = 0;
+
+    if (port > 0)
+    {
+        listeners[listener_count].fd = create_socket_and_listen(bind_address, port);
+        listener_proxy[listener_count] = proxy_listeners & PROXY_ON_TCP;
+        listener_count++;
+    }
+
+    if (tls_port > 0)
+    {
+        listeners[listener_count].fd = create_socket_and_listen(bind_address, tls_port);
+        listener_tls[listener_count] = 1;
+        listener_proxy[listener_count] = proxy_listeners & PROXY_ON_TCP;
+        listener_count++;
+    }
+
+    if (g_unix_path)
+    {
+        listeners[listener_count].fd = create_unix_listener(g_unix_path);
+        listener_proxy[listener_count] = proxy_listeners & PROXY_ON_UNIX;
+        listener_count++;
     }
 
-    init_stats();
-    init_thread_pool(worker_count);
-    int server_fd = create_socket_and_listen(8001);
+    for (int i = 0; i < listener_count; i++)
+    {
+        listeners[i].events = POLLIN;
+    }
 
     if (!is_logging_enabled())
     {
-        printf("Servidor HTTP escuchando en puerto 8000...\n");
-        printf("Workers: %d\n", worker_count);
+        if (g_process_count > 1)
+            printf("Procesos: %d x %d workers\n", g_process_count, worker_count);
+        else
+            printf("Workers: %d\n", worker_count);
         if (g_log_file)
             printf("Logging to file: %s\n", g_log_file);
         printf("Presiona 'q' para salir y ver estadísticas\n");
@@ -115,27 +470,105 @@ int main(int argc, char *argv[])
 
     set_nonblocking_input();
 
+    /* Nothing before this point may start a thread: fork(2) only carries the calling one. */
+    char child_path[1024];
+    if (g_process_count > 1)
+    {
+        int index = prefork_run(g_process_count, check_quit_key);
+        if (index < 0)
+        {
+            cleanup_and_exit();
+        }
+        g_is_child = 1;
+        signal(SIGTERM, handle_stop);
+        stats_use_shard(index);
+        next_conn_id = (unsigned long)index << 40;
+        if (access_log_path)
+        {
+            snprintf(child_path, sizeof(child_path), "%s.p%d", access_log_path, index);
+            access_log_path = strdup(child_path);
+        }
+        if (capture_path)
+        {
+            snprintf(child_path, sizeof(child_path), "%s.p%d", capture_path, index);
+            capture_path = strdup(child_path);
+        }
+    }
+
+    init_log_writer(log_level);
+    if (access_log_path)
+    {
+        init_access_log(access_log_path, access_log_rotate_mb * 1024ULL * 1024ULL, worker_count + bulk_workers);
+    }
+    if (capture_path)
+    {
+        init_capture(capture_path, capture_sample);
+    }
+    init_block_cache((size_t)block_cache_mb * 1024 * 1024);
+    set_coroutines(coroutines);
+    init_thread_pool(worker_count, bulk_workers);
+    if (enable_dashboard)
+    {
+        init_dashboard();
+    }
+
     while (keep_running)
     {
-        if (check_quit_key())
+        if (!g_is_child && check_quit_key())
         {
             cleanup_and_exit();
         }
 
         log_event(ID_PRODUCER, -1, "Sleeping", "Waiting for connection");
 
-        struct timeval tv;
-        tv.tv_sec = 0;
-        tv.tv_usec = 100000;
-        setsockopt(server_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-
-        int client_fd = accept_connection(server_fd);
-        if (client_fd < 0)
+        if (poll(listeners, (nfds_t)listener_count, 100) <= 0)
             continue;
 
-        log_event(ID_PRODUCER, client_fd, "Running", "New connection accepted");
-        enqueue_client(client_fd);
-        log_event(ID_PRODUCER, client_fd, "Ready", "Client added to queue");
+        for (int i = 0; i < listener_count; i++)
+        {
+            if (!(listeners[i].revents & POLLIN))
+                continue;
+
+            /* Drain the accept queue per wakeup, bounded so the other listener is not starved. */
+            int accepted = 0;
+            while (accepted < ACCEPT_BATCH_MAX)
+            {
+                client_t client = {0};
+                int client_fd = accept_connection(listeners[i].fd, &client);
+                if (client_fd < 0)
+                    break;
+                accepted++;
+
+                trace_mark(&client.trace, TRACE_ACCEPT);
+                client.tls = listener_tls[i];
+                client.conn_id = next_conn_id++;
+                PROBE2(accept, client.conn_id, client_fd);
+
+                /* Take the PROXY header now if it is already queued so fairness sees the real client;
+                 * otherwise the worker finishes reading it under the header deadline. */
+                if (listener_proxy[i])
+                {
+                    int parsed = proxy_accept(&client, 0);
+                    if (parsed < 0)
+                    {
+                        log_debug("Cabecera PROXY inválida, cerrando fd %d", client_fd);
+                        close(client_fd);
+                        continue;
+                    }
+                    client.proxy = parsed == 0;
+                }
+
+                log_event(ID_PRODUCER, client_fd, "Running", "New connection accepted");
+                if (enqueue_client(&client) != 0)
+                {
+                    reject_client(&client);
+                    log_event(ID_PRODUCER, client_fd, "Running", "Client over its queue share, rejected");
+                    continue;
+                }
+                log_event(ID_PRODUCER, client_fd, "Ready", "Client added to queue");
+            }
+            record_accept_batch((unsigned long)accepted);
+        }
     }
 
     cleanup_and_exit();
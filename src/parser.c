@@ -1,32 +1,124 @@
+#define _GNU_SOURCE
 #include "parser.h"
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include "logger.h"
 
-void sanitize_path(char *path)
+static const char *find_line_end(const char *p, const char *end)
 {
+    while (p + 1 < end)
+    {
+        if (p[0] == '\r' && p[1] == '\n')
+        {
+            return p;
+        }
+        p++;
+    }
+    return NULL;
+}
 
-    if (strcmp(path, "/") == 0)
+static const char *next_token(const char **p, const char *end, size_t *len)
+{
+    while (*p < end && **p == ' ')
     {
-        strcpy(path, "/index.html");
+        (*p)++;
     }
+    const char *start = *p;
+    while (*p < end && **p != ' ')
+    {
+        (*p)++;
+    }
+    *len = (size_t)(*p - start);
+    return start;
 }
 
-void parse_http_request(char *request, char *method, char *file_path)
+/* Parses the request head (request line + headers, ending in an empty line) into
+ * arena-owned strings. The source buffer is left untouched. */
+int parse_http_request(const char *request, size_t len, arena_t *arena, http_request_t *req)
 {
+    const char *end = request + len;
+    const char *line_end = find_line_end(request, end);
+
+    memset(req, 0, sizeof(*req));
+    if (!line_end)
+    {
+        log_debug("Petición HTTP mal formada");
+        return -1;
+    }
+
+    const char *p = request;
+    size_t method_len, path_len, version_len;
+    const char *method = next_token(&p, line_end, &method_len);
+    const char *path = next_token(&p, line_end, &path_len);
+    const char *version = next_token(&p, line_end, &version_len);
+
+    if (method_len == 0 || path_len == 0)
+    {
+        log_debug("Petición HTTP mal formada");
+        return -1;
+    }
 
-    int parsed = sscanf(request, "%s %s", method, file_path);
+    req->method = arena_strndup(arena, method, method_len);
+    req->path = arena_strndup(arena, path, path_len);
+    req->version = arena_strndup(arena, version, version_len);
+    req->headers = arena_alloc(arena, HTTP_MAX_HEADERS * sizeof(http_header_t));
+    if (!req->method || !req->path || !req->version || !req->headers)
+    {
+        return -1;
+    }
 
-    if (parsed < 2)
+    for (p = line_end + 2; p < end && req->header_count < HTTP_MAX_HEADERS; p = line_end + 2)
     {
-        printf("Error: Petición HTTP mal formada");
-        return;
+        line_end = find_line_end(p, end);
+        if (!line_end || line_end == p)
+        {
+            break;
+        }
+
+        const char *colon = memchr(p, ':', (size_t)(line_end - p));
+        if (!colon)
+        {
+            continue;
+        }
+        const char *value = colon + 1;
+        while (value < line_end && (*value == ' ' || *value == '\t'))
+        {
+            value++;
+        }
+
+        http_header_t *h = &req->headers[req->header_count];
+        h->name = arena_strndup(arena, p, (size_t)(colon - p));
+        h->value = arena_strndup(arena, value, (size_t)(line_end - value));
+        if (!h->name || !h->value)
+        {
+            return -1;
+        }
+        req->header_count++;
     }
 
-    if (!is_logging_enabled()) {
-        printf("Método detectado: %s\n", method);
-        printf("Archivo solicitado: %s\n", file_path);
+    const char *connection = http_request_header(req, "Connection");
+    if (strcmp(req->version, "HTTP/1.1") == 0)
+    {
+        req->keep_alive = !(connection && strcasestr(connection, "close"));
+    }
+    else
+    {
+        req->keep_alive = connection && strcasestr(connection, "keep-alive");
     }
 
-    sanitize_path(file_path);
-}
\ No newline at end of file
+    log_debug("Método detectado: %s, archivo solicitado: %s", req->method, req->path);
+    return 0;
+}
+
+const char *http_request_header(const http_request_t *req, const char *name)
+{
+    for (int i = 0; i < req->header_count; i++)
+    {
+        if (strcasecmp(req->headers[i].name, name) == 0)
+        {
+            return req->headers[i].value;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,165 @@
+#define _GNU_SOURCE
+#include "prefork.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include "logger.h"
+#include "stats.h"
+#include "trace.h"
+
+typedef struct
+{
+    pid_t pid;
+    uint64_t started_ns;
+    uint64_t respawn_at_ns;
+} child_slot_t;
+
+static child_slot_t g_children[PREFORK_MAX_PROCESSES];
+static int g_process_count = 0;
+
+/* Returns 1 inside the new child, 0 in the supervisor. */
+static int spawn_child(int index, pid_t supervisor)
+{
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        log_errno("fork");
+        g_children[index].pid = 0;
+        g_children[index].respawn_at_ns = trace_now_ns() + PREFORK_RESPAWN_BACKOFF_MS * 1000000ULL;
+        return 0;
+    }
+    if (pid == 0)
+    {
+        /* Children must not outlive the supervisor: nobody would reap or replace them. */
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (getppid() != supervisor)
+        {
+            _exit(0);
+        }
+        return 1;
+    }
+    g_children[index].pid = pid;
+    g_children[index].started_ns = trace_now_ns();
+    return 0;
+}
+
+static int child_index(pid_t pid)
+{
+    for (int i = 0; i < g_process_count; i++)
+    {
+        if (g_children[i].pid == pid)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void reap_children(void)
+{
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        int index = child_index(pid);
+        if (index < 0)
+        {
+            continue;
+        }
+        if (WIFSIGNALED(status))
+        {
+            log_warn("proceso %d (pid %d) murió por la señal %d, relanzando", index, (int)pid, WTERMSIG(status));
+        }
+        else
+        {
+            log_warn("proceso %d (pid %d) salió con código %d, relanzando", index, (int)pid, WEXITSTATUS(status));
+        }
+        record_respawn();
+
+        /* A child that dies right after starting is failing at init; back off instead of fork-looping. */
+        uint64_t now = trace_now_ns();
+        uint64_t backoff = PREFORK_RESPAWN_BACKOFF_MS * 1000000ULL;
+        g_children[index].pid = 0;
+        g_children[index].respawn_at_ns = now - g_children[index].started_ns < backoff ? now + backoff : now;
+    }
+}
+
+static void stop_children(void)
+{
+    for (int i = 0; i < g_process_count; i++)
+    {
+        if (g_children[i].pid > 0)
+        {
+            kill(g_children[i].pid, SIGTERM);
+        }
+    }
+
+    uint64_t deadline = trace_now_ns() + PREFORK_STOP_GRACE_MS * 1000000ULL;
+    int alive = 1;
+    while (alive)
+    {
+        alive = 0;
+        for (int i = 0; i < g_process_count; i++)
+        {
+            if (g_children[i].pid <= 0)
+            {
+                continue;
+            }
+            pid_t pid = waitpid(g_children[i].pid, NULL, WNOHANG);
+            if (pid == g_children[i].pid || (pid < 0 && errno == ECHILD))
+            {
+                g_children[i].pid = 0;
+                continue;
+            }
+            if (trace_now_ns() > deadline)
+            {
+                kill(g_children[i].pid, SIGKILL);
+            }
+            alive = 1;
+        }
+        if (alive)
+        {
+            usleep(10000);
+        }
+    }
+}
+
+int prefork_run(int processes, int (*should_stop)(void))
+{
+    if (processes > PREFORK_MAX_PROCESSES)
+    {
+        processes = PREFORK_MAX_PROCESSES;
+    }
+    g_process_count = processes;
+    pid_t supervisor = getpid();
+
+    for (int i = 0; i < processes; i++)
+    {
+        if (spawn_child(i, supervisor))
+        {
+            return i;
+        }
+    }
+
+    while (!should_stop())
+    {
+        reap_children();
+        uint64_t now = trace_now_ns();
+        for (int i = 0; i < processes; i++)
+        {
+            if (g_children[i].pid == 0 && now >= g_children[i].respawn_at_ns && spawn_child(i, supervisor))
+            {
+                return i;
+            }
+        }
+        usleep(100000);
+    }
+
+    stop_children();
+    return -1;
+}
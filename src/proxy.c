@@ -0,0 +1,214 @@
+#include "proxy.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include "io.h"
+
+static const unsigned char v2_signature[12] = {0x0D, 0x0A, 0x0D, 0x0A, 0x00, 0x0D,
+                                               0x0A, 0x51, 0x55, 0x49, 0x54, 0x0A};
+
+static long parse_v2(const unsigned char *buf, size_t len, struct sockaddr_storage *peer, socklen_t *peer_len)
+{
+    if (len < 16)
+    {
+        return 0;
+    }
+    if ((buf[12] & 0xF0) != 0x20)
+    {
+        return -1;
+    }
+    size_t body = ((size_t)buf[14] << 8) | buf[15];
+    if (16 + body > PROXY_HEADER_MAX)
+    {
+        return -1;
+    }
+    if (len < 16 + body)
+    {
+        return 0;
+    }
+
+    int command = buf[12] & 0x0F;
+    int family = buf[13] >> 4;
+    int transport = buf[13] & 0x0F;
+    const unsigned char *addr = buf + 16;
+    if (command == 0x0)
+    {
+        return (long)(16 + body);
+    }
+    if (command != 0x1)
+    {
+        return -1;
+    }
+
+    /* Layout: source address, destination address, source port, destination port. */
+    if (family == 0x1 && transport == 0x1 && body >= 12)
+    {
+        struct sockaddr_in *in = (struct sockaddr_in *)peer;
+        memset(peer, 0, sizeof(*peer));
+        in->sin_family = AF_INET;
+        memcpy(&in->sin_addr, addr, 4);
+        memcpy(&in->sin_port, addr + 8, 2);
+        *peer_len = sizeof(*in);
+    }
+    else if (family == 0x2 && transport == 0x1 && body >= 36)
+    {
+        struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)peer;
+        memset(peer, 0, sizeof(*peer));
+        in6->sin6_family = AF_INET6;
+        memcpy(&in6->sin6_addr, addr, 16);
+        memcpy(&in6->sin6_port, addr + 32, 2);
+        *peer_len = sizeof(*in6);
+    }
+    return (long)(16 + body);
+}
+
+/* "PROXY TCP4 <src> <dst> <sport> <dport>\r\n" or "PROXY UNKNOWN ...\r\n". */
+static long parse_v1(const unsigned char *buf, size_t len, struct sockaddr_storage *peer, socklen_t *peer_len)
+{
+    const unsigned char *eol = memchr(buf, '\n', len < PROXY_V1_MAX ? len : PROXY_V1_MAX);
+    if (!eol)
+    {
+        return len >= PROXY_V1_MAX ? -1 : 0;
+    }
+    size_t line_len = (size_t)(eol - buf) + 1;
+    if (line_len < 8 || eol[-1] != '\r')
+    {
+        return -1;
+    }
+
+    char line[PROXY_V1_MAX + 1];
+    memcpy(line, buf, line_len - 2);
+    line[line_len - 2] = '\0';
+
+    char proto[8], src[64], dst[64];
+    unsigned int sport, dport;
+    if (strncmp(line, "PROXY UNKNOWN", 13) == 0)
+    {
+        return (long)line_len;
+    }
+    if (sscanf(line, "PROXY %7s %63s %63s %u %u", proto, src, dst, &sport, &dport) != 5 || sport > 65535 ||
+        dport > 65535)
+    {
+        return -1;
+    }
+
+    memset(peer, 0, sizeof(*peer));
+    if (strcmp(proto, "TCP4") == 0)
+    {
+        struct sockaddr_in *in = (struct sockaddr_in *)peer;
+        in->sin_family = AF_INET;
+        in->sin_port = htons((uint16_t)sport);
+        if (inet_pton(AF_INET, src, &in->sin_addr) != 1)
+        {
+            return -1;
+        }
+        *peer_len = sizeof(*in);
+    }
+    else if (strcmp(proto, "TCP6") == 0)
+    {
+        struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)peer;
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons((uint16_t)sport);
+        if (inet_pton(AF_INET6, src, &in6->sin6_addr) != 1)
+        {
+            return -1;
+        }
+        *peer_len = sizeof(*in6);
+    }
+    else
+    {
+        return -1;
+    }
+    return (long)line_len;
+}
+
+long proxy_parse(const unsigned char *buf, size_t len, struct sockaddr_storage *peer, socklen_t *peer_len)
+{
+    size_t sig = len < sizeof(v2_signature) ? len : sizeof(v2_signature);
+    if (memcmp(buf, v2_signature, sig) == 0)
+    {
+        return len < sizeof(v2_signature) ? 0 : parse_v2(buf, len, peer, peer_len);
+    }
+    size_t tag = len < 6 ? len : 6;
+    if (memcmp(buf, "PROXY ", tag) == 0)
+    {
+        return len < 6 ? 0 : parse_v1(buf, len, peer, peer_len);
+    }
+    return -1;
+}
+
+/* Peeks so nothing past the header is ever consumed: the HTTP or TLS bytes behind it stay queued. */
+int proxy_accept(client_t *client, int may_wait)
+{
+    unsigned char buf[PROXY_HEADER_MAX];
+    size_t have = 0;
+    struct sockaddr_storage peer = client->peer;
+    socklen_t peer_len = client->peer_len;
+
+    while (1)
+    {
+        io_count_syscalls(SYSCALL_READ, 1);
+        ssize_t n = recv(client->fd, buf + have, sizeof(buf) - have, MSG_PEEK);
+        if (n == 0)
+        {
+            return -1;
+        }
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                return -1;
+            }
+            if (!may_wait)
+            {
+                return 0;
+            }
+            if (io_wait(client, POLLIN, IO_WAIT_TIMEOUT_MS) != 0)
+            {
+                return -1;
+            }
+            continue;
+        }
+
+        long header_len = proxy_parse(buf, have + (size_t)n, &peer, &peer_len);
+        if (header_len < 0)
+        {
+            return -1;
+        }
+        if (header_len > 0)
+        {
+            size_t rest = (size_t)header_len - have;
+            io_count_syscalls(SYSCALL_READ, 1);
+            if (recv(client->fd, buf + have, rest, 0) != (ssize_t)rest)
+            {
+                return -1;
+            }
+            client->peer = peer;
+            client->peer_len = peer_len;
+            return 1;
+        }
+        if (!may_wait)
+        {
+            return 0;
+        }
+
+        /* Incomplete, so every queued byte belongs to the header: take them and wait for more. */
+        io_count_syscalls(SYSCALL_READ, 1);
+        if (recv(client->fd, buf + have, (size_t)n, 0) != n)
+        {
+            return -1;
+        }
+        have += (size_t)n;
+        if (io_wait(client, POLLIN, IO_WAIT_TIMEOUT_MS) != 0)
+        {
+            return -1;
+        }
+    }
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include "server.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -5,37 +6,115 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <errno.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "conn.h"
+#include "coro.h"
+#include "dashboard.h"
 #include "http.h"
 #include "logger.h"
+#include "probes.h"
+#include "trace.h"
 
-#define CLIENT_QUEUE_CAPACITY 64
-
+/* Pending connections are grouped by client (hashed address prefix, SFQ-style) and the
+ * groups are served with deficit round robin. With fairness off everything lands in
+ * group 0, which is plain FIFO. */
 typedef struct
 {
-    int client_fds[CLIENT_QUEUE_CAPACITY];
+    unsigned char key[17];
+    int used;
+    int shared;
     int head;
     int tail;
+    int pending;
+    int active;
+    int deficit;
+    int in_round;
+    int round_next;
+    int round_prev;
+    unsigned long connections;
+    unsigned long shed;
+    int peak_pending;
+    char label[INET6_ADDRSTRLEN + 8];
+} client_group_t;
+
+typedef struct
+{
+    client_t clients[CLIENT_QUEUE_CAPACITY];
+    int slot_next[CLIENT_QUEUE_CAPACITY];
+    int free_head;
     int count;
+    client_group_t groups[CLIENT_GROUPS];
+    int round;
     pthread_mutex_t mutex;
     pthread_cond_t not_empty;
     pthread_cond_t not_full;
 } client_queue_t;
 
+/* Bulk transfers handed off by the small pool; bounded so a backlog falls back to inline serving. */
+typedef struct
+{
+    http_bulk_job_t jobs[BULK_QUEUE_CAPACITY];
+    int head;
+    int tail;
+    int count;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+} bulk_queue_t;
+
 static client_queue_t g_client_queue;
-static client_queue_t g_client_queue;
+static bulk_queue_t g_bulk_queue;
+static int g_bulk_worker_count = 0;
+static atomic_int g_queue_depth;
+static fair_queue_options_t g_fair = {0};
 static pthread_t *g_worker_threads = NULL;
 static int *g_worker_ids = NULL;
 static int g_worker_count = 0;
+static int g_coroutines = 0;
+static int g_queue_event = -1;
+
+void set_fair_queue_options(const fair_queue_options_t *options)
+{
+    g_fair = *options;
+    if (g_fair.quantum < 1)
+        g_fair.quantum = 1;
+    if (g_fair.per_client_queue < 1 || g_fair.per_client_queue > CLIENT_QUEUE_CAPACITY)
+        g_fair.per_client_queue = CLIENT_QUEUE_CAPACITY;
+}
+
+void set_coroutines(int per_worker)
+{
+    g_coroutines = per_worker;
+}
+
+/* Coroutine workers sleep in epoll rather than on not_empty; this eventfd stands in for the signal. */
+static void notify_queue_event(void)
+{
+    if (g_queue_event >= 0)
+    {
+        eventfd_write(g_queue_event, 1);
+    }
+}
 
 static void client_queue_init(client_queue_t *q)
 {
-    q->head = 0;
-    q->tail = 0;
+    memset(q->groups, 0, sizeof(q->groups));
+    for (int i = 0; i < CLIENT_QUEUE_CAPACITY; i++)
+    {
+        q->slot_next[i] = i + 1 < CLIENT_QUEUE_CAPACITY ? i + 1 : -1;
+    }
+    q->free_head = 0;
     q->count = 0;
+    q->round = -1;
     if (pthread_mutex_init(&q->mutex, NULL) != 0)
     {
         perror("pthread_mutex_init");
@@ -53,62 +132,473 @@ static void client_queue_init(client_queue_t *q)
     }
 }
 
-static void client_queue_push(client_queue_t *q, int client_fd)
+/* Family byte + address masked to the configured prefix (/64 for IPv6). */
+static int client_group_of(const client_t *client, unsigned char key[17])
+{
+    memset(key, 0, 17);
+    if (!g_fair.enabled)
+    {
+        return 0;
+    }
+
+    int bits = 0;
+    const unsigned char *addr = NULL;
+    if (client->peer.ss_family == AF_INET)
+    {
+        addr = (const unsigned char *)&((const struct sockaddr_in *)&client->peer)->sin_addr;
+        bits = g_fair.prefix_bits > 0 && g_fair.prefix_bits <= 32 ? g_fair.prefix_bits : 32;
+    }
+    else if (client->peer.ss_family == AF_INET6)
+    {
+        addr = (const unsigned char *)&((const struct sockaddr_in6 *)&client->peer)->sin6_addr;
+        bits = 64;
+    }
+    key[0] = (unsigned char)client->peer.ss_family;
+    for (int i = 0; addr && i < bits / 8; i++)
+    {
+        key[1 + i] = addr[i];
+    }
+    if (addr && bits % 8)
+    {
+        key[1 + bits / 8] = addr[bits / 8] & (unsigned char)(0xff << (8 - bits % 8));
+    }
+
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 17; i++)
+    {
+        hash = (hash ^ key[i]) * 16777619u;
+    }
+    return (int)(hash % CLIENT_GROUPS);
+}
+
+static void group_label(client_group_t *g, const client_t *client)
 {
+    if (client->peer.ss_family == AF_UNIX)
+    {
+        snprintf(g->label, sizeof(g->label), "unix");
+        return;
+    }
+    const void *addr = client->peer.ss_family == AF_INET6
+                           ? (const void *)&((const struct sockaddr_in6 *)&client->peer)->sin6_addr
+                           : (const void *)&((const struct sockaddr_in *)&client->peer)->sin_addr;
+    if (!inet_ntop(client->peer.ss_family, addr, g->label, sizeof(g->label)))
+    {
+        snprintf(g->label, sizeof(g->label), "?");
+    }
+    if (client->peer.ss_family == AF_INET && g_fair.prefix_bits > 0 && g_fair.prefix_bits < 32)
+    {
+        size_t len = strlen(g->label);
+        snprintf(g->label + len, sizeof(g->label) - len, "/%d", g_fair.prefix_bits);
+    }
+}
+
+static void round_insert(client_queue_t *q, int gi)
+{
+    client_group_t *g = &q->groups[gi];
+    if (q->round < 0)
+    {
+        g->round_next = g->round_prev = gi;
+        q->round = gi;
+    }
+    else
+    {
+        /* New groups join just behind the cursor, i.e. at the end of the current round. */
+        client_group_t *cur = &q->groups[q->round];
+        g->round_next = q->round;
+        g->round_prev = cur->round_prev;
+        q->groups[cur->round_prev].round_next = gi;
+        cur->round_prev = gi;
+    }
+    g->in_round = 1;
+}
+
+static void round_remove(client_queue_t *q, int gi)
+{
+    client_group_t *g = &q->groups[gi];
+    if (g->round_next == gi)
+    {
+        q->round = -1;
+    }
+    else
+    {
+        q->groups[g->round_prev].round_next = g->round_next;
+        q->groups[g->round_next].round_prev = g->round_prev;
+        if (q->round == gi)
+        {
+            q->round = g->round_next;
+        }
+    }
+    g->in_round = 0;
+    g->deficit = 0;
+}
+
+/* Returns -1 when the client already has its share of the queue; the caller sheds it.
+ * Connections coming back from the bulk pool skip the per-client cap but never wait for room:
+ * a full queue must not stall a bulk worker behind small requests, so they get -1 instead. */
+static int client_queue_push(client_queue_t *q, const client_t *client, int resumed)
+{
+    unsigned char key[17];
+    int gi = client_group_of(client, key);
+
     pthread_mutex_lock(&q->mutex);
+    client_group_t *g = &q->groups[gi];
+    if (!resumed && g->pending >= g_fair.per_client_queue && g_fair.enabled)
+    {
+        g->shed++;
+        pthread_mutex_unlock(&q->mutex);
+        return -1;
+    }
+    if (resumed && q->count == CLIENT_QUEUE_CAPACITY)
+    {
+        pthread_mutex_unlock(&q->mutex);
+        return -1;
+    }
     while (q->count == CLIENT_QUEUE_CAPACITY)
     {
         log_event(ID_PRODUCER, -1, "Sleeping", "Waiting to be awake");
         pthread_cond_wait(&q->not_full, &q->mutex);
     }
-    q->client_fds[q->tail] = client_fd;
-    q->tail = (q->tail + 1) % CLIENT_QUEUE_CAPACITY;
+
+    if (!g->used)
+    {
+        g->used = 1;
+        memcpy(g->key, key, sizeof(g->key));
+        group_label(g, client);
+    }
+    else if (memcmp(g->key, key, sizeof(g->key)) != 0)
+    {
+        g->shared = 1;
+    }
+
+    int slot = q->free_head;
+    q->free_head = q->slot_next[slot];
+    q->clients[slot] = *client;
+    q->clients[slot].queue_group = gi;
+    q->slot_next[slot] = -1;
+    trace_mark(&q->clients[slot].trace, TRACE_ENQUEUE);
+    PROBE3(enqueue, client->conn_id, client->fd, q->count);
+
+    if (g->pending == 0)
+    {
+        g->head = slot;
+    }
+    else
+    {
+        q->slot_next[g->tail] = slot;
+    }
+    g->tail = slot;
+    g->pending++;
+    g->connections++;
+    if (g->pending > g->peak_pending)
+    {
+        g->peak_pending = g->pending;
+    }
+    if (!g->in_round)
+    {
+        round_insert(q, gi);
+    }
+
     q->count++;
+    atomic_store_explicit(&g_queue_depth, q->count, memory_order_relaxed);
     pthread_cond_signal(&q->not_empty);
     pthread_mutex_unlock(&q->mutex);
+    notify_queue_event();
+    return 0;
 }
 
-static int client_queue_pop(client_queue_t *q, int worker_id)
+/* Deficit round robin: each visit grants `quantum` connections, skipping clients at their cap. */
+static int next_group(client_queue_t *q)
 {
+    if (q->round < 0)
+    {
+        return -1;
+    }
+    int gi = q->round;
+    do
+    {
+        client_group_t *g = &q->groups[gi];
+        if (g_fair.client_cap <= 0 || g->active < g_fair.client_cap)
+        {
+            if (g->deficit <= 0)
+            {
+                g->deficit += g_fair.quantum;
+            }
+            q->round = gi;
+            return gi;
+        }
+        gi = g->round_next;
+    } while (gi != q->round);
+    return -1;
+}
+
+/* Called with the mutex held on an eligible group; releases it. */
+static client_t client_queue_take(client_queue_t *q, int gi, int worker_id)
+{
+    client_group_t *g = &q->groups[gi];
+    int slot = g->head;
+    client_t client = q->clients[slot];
+    g->head = q->slot_next[slot];
+    g->pending--;
+    g->active++;
+    g->deficit--;
+    q->slot_next[slot] = q->free_head;
+    q->free_head = slot;
+
+    if (g->pending == 0)
+    {
+        round_remove(q, gi);
+    }
+    else if (g->deficit <= 0)
+    {
+        q->round = g->round_next;
+    }
 
+    q->count--;
+    atomic_store_explicit(&g_queue_depth, q->count, memory_order_relaxed);
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->mutex);
+    trace_mark(&client.trace, TRACE_DEQUEUE);
+    PROBE3(dequeue, client.conn_id, client.fd, worker_id);
+    return client;
+}
+
+static client_t client_queue_pop(client_queue_t *q, int worker_id)
+{
     pthread_mutex_lock(&q->mutex);
-    while (q->count == 0)
+    int gi;
+    while ((gi = next_group(q)) < 0)
     {
         pthread_cond_wait(&q->not_empty, &q->mutex);
         log_event(worker_id, -1, "Ready", "Waiting to execute");
     }
-    int client_fd = q->client_fds[q->head];
-    q->head = (q->head + 1) % CLIENT_QUEUE_CAPACITY;
-    q->count--;
-    pthread_cond_signal(&q->not_full);
+    return client_queue_take(q, gi, worker_id);
+}
+
+/* Never blocks; -1 when nothing is eligible right now. */
+static int client_queue_try_pop(client_queue_t *q, int worker_id, client_t *client)
+{
+    pthread_mutex_lock(&q->mutex);
+    int gi = next_group(q);
+    if (gi < 0)
+    {
+        pthread_mutex_unlock(&q->mutex);
+        return -1;
+    }
+    *client = client_queue_take(q, gi, worker_id);
+    return 0;
+}
+
+/* A finished connection frees one unit of its client's concurrency cap. */
+static void client_queue_done(client_queue_t *q, const client_t *client)
+{
+    pthread_mutex_lock(&q->mutex);
+    q->groups[client->queue_group].active--;
+    int wake = g_fair.client_cap > 0 && q->count > 0;
+    if (wake)
+    {
+        pthread_cond_signal(&q->not_empty);
+    }
     pthread_mutex_unlock(&q->mutex);
-    return client_fd;
+    if (wake)
+    {
+        notify_queue_event();
+    }
+}
+
+static void drop_connection(client_t *client)
+{
+    close(client->fd);
+    client_queue_done(&g_client_queue, client);
+}
+
+static conn_t *acquire_or_drop(conn_pool_t *pool, client_t *client, int worker_id)
+{
+    client->worker_id = worker_id;
+    conn_t *conn = conn_acquire(pool, client);
+    if (!conn)
+    {
+        log_errno("conn_acquire");
+        drop_connection(client);
+    }
+    return conn;
+}
+
+static void serve_connection(conn_pool_t *pool, conn_t *conn)
+{
+    client_t client = conn->client;
+    log_event(client.worker_id, client.fd, "Running", "Handling request");
+    int handed_off = handle_client(conn);
+    conn_release(pool, conn);
+
+    /* A handed-off connection stays counted as active until the bulk worker is done with it. */
+    if (handed_off)
+    {
+        log_event(client.worker_id, client.fd, "Bulk", "Body handed to bulk pool");
+        return;
+    }
+    log_event(client.worker_id, client.fd, "Done", "Finished request");
+    drop_connection(&client);
 }
 
 static void *worker_thread_main(void *arg)
 {
     int worker_id = *((int *)arg);
+    conn_pool_t pool;
+    conn_pool_init(&pool);
+
     while (1)
     {
         log_event(worker_id, -1, "Sleeping", "Waiting for client");
-        int client_fd = client_queue_pop(&g_client_queue, worker_id);
+        dashboard_publish(worker_id, WORKER_IDLE, -1);
+        client_t client = client_queue_pop(&g_client_queue, worker_id);
+        conn_t *conn = acquire_or_drop(&pool, &client, worker_id);
+        if (conn)
+        {
+            serve_connection(&pool, conn);
+        }
+    }
+    return NULL;
+}
+
+static __thread conn_pool_t *t_conn_pool;
+
+static void serve_connection_coro(void *arg)
+{
+    serve_connection(t_conn_pool, arg);
+}
+
+/* Same queue, but each popped connection becomes a coroutine; the worker only blocks in epoll. */
+static void *coro_worker_main(void *arg)
+{
+    int worker_id = *((int *)arg);
+    conn_pool_t pool;
+    conn_pool_init(&pool);
+    t_conn_pool = &pool;
+    coro_sched_t *sched = coro_sched_create(g_coroutines, g_queue_event);
+    dashboard_publish(worker_id, WORKER_IDLE, -1);
+
+    while (1)
+    {
+        client_t client;
+        while (coro_sched_has_room(sched) && client_queue_try_pop(&g_client_queue, worker_id, &client) == 0)
+        {
+            conn_t *conn = acquire_or_drop(&pool, &client, worker_id);
+            if (conn && coro_spawn(sched, serve_connection_coro, conn) != 0)
+            {
+                log_errno("coro_spawn");
+                conn_release(&pool, conn);
+                drop_connection(&client);
+            }
+        }
+        /* A full worker stops watching the queue; pass the wakeup on to one that has room. */
+        if (!coro_sched_has_room(sched) && client_queue_depth() > 0)
+        {
+            notify_queue_event();
+        }
+        coro_sched_run(sched);
+    }
+    return NULL;
+}
+
+int is_bulk_pool_enabled(void)
+{
+    return g_bulk_worker_count > 0;
+}
+
+/* Never blocks: a full bulk queue means the small worker streams the body itself. */
+int dispatch_bulk(const http_bulk_job_t *job)
+{
+    bulk_queue_t *q = &g_bulk_queue;
+    pthread_mutex_lock(&q->mutex);
+    if (q->count == BULK_QUEUE_CAPACITY)
+    {
+        pthread_mutex_unlock(&q->mutex);
+        return -1;
+    }
+    q->jobs[q->tail] = *job;
+    q->tail = (q->tail + 1) % BULK_QUEUE_CAPACITY;
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->mutex);
+    return 0;
+}
+
+static void *bulk_thread_main(void *arg)
+{
+    int worker_id = *((int *)arg);
+    bulk_queue_t *q = &g_bulk_queue;
+    char *buffer = malloc(CONN_BODY_BUFFER_SIZE);
+    if (!buffer)
+    {
+        perror("Failed to allocate bulk buffer");
+        exit(EXIT_FAILURE);
+    }
 
-        log_event(worker_id, client_fd, "Running", "Handling request");
-        handle_client(client_fd);
+    while (1)
+    {
+        dashboard_publish(worker_id, WORKER_IDLE, -1);
+        pthread_mutex_lock(&q->mutex);
+        while (q->count == 0)
+        {
+            pthread_cond_wait(&q->not_empty, &q->mutex);
+        }
+        http_bulk_job_t job = q->jobs[q->head];
+        q->head = (q->head + 1) % BULK_QUEUE_CAPACITY;
+        q->count--;
+        pthread_mutex_unlock(&q->mutex);
+
+        int client_fd = job.client.fd;
+        job.client.worker_id = worker_id;
+        log_event(worker_id, client_fd, "Running", "Streaming bulk body");
+        int keep_alive = http_serve_bulk(&job, buffer, CONN_BODY_BUFFER_SIZE);
 
+        client_queue_done(&g_client_queue, &job.client);
+        if (keep_alive)
+        {
+            if (client_queue_push(&g_client_queue, &job.client, 1) == 0)
+            {
+                continue;
+            }
+            log_debug("Client queue full; closing keep-alive connection fd=%d after bulk body", client_fd);
+        }
         log_event(worker_id, client_fd, "Done", "Finished request");
         close(client_fd);
     }
     return NULL;
 }
 
-void init_thread_pool(int worker_count)
+static void bulk_queue_init(bulk_queue_t *q)
 {
+    q->head = q->tail = q->count = 0;
+    if (pthread_mutex_init(&q->mutex, NULL) != 0)
+    {
+        perror("pthread_mutex_init bulk");
+        exit(EXIT_FAILURE);
+    }
+    if (pthread_cond_init(&q->not_empty, NULL) != 0)
+    {
+        perror("pthread_cond_init bulk");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Worker ids [0, worker_count) are the small pool, the bulk pool follows. */
+void init_thread_pool(int worker_count, int bulk_worker_count)
+{
+    int total = worker_count + bulk_worker_count;
     g_worker_count = worker_count;
+    g_bulk_worker_count = bulk_worker_count;
     client_queue_init(&g_client_queue);
+    bulk_queue_init(&g_bulk_queue);
+    init_worker_slots(total);
+    if (g_coroutines > 0 && (g_queue_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    {
+        perror("eventfd");
+        exit(EXIT_FAILURE);
+    }
 
-    g_worker_threads = malloc(worker_count * sizeof(pthread_t));
-    g_worker_ids = malloc(worker_count * sizeof(int));
+    g_worker_threads = malloc(total * sizeof(pthread_t));
+    g_worker_ids = malloc(total * sizeof(int));
 
     if (!g_worker_threads || !g_worker_ids)
     {
@@ -116,10 +606,13 @@ void init_thread_pool(int worker_count)
         exit(EXIT_FAILURE);
     }
 
-    for (int i = 0; i < worker_count; ++i)
+    for (int i = 0; i < total; ++i)
     {
         g_worker_ids[i] = i;
-        if (pthread_create(&g_worker_threads[i], NULL, worker_thread_main, &g_worker_ids[i]) != 0)
+        void *(*main_fn)(void *) = i >= worker_count ? bulk_thread_main
+                                   : g_coroutines > 0 ? coro_worker_main
+                                                      : worker_thread_main;
+        if (pthread_create(&g_worker_threads[i], NULL, main_fn, &g_worker_ids[i]) != 0)
         {
             perror("pthread_create");
             exit(EXIT_FAILURE);
@@ -127,24 +620,160 @@ void init_thread_pool(int worker_count)
     }
     if (!is_logging_enabled())
     {
-        printf("Thread pool initialized with %d workers\n", worker_count);
+        printf("Thread pool initialized with %d workers", worker_count);
+        if (g_coroutines > 0)
+        {
+            printf(" x %d coroutines", g_coroutines);
+        }
+        if (bulk_worker_count > 0)
+        {
+            printf(" + %d bulk", bulk_worker_count);
+        }
+        printf("\n");
     }
 }
 
-void enqueue_client(int client_fd)
+int enqueue_client(const client_t *client)
+{
+    return client_queue_push(&g_client_queue, client, 0);
+}
+
+/* Shed connection: a best-effort 503 on plain HTTP, then close. Never blocks the producer. */
+void reject_client(const client_t *client)
 {
-    client_queue_push(&g_client_queue, client_fd);
+    static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                               "Retry-After: 1\r\n"
+                               "Content-Length: 0\r\n"
+                               "Connection: close\r\n"
+                               "\r\n";
+    if (!client->tls)
+    {
+        send(client->fd, busy, sizeof(busy) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+    close(client->fd);
 }
 
-#define LISTENQ 1024
+static int compare_groups_by_connections(const void *a, const void *b)
+{
+    const client_group_t *ga = *(client_group_t *const *)a;
+    const client_group_t *gb = *(client_group_t *const *)b;
+    return ga->connections < gb->connections ? 1 : ga->connections > gb->connections ? -1 : 0;
+}
 
-int create_socket_and_listen(int port)
+void print_client_queue_stats(const char *outfile)
 {
+    if (!g_fair.enabled)
+    {
+        return;
+    }
+
+    FILE *out = stdout;
+    if (outfile)
+    {
+        out = fopen(outfile, "a");
+        if (!out)
+        {
+            perror("Failed to open stats output file");
+            out = stdout;
+        }
+    }
+
+    client_queue_t *q = &g_client_queue;
+    client_group_t *groups[CLIENT_GROUPS];
+    int used = 0;
+    unsigned long shed_total = 0;
+    pthread_mutex_lock(&q->mutex);
+    for (int i = 0; i < CLIENT_GROUPS; i++)
+    {
+        if (q->groups[i].used)
+        {
+            groups[used++] = &q->groups[i];
+            shed_total += q->groups[i].shed;
+        }
+    }
+    qsort(groups, (size_t)used, sizeof(groups[0]), compare_groups_by_connections);
+
+    fprintf(out, "  Fair queue: %d clientes, %lu conexiones rechazadas (cap %d, cola/cliente %d)\n",
+            used, shed_total, g_fair.client_cap, g_fair.per_client_queue);
+    fprintf(out, "  %-24s %12s %10s %10s\n", "cliente", "conexiones", "pico cola", "rechazos");
+    for (int i = 0; i < used && i < CLIENT_REPORT_TOP; i++)
+    {
+        fprintf(out, "  %-24s %12lu %10d %10lu%s\n", groups[i]->label, groups[i]->connections,
+                groups[i]->peak_pending, groups[i]->shed, groups[i]->shared ? "  (bucket compartido)" : "");
+    }
+    pthread_mutex_unlock(&q->mutex);
+    fprintf(out, "\n");
+
+    if (outfile && out != stdout)
+    {
+        fclose(out);
+    }
+}
+
+int client_queue_depth(void)
+{
+    return atomic_load_explicit(&g_queue_depth, memory_order_relaxed);
+}
+
+static listen_options_t g_listen_options = {
+    .backlog = 1024,
+    .defer_accept_s = 5,
+    .fastopen_qlen = 256,
+};
+
+void set_listen_options(const listen_options_t *options)
+{
+    g_listen_options = *options;
+}
+
+/* Both options are best-effort: an unsupported kernel only costs the round trip they save. */
+static void apply_listen_options(int server_fd)
+{
+    if (g_listen_options.defer_accept_s > 0 &&
+        setsockopt(server_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &g_listen_options.defer_accept_s,
+                   sizeof(g_listen_options.defer_accept_s)) != 0)
+    {
+        perror("setsockopt TCP_DEFER_ACCEPT");
+    }
+
+    if (g_listen_options.fastopen_qlen > 0 &&
+        setsockopt(server_fd, IPPROTO_TCP, TCP_FASTOPEN, &g_listen_options.fastopen_qlen,
+                   sizeof(g_listen_options.fastopen_qlen)) != 0)
+    {
+        perror("setsockopt TCP_FASTOPEN");
+    }
+}
+
+static void listen_or_exit(int server_fd)
+{
+    if (listen(server_fd, g_listen_options.backlog) < 0)
+    {
+        perror("Failure in listen");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* A NULL address keeps the historical IPv4 wildcard; "::" or a literal picks the family. */
+int create_socket_and_listen(const char *address, int port)
+{
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+
+    struct addrinfo hints = {0};
+    hints.ai_family = address ? AF_UNSPEC : AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+    struct addrinfo *res = NULL;
+    int rc = getaddrinfo(address, port_str, &hints, &res);
+    if (rc != 0)
+    {
+        fprintf(stderr, "Invalid bind address %s: %s\n", address ? address : "*", gai_strerror(rc));
+        exit(EXIT_FAILURE);
+    }
+
     int server_fd;
-    struct sockaddr_in address;
     int opt = 1;
-
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0)
+    if ((server_fd = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
     {
         perror("Error while creating socket");
         exit(EXIT_FAILURE);
@@ -155,45 +784,88 @@ int create_socket_and_listen(int port)
         perror("Failure in setsockopt");
         exit(EXIT_FAILURE);
     }
+    apply_listen_options(server_fd);
 
-    memset(&address, 0, sizeof(address));
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = htonl(INADDR_ANY);
-    address.sin_port = htons((unsigned short)port);
-
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    if (bind(server_fd, res->ai_addr, res->ai_addrlen) < 0)
     {
         perror("Failure in bind, port may be in use");
         exit(EXIT_FAILURE);
     }
+    freeaddrinfo(res);
+    listen_or_exit(server_fd);
 
-    if (listen(server_fd, LISTENQ) < 0)
+    if (!is_logging_enabled())
     {
-        perror("Failure in listen");
+        printf("Server listening on %s:%d\n", address ? address : "*", port);
+    }
+    return server_fd;
+}
+
+/* Only a stale socket file is replaced; anything else at the path is an error. */
+int create_unix_listener(const char *path)
+{
+    struct sockaddr_un address = {0};
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "Unix socket path too long: %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        unlink(path);
+    }
+
+    int server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server_fd < 0)
+    {
+        perror("Error while creating unix socket");
+        exit(EXIT_FAILURE);
+    }
+    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        perror("Failure in bind of unix socket");
         exit(EXIT_FAILURE);
     }
+    listen_or_exit(server_fd);
 
     if (!is_logging_enabled())
     {
-        printf("Server listening on port %d\n", port);
+        printf("Server listening on unix:%s\n", path);
     }
     return server_fd;
 }
 
-int accept_connection(int server_fd)
+int accept_connection(int server_fd, client_t *client)
 {
     int new_socket;
-    struct sockaddr_in client_addr;
-    socklen_t addr_len = sizeof(client_addr);
+    client->peer_len = sizeof(client->peer);
+
+    do
+    {
+        new_socket = accept4(server_fd, (struct sockaddr *)&client->peer, &client->peer_len,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
+    } while (new_socket < 0 && errno == EINTR);
 
-    if ((new_socket = accept(server_fd, (struct sockaddr *)&client_addr, &addr_len)) < 0)
+    if (new_socket < 0)
     {
-        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED)
         {
-            perror("Failure in accept");
+            log_errno("Failure in accept");
         }
         return -1;
     }
 
+    /* Responses are already coalesced (writev / MSG_MORE), so Nagle would only add latency. */
+    if (client->peer.ss_family != AF_UNIX)
+    {
+        int nodelay = 1;
+        setsockopt(new_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    }
+
+    client->fd = new_socket;
     return new_socket;
-}
\ No newline at end of file
+}
@@ -1,54 +1,421 @@
 #include "stats.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
+#include <sys/mman.h>
 
-static server_stats_t g_stats = {0};
+/* One shard per process, in a MAP_SHARED segment so prefork children and the supervisor see the same counters. */
+static server_stats_t *g_shards = NULL;
+static int g_shard_count = 0;
+static server_stats_t *g_stats = NULL;
 
-void init_stats(void)
+static void init_shard(server_stats_t *shard)
 {
-    atomic_init(&g_stats.total_requests, 0);
-    atomic_init(&g_stats.successful_requests, 0);
-    atomic_init(&g_stats.failed_requests, 0);
-    atomic_init(&g_stats.aborted_requests, 0);
-    atomic_init(&g_stats.bytes_sent, 0);
-    atomic_init(&g_stats.total_turnaround_time_us, 0);
-    atomic_init(&g_stats.total_response_time_us, 0);
-    g_stats.start_time = time(NULL);
+    atomic_init(&shard->total_requests, 0);
+    atomic_init(&shard->successful_requests, 0);
+    atomic_init(&shard->failed_requests, 0);
+    atomic_init(&shard->aborted_requests, 0);
+    atomic_init(&shard->bytes_sent, 0);
+    atomic_init(&shard->total_turnaround_time_us, 0);
+    atomic_init(&shard->total_response_time_us, 0);
+    atomic_init(&shard->tls_handshakes, 0);
+    atomic_init(&shard->tls_resumed, 0);
+    atomic_init(&shard->tls_ktls, 0);
+    atomic_init(&shard->tls_failed, 0);
+    atomic_init(&shard->conn_objects, 0);
+    atomic_init(&shard->conn_bytes, 0);
+    atomic_init(&shard->arena_peak, 0);
+    atomic_init(&shard->accept_wakeups, 0);
+    atomic_init(&shard->accepted_connections, 0);
+    atomic_init(&shard->header_timeouts, 0);
+    atomic_init(&shard->header_slow, 0);
+    atomic_init(&shard->process_respawns, 0);
+    atomic_init(&shard->coro_peak, 0);
+    atomic_init(&shard->coro_offloads, 0);
+    for (int k = 0; k < BLOCK_LOOKUP_COUNT; k++)
+    {
+        atomic_init(&shard->block_lookups[k], 0);
+    }
+    atomic_init(&shard->block_evictions, 0);
+    atomic_init(&shard->peer_fetches, 0);
+    atomic_init(&shard->peer_fetch_failures, 0);
+    atomic_init(&shard->peer_fetch_bytes, 0);
+    atomic_init(&shard->peer_requests, 0);
+    atomic_init(&shard->hot_routes, 0);
+    for (int k = 0; k < SYSCALL_KIND_COUNT; k++)
+    {
+        atomic_init(&shard->syscalls[k], 0);
+    }
+    for (int p = 0; p < PHASE_COUNT; p++)
+    {
+        for (int b = 0; b < LATENCY_BUCKETS; b++)
+        {
+            atomic_init(&shard->phases[p].buckets[b], 0);
+        }
+        atomic_init(&shard->phases[p].count, 0);
+        atomic_init(&shard->phases[p].sum_us, 0);
+    }
+    for (int c = 0; c < SIZE_CLASS_COUNT; c++)
+    {
+        for (int b = 0; b < LATENCY_BUCKETS; b++)
+        {
+            atomic_init(&shard->size_classes[c].buckets[b], 0);
+        }
+        atomic_init(&shard->size_classes[c].count, 0);
+        atomic_init(&shard->size_classes[c].sum_us, 0);
+    }
+    for (int b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        atomic_init(&shard->turnaround.buckets[b], 0);
+    }
+    atomic_init(&shard->turnaround.count, 0);
+    atomic_init(&shard->turnaround.sum_us, 0);
+    shard->start_time = time(NULL);
+}
+
+void init_stats(int shards)
+{
+    g_shards = mmap(NULL, (size_t)shards * sizeof(server_stats_t), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (g_shards == MAP_FAILED)
+    {
+        perror("Failed to map stats segment");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < shards; i++)
+    {
+        init_shard(&g_shards[i]);
+    }
+    g_shard_count = shards;
+    g_stats = &g_shards[0];
+}
+
+void stats_use_shard(int index)
+{
+    g_stats = &g_shards[index];
 }
 
 void increment_requests(void)
 {
-    atomic_fetch_add(&g_stats.total_requests, 1);
+    atomic_fetch_add(&g_stats->total_requests, 1);
 }
 
 void increment_successful(void)
 {
-    atomic_fetch_add(&g_stats.successful_requests, 1);
+    atomic_fetch_add(&g_stats->successful_requests, 1);
 }
 
 void increment_failed(void)
 {
-    atomic_fetch_add(&g_stats.failed_requests, 1);
+    atomic_fetch_add(&g_stats->failed_requests, 1);
 }
 
 void increment_aborted(void)
 {
-    atomic_fetch_add(&g_stats.aborted_requests, 1);
+    atomic_fetch_add(&g_stats->aborted_requests, 1);
 }
 
 void add_bytes_sent(unsigned long bytes)
 {
-    atomic_fetch_add(&g_stats.bytes_sent, bytes);
+    atomic_fetch_add(&g_stats->bytes_sent, bytes);
 }
 
+static void histogram_add(latency_histogram_t *h, unsigned long long microseconds);
+
 void add_turnaround_time(unsigned long long microseconds)
 {
-    atomic_fetch_add(&g_stats.total_turnaround_time_us, microseconds);
+    atomic_fetch_add(&g_stats->total_turnaround_time_us, microseconds);
+    histogram_add(&g_stats->turnaround, microseconds);
 }
 
 void add_response_time(unsigned long long microseconds)
 {
-    atomic_fetch_add(&g_stats.total_response_time_us, microseconds);
+    atomic_fetch_add(&g_stats->total_response_time_us, microseconds);
+}
+
+void record_tls_handshake(int resumed, int ktls)
+{
+    atomic_fetch_add(&g_stats->tls_handshakes, 1);
+    if (resumed)
+    {
+        atomic_fetch_add(&g_stats->tls_resumed, 1);
+    }
+    if (ktls)
+    {
+        atomic_fetch_add(&g_stats->tls_ktls, 1);
+    }
+}
+
+void increment_tls_failed(void)
+{
+    atomic_fetch_add(&g_stats->tls_failed, 1);
+}
+
+void add_conn_objects(unsigned long count, unsigned long long bytes_each)
+{
+    atomic_fetch_add(&g_stats->conn_objects, count);
+    atomic_fetch_add(&g_stats->conn_bytes, count * bytes_each);
+}
+
+static void store_max(atomic_ulong *target, unsigned long value)
+{
+    unsigned long current = atomic_load_explicit(target, memory_order_relaxed);
+    while (value > current &&
+           !atomic_compare_exchange_weak_explicit(target, &current, value,
+                                                  memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+}
+
+void update_arena_peak(unsigned long bytes)
+{
+    store_max(&g_stats->arena_peak, bytes);
+}
+
+/* Highest number of live coroutines seen on any one worker. */
+void update_coro_peak(unsigned long active)
+{
+    store_max(&g_stats->coro_peak, active);
+}
+
+void increment_coro_offloads(void)
+{
+    atomic_fetch_add_explicit(&g_stats->coro_offloads, 1, memory_order_relaxed);
+}
+
+void record_block_lookup(block_lookup_t outcome)
+{
+    atomic_fetch_add_explicit(&g_stats->block_lookups[outcome], 1, memory_order_relaxed);
+}
+
+void record_block_eviction(void)
+{
+    atomic_fetch_add_explicit(&g_stats->block_evictions, 1, memory_order_relaxed);
+}
+
+void record_peer_fetch(int ok, unsigned long bytes)
+{
+    atomic_fetch_add_explicit(ok ? &g_stats->peer_fetches : &g_stats->peer_fetch_failures, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_stats->peer_fetch_bytes, bytes, memory_order_relaxed);
+}
+
+void record_peer_request(void)
+{
+    atomic_fetch_add_explicit(&g_stats->peer_requests, 1, memory_order_relaxed);
+}
+
+void record_hot_route(void)
+{
+    atomic_fetch_add_explicit(&g_stats->hot_routes, 1, memory_order_relaxed);
+}
+
+void record_accept_batch(unsigned long accepted)
+{
+    atomic_fetch_add(&g_stats->accept_wakeups, 1);
+    atomic_fetch_add(&g_stats->accepted_connections, accepted);
+}
+
+void record_header_timeout(int below_min_rate)
+{
+    atomic_fetch_add(&g_stats->header_timeouts, 1);
+    if (below_min_rate)
+    {
+        atomic_fetch_add(&g_stats->header_slow, 1);
+    }
+}
+
+void record_respawn(void)
+{
+    atomic_fetch_add(&g_stats->process_respawns, 1);
+}
+
+void add_syscalls(const unsigned long counts[SYSCALL_KIND_COUNT])
+{
+    for (int k = 0; k < SYSCALL_KIND_COUNT; k++)
+    {
+        if (counts[k])
+        {
+            atomic_fetch_add_explicit(&g_stats->syscalls[k], counts[k], memory_order_relaxed);
+        }
+    }
+}
+
+static int latency_bucket(unsigned long long microseconds)
+{
+    int bucket = 0;
+    while (microseconds > 0 && bucket < LATENCY_BUCKETS - 1)
+    {
+        microseconds >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static void histogram_add(latency_histogram_t *h, unsigned long long microseconds)
+{
+    atomic_fetch_add_explicit(&h->buckets[latency_bucket(microseconds)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_us, microseconds, memory_order_relaxed);
+}
+
+void add_phase_sample(phase_t phase, unsigned long long microseconds)
+{
+    histogram_add(&g_stats->phases[phase], microseconds);
+}
+
+void add_size_class_sample(size_class_t size_class, unsigned long long microseconds)
+{
+    histogram_add(&g_stats->size_classes[size_class], microseconds);
+}
+
+/* Relaxed reads only: used by the dashboard renderer, never by the request path. */
+void stats_snapshot(stats_snapshot_t *snap)
+{
+    snap->requests = 0;
+    snap->bytes_sent = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        snap->turnaround_buckets[b] = 0;
+    }
+    for (int i = 0; i < g_shard_count; i++)
+    {
+        server_stats_t *shard = &g_shards[i];
+        snap->requests += atomic_load_explicit(&shard->total_requests, memory_order_relaxed);
+        snap->bytes_sent += atomic_load_explicit(&shard->bytes_sent, memory_order_relaxed);
+        for (int b = 0; b < LATENCY_BUCKETS; b++)
+        {
+            snap->turnaround_buckets[b] += atomic_load_explicit(&shard->turnaround.buckets[b], memory_order_relaxed);
+        }
+    }
+}
+
+/* Upper bound of the bucket holding the given percentile. */
+unsigned long long histogram_percentile(const unsigned long long *buckets, unsigned long long count, double pct)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    unsigned long long target = (unsigned long long)(count * pct / 100.0);
+    if (target >= count)
+    {
+        target = count - 1;
+    }
+    unsigned long long seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        seen += buckets[b];
+        if (seen > target)
+        {
+            return 1ULL << b;
+        }
+    }
+    return 1ULL << (LATENCY_BUCKETS - 1);
+}
+
+static const char *phase_names[PHASE_COUNT] = {
+    "accept->enqueue", "queue wait", "read+parse", "open", "first byte", "transfer", "total"};
+
+static const char *size_class_names[SIZE_CLASS_COUNT] = {"pool small", "pool bulk"};
+
+static void merge_histogram(latency_histogram_t *dst, latency_histogram_t *src)
+{
+    for (int b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        atomic_fetch_add(&dst->buckets[b], atomic_load(&src->buckets[b]));
+    }
+    atomic_fetch_add(&dst->count, atomic_load(&src->count));
+    atomic_fetch_add(&dst->sum_us, atomic_load(&src->sum_us));
+}
+
+#define MERGE_COUNTER(field) atomic_fetch_add(&total->field, atomic_load(&shard->field))
+
+/* Folds every process shard into one private copy for reporting; the peaks are a max, not a sum. */
+static void merge_shards(server_stats_t *total)
+{
+    init_shard(total);
+    total->start_time = g_shards[0].start_time;
+    for (int i = 0; i < g_shard_count; i++)
+    {
+        server_stats_t *shard = &g_shards[i];
+        MERGE_COUNTER(total_requests);
+        MERGE_COUNTER(successful_requests);
+        MERGE_COUNTER(failed_requests);
+        MERGE_COUNTER(aborted_requests);
+        MERGE_COUNTER(bytes_sent);
+        MERGE_COUNTER(total_turnaround_time_us);
+        MERGE_COUNTER(total_response_time_us);
+        MERGE_COUNTER(tls_handshakes);
+        MERGE_COUNTER(tls_resumed);
+        MERGE_COUNTER(tls_ktls);
+        MERGE_COUNTER(tls_failed);
+        MERGE_COUNTER(conn_objects);
+        MERGE_COUNTER(conn_bytes);
+        MERGE_COUNTER(accept_wakeups);
+        MERGE_COUNTER(accepted_connections);
+        MERGE_COUNTER(header_timeouts);
+        MERGE_COUNTER(header_slow);
+        MERGE_COUNTER(process_respawns);
+        MERGE_COUNTER(coro_offloads);
+        MERGE_COUNTER(block_evictions);
+        MERGE_COUNTER(peer_fetches);
+        MERGE_COUNTER(peer_fetch_failures);
+        MERGE_COUNTER(peer_fetch_bytes);
+        MERGE_COUNTER(peer_requests);
+        MERGE_COUNTER(hot_routes);
+        for (int k = 0; k < BLOCK_LOOKUP_COUNT; k++)
+        {
+            MERGE_COUNTER(block_lookups[k]);
+        }
+        for (int k = 0; k < SYSCALL_KIND_COUNT; k++)
+        {
+            MERGE_COUNTER(syscalls[k]);
+        }
+        store_max(&total->arena_peak, atomic_load(&shard->arena_peak));
+        store_max(&total->coro_peak, atomic_load(&shard->coro_peak));
+        for (int p = 0; p < PHASE_COUNT; p++)
+        {
+            merge_histogram(&total->phases[p], &shard->phases[p]);
+        }
+        for (int c = 0; c < SIZE_CLASS_COUNT; c++)
+        {
+            merge_histogram(&total->size_classes[c], &shard->size_classes[c]);
+        }
+        merge_histogram(&total->turnaround, &shard->turnaround);
+    }
+}
+
+static void print_histogram_row(FILE *out, const char *name, latency_histogram_t *h)
+{
+    unsigned long long buckets[LATENCY_BUCKETS];
+    for (int b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        buckets[b] = atomic_load(&h->buckets[b]);
+    }
+    unsigned long long count = atomic_load(&h->count);
+    unsigned long long sum = atomic_load(&h->sum_us);
+    if (count == 0)
+    {
+        return;
+    }
+    fprintf(out, "  %-16s %10llu %10.3f %10.3f %10.3f %10.3f\n", name, count,
+            sum / (double)count / 1000.0,
+            histogram_percentile(buckets, count, 50) / 1000.0,
+            histogram_percentile(buckets, count, 90) / 1000.0,
+            histogram_percentile(buckets, count, 99) / 1000.0);
+}
+
+static void print_phase_table(FILE *out, server_stats_t *total)
+{
+    fprintf(out, "  %-16s %10s %10s %10s %10s %10s\n", "Phase", "count", "avg ms", "p50 ms", "p90 ms", "p99 ms");
+    for (int p = 0; p < PHASE_COUNT; p++)
+    {
+        print_histogram_row(out, phase_names[p], &total->phases[p]);
+    }
+    for (int c = 0; c < SIZE_CLASS_COUNT; c++)
+    {
+        print_histogram_row(out, size_class_names[c], &total->size_classes[c]);
+    }
 }
 
 void print_stats(const char *outfile)
@@ -64,15 +431,19 @@ void print_stats(const char *outfile)
         }
     }
 
+    static server_stats_t merged;
+    server_stats_t *all = &merged;
+    merge_shards(all);
+
     time_t end_time = time(NULL);
-    double uptime = difftime(end_time, g_stats.start_time);
+    double uptime = difftime(end_time, all->start_time);
 
-    unsigned long total = atomic_load(&g_stats.total_requests);
-    unsigned long successful = atomic_load(&g_stats.successful_requests);
-    unsigned long failed = atomic_load(&g_stats.failed_requests);
-    unsigned long long bytes = atomic_load(&g_stats.bytes_sent);
-    unsigned long long total_turnaround_us = atomic_load(&g_stats.total_turnaround_time_us);
-    unsigned long long total_response_us = atomic_load(&g_stats.total_response_time_us);
+    unsigned long total = atomic_load(&all->total_requests);
+    unsigned long successful = atomic_load(&all->successful_requests);
+    unsigned long failed = atomic_load(&all->failed_requests);
+    unsigned long long bytes = atomic_load(&all->bytes_sent);
+    unsigned long long total_turnaround_us = atomic_load(&all->total_turnaround_time_us);
+    unsigned long long total_response_us = atomic_load(&all->total_response_time_us);
 
     double avg_turnaround_ms = (total > 0) ? (total_turnaround_us / (double)total) / 1000.0 : 0.0;
     double avg_response_ms = (total > 0) ? (total_response_us / (double)total) / 1000.0 : 0.0;
@@ -82,10 +453,15 @@ void print_stats(const char *outfile)
     fprintf(out, "                   SERVER STATISTICS                       \n");
     fprintf(out, "═══════════════════════════════════════════════════════════\n");
     fprintf(out, "  Uptime:              %.0f seconds\n", uptime);
+    if (g_shard_count > 1)
+    {
+        fprintf(out, "  Processes:           %d (respawned %lu)\n", g_shard_count,
+                atomic_load(&all->process_respawns));
+    }
     fprintf(out, "  Total Requests:      %lu\n", total);
     fprintf(out, "  Successful:          %lu\n", successful);
     fprintf(out, "  Failed:              %lu\n", failed);
-    unsigned long aborted = atomic_load(&g_stats.aborted_requests);
+    unsigned long aborted = atomic_load(&all->aborted_requests);
     fprintf(out, "  Aborted (Client):    %lu\n", aborted);
     fprintf(out, "  Bytes Sent:          %llu (%.2f MB)\n", bytes, bytes / 1024.0 / 1024.0);
     if (uptime > 0)
@@ -95,6 +471,64 @@ void print_stats(const char *outfile)
     }
     fprintf(out, "  Avg Turnaround Time: %.2f ms\n", avg_turnaround_ms);
     fprintf(out, "  Avg Response Time:   %.2f ms\n", avg_response_ms);
+    unsigned long long conn_bytes = atomic_load(&all->conn_bytes);
+    fprintf(out, "  Conn Objects:        %lu (%.1f KB), peak arena %lu bytes\n",
+            atomic_load(&all->conn_objects), conn_bytes / 1024.0, atomic_load(&all->arena_peak));
+    unsigned long wakeups = atomic_load(&all->accept_wakeups);
+    unsigned long accepted = atomic_load(&all->accepted_connections);
+    fprintf(out, "  Accepted:            %lu (%.2f per wakeup)\n",
+            accepted, wakeups ? (double)accepted / wakeups : 0.0);
+    unsigned long coro_peak = atomic_load(&all->coro_peak);
+    if (coro_peak > 0)
+    {
+        fprintf(out, "  Coroutines:          peak %lu per worker (file reads offloaded %lu)\n", coro_peak,
+                atomic_load(&all->coro_offloads));
+    }
+    unsigned long block_hits = atomic_load(&all->block_lookups[BLOCK_LOOKUP_HIT]);
+    unsigned long block_lookups = block_hits + atomic_load(&all->block_lookups[BLOCK_LOOKUP_MISS]) +
+                                  atomic_load(&all->block_lookups[BLOCK_LOOKUP_BYPASS]);
+    if (block_lookups > 0)
+    {
+        fprintf(out, "  Block Cache:         %.1f%% hits (%lu hit, %lu miss, %lu bypass), %lu evictions\n",
+                100.0 * block_hits / block_lookups, block_hits, atomic_load(&all->block_lookups[BLOCK_LOOKUP_MISS]),
+                atomic_load(&all->block_lookups[BLOCK_LOOKUP_BYPASS]), atomic_load(&all->block_evictions));
+    }
+    unsigned long peer_fetches = atomic_load(&all->peer_fetches);
+    unsigned long peer_failures = atomic_load(&all->peer_fetch_failures);
+    unsigned long peer_requests = atomic_load(&all->peer_requests);
+    if (peer_fetches > 0 || peer_failures > 0 || peer_requests > 0)
+    {
+        fprintf(out, "  Cluster:             fetched %lu blocks (%.2f MB, failed %lu), served %lu to peers, "
+                     "hot routes %lu\n",
+                peer_fetches, atomic_load(&all->peer_fetch_bytes) / 1024.0 / 1024.0, peer_failures, peer_requests,
+                atomic_load(&all->hot_routes));
+    }
+    unsigned long header_timeouts = atomic_load(&all->header_timeouts);
+    if (header_timeouts > 0)
+    {
+        fprintf(out, "  Header Timeouts:     %lu (below min rate %lu)\n", header_timeouts,
+                atomic_load(&all->header_slow));
+    }
+    unsigned long long sys[SYSCALL_KIND_COUNT];
+    unsigned long long sys_total = 0;
+    for (int k = 0; k < SYSCALL_KIND_COUNT; k++)
+    {
+        sys[k] = atomic_load(&all->syscalls[k]);
+        sys_total += sys[k];
+    }
+    double per_req = total > 0 ? 1.0 / total : 0.0;
+    fprintf(out, "  Syscalls/Request:    %.2f (read %.2f, write %.2f, file %.2f, wait %.2f)\n",
+            sys_total * per_req, sys[SYSCALL_READ] * per_req, sys[SYSCALL_WRITE] * per_req,
+            sys[SYSCALL_FILE] * per_req, sys[SYSCALL_WAIT] * per_req);
+    unsigned long handshakes = atomic_load(&all->tls_handshakes);
+    unsigned long tls_failed = atomic_load(&all->tls_failed);
+    if (handshakes > 0 || tls_failed > 0)
+    {
+        fprintf(out, "  TLS Handshakes:      %lu (resumed %lu, kTLS %lu, failed %lu)\n", handshakes,
+                atomic_load(&all->tls_resumed), atomic_load(&all->tls_ktls), tls_failed);
+    }
+    fprintf(out, "───────────────────────────────────────────────────────────\n");
+    print_phase_table(out, all);
     fprintf(out, "═══════════════════════════════════════════════════════════\n");
     fprintf(out, "\n");
 
@@ -0,0 +1,246 @@
+#include "tls.h"
+#include <stdio.h>
+#include <errno.h>
+#include "stats.h"
+#include "io.h"
+
+#ifdef HAVE_OPENSSL
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#define TLS_SESSION_CACHE_SIZE 20480
+#define TLS_TICKETS_PER_HANDSHAKE 2
+
+static SSL_CTX *g_ctx = NULL;
+static const unsigned char g_session_id_ctx[] = "happytree";
+
+static const unsigned char g_alpn_protocols[] = "\x02h2\x08http/1.1";
+
+/* Parks on the socket when a nonblocking SSL call needs more I/O; -1 means give up. */
+static int wait_for_ssl(client_t *client, SSL *ssl, int ret)
+{
+    switch (SSL_get_error(ssl, ret))
+    {
+    case SSL_ERROR_WANT_READ:
+        return io_wait(client, POLLIN, IO_WAIT_TIMEOUT_MS);
+    case SSL_ERROR_WANT_WRITE:
+        return io_wait(client, POLLOUT, IO_WAIT_TIMEOUT_MS);
+    case SSL_ERROR_SYSCALL:
+        if (errno == 0)
+        {
+            errno = ECONNRESET;
+        }
+        int saved_errno = errno;
+        ERR_clear_error();
+        errno = saved_errno;
+        return -1;
+    default:
+        /* The error queue is per thread; with coroutines a stale entry would fail another connection. */
+        ERR_clear_error();
+        return -1;
+    }
+}
+
+static int select_alpn(SSL *ssl, const unsigned char **out, unsigned char *outlen,
+                       const unsigned char *in, unsigned int inlen, void *arg)
+{
+    (void)ssl;
+    (void)arg;
+    if (SSL_select_next_proto((unsigned char **)out, outlen, g_alpn_protocols,
+                              sizeof(g_alpn_protocols) - 1, in, inlen) != OPENSSL_NPN_NEGOTIATED)
+    {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    return SSL_TLSEXT_ERR_OK;
+}
+
+int init_tls(const char *cert_file, const char *key_file)
+{
+    g_ctx = SSL_CTX_new(TLS_server_method());
+    if (!g_ctx)
+    {
+        ERR_print_errors_fp(stderr);
+        return -1;
+    }
+
+    SSL_CTX_set_min_proto_version(g_ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(g_ctx, SSL_OP_ENABLE_KTLS | SSL_OP_NO_RENEGOTIATION);
+
+    /* Resumption: stateful cache for TLS 1.2 ids, stateless tickets for 1.3. */
+    SSL_CTX_set_session_id_context(g_ctx, g_session_id_ctx, sizeof(g_session_id_ctx) - 1);
+    SSL_CTX_set_session_cache_mode(g_ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(g_ctx, TLS_SESSION_CACHE_SIZE);
+    SSL_CTX_set_num_tickets(g_ctx, TLS_TICKETS_PER_HANDSHAKE);
+    SSL_CTX_set_alpn_select_cb(g_ctx, select_alpn, NULL);
+
+    if (SSL_CTX_use_certificate_chain_file(g_ctx, cert_file) <= 0 ||
+        SSL_CTX_use_PrivateKey_file(g_ctx, key_file, SSL_FILETYPE_PEM) <= 0 ||
+        !SSL_CTX_check_private_key(g_ctx))
+    {
+        ERR_print_errors_fp(stderr);
+        SSL_CTX_free(g_ctx);
+        g_ctx = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int is_tls_enabled(void)
+{
+    return g_ctx != NULL;
+}
+
+int tls_accept(client_t *client)
+{
+    SSL *ssl = SSL_new(g_ctx);
+    if (!ssl)
+    {
+        return -1;
+    }
+    SSL_set_fd(ssl, client->fd);
+
+    int ret;
+    while ((ret = SSL_accept(ssl)) <= 0 && wait_for_ssl(client, ssl, ret) == 0)
+    {
+    }
+    if (ret <= 0)
+    {
+        ERR_clear_error();
+        SSL_free(ssl);
+        increment_tls_failed();
+        return -1;
+    }
+
+    client->ssl = ssl;
+    client->ktls_send = BIO_get_ktls_send(SSL_get_wbio(ssl)) ? 1 : 0;
+
+    const unsigned char *alpn = NULL;
+    unsigned int alpn_len = 0;
+    SSL_get0_alpn_selected(ssl, &alpn, &alpn_len);
+    client->alpn_h2 = (alpn_len == 2 && alpn[0] == 'h' && alpn[1] == '2');
+    record_tls_handshake(SSL_session_reused(ssl), client->ktls_send);
+    return 0;
+}
+
+int tls_pending(client_t *client)
+{
+    return SSL_pending((SSL *)client->ssl) > 0;
+}
+
+ssize_t tls_read(client_t *client, void *buf, size_t len)
+{
+    SSL *ssl = (SSL *)client->ssl;
+    size_t n = 0;
+    int ret;
+    while ((ret = SSL_read_ex(ssl, buf, len, &n)) <= 0)
+    {
+        if (wait_for_ssl(client, ssl, ret) != 0)
+        {
+            return -1;
+        }
+    }
+    return (ssize_t)n;
+}
+
+ssize_t tls_write(client_t *client, const void *buf, size_t len)
+{
+    SSL *ssl = (SSL *)client->ssl;
+    size_t n = 0;
+    int ret;
+    while ((ret = SSL_write_ex(ssl, buf, len, &n)) <= 0)
+    {
+        if (wait_for_ssl(client, ssl, ret) != 0)
+        {
+            return -1;
+        }
+    }
+    return (ssize_t)n;
+}
+
+ssize_t tls_sendfile(client_t *client, int file_fd, off_t offset, size_t len)
+{
+    SSL *ssl = (SSL *)client->ssl;
+    ossl_ssize_t n;
+    while ((n = SSL_sendfile(ssl, file_fd, offset, len, 0)) <= 0)
+    {
+        if (wait_for_ssl(client, ssl, (int)n) != 0)
+        {
+            return -1;
+        }
+    }
+    return (ssize_t)n;
+}
+
+void tls_close(client_t *client)
+{
+    if (!client->ssl)
+    {
+        return;
+    }
+    SSL_shutdown((SSL *)client->ssl);
+    SSL_free((SSL *)client->ssl);
+    client->ssl = NULL;
+}
+
+#else
+
+int init_tls(const char *cert_file, const char *key_file)
+{
+    (void)cert_file;
+    (void)key_file;
+    fprintf(stderr, "TLS support not compiled in (build with TLS=1)\n");
+    return -1;
+}
+
+int is_tls_enabled(void)
+{
+    return 0;
+}
+
+int tls_accept(client_t *client)
+{
+    (void)client;
+    return -1;
+}
+
+int tls_pending(client_t *client)
+{
+    (void)client;
+    return 0;
+}
+
+ssize_t tls_read(client_t *client, void *buf, size_t len)
+{
+    (void)client;
+    (void)buf;
+    (void)len;
+    errno = EOPNOTSUPP;
+    return -1;
+}
+
+ssize_t tls_write(client_t *client, const void *buf, size_t len)
+{
+    (void)client;
+    (void)buf;
+    (void)len;
+    errno = EOPNOTSUPP;
+    return -1;
+}
+
+ssize_t tls_sendfile(client_t *client, int file_fd, off_t offset, size_t len)
+{
+    (void)client;
+    (void)file_fd;
+    (void)offset;
+    (void)len;
+    errno = EOPNOTSUPP;
+    return -1;
+}
+
+void tls_close(client_t *client)
+{
+    (void)client;
+}
+
+#endif
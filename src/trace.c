@@ -0,0 +1,104 @@
+#include "trace.h"
+#include <stdio.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include "logger.h"
+#include "stats.h"
+
+static unsigned long long g_slow_threshold_ns = 0;
+static unsigned int g_sample_every = 1;
+static atomic_uint g_slow_seen;
+
+static const char *point_names[TRACE_POINT_COUNT] = {
+    "accept", "enqueue", "dequeue", "parse", "open", "first_byte", "last_byte"};
+
+uint64_t trace_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void init_trace(unsigned long slow_threshold_us, unsigned int sample_every)
+{
+    g_slow_threshold_ns = (unsigned long long)slow_threshold_us * 1000ULL;
+    g_sample_every = sample_every > 0 ? sample_every : 1;
+    atomic_init(&g_slow_seen, 0);
+}
+
+static const trace_point_t phase_bounds[PHASE_COUNT][2] = {
+    [PHASE_ENQUEUE] = {TRACE_ACCEPT, TRACE_ENQUEUE},
+    [PHASE_QUEUE_WAIT] = {TRACE_ENQUEUE, TRACE_DEQUEUE},
+    [PHASE_READ_PARSE] = {TRACE_DEQUEUE, TRACE_PARSE_DONE},
+    [PHASE_OPEN] = {TRACE_PARSE_DONE, TRACE_FILE_OPEN},
+    [PHASE_FIRST_BYTE] = {TRACE_FILE_OPEN, TRACE_FIRST_BYTE},
+    [PHASE_TRANSFER] = {TRACE_FIRST_BYTE, TRACE_LAST_BYTE},
+    [PHASE_TOTAL] = {TRACE_ACCEPT, TRACE_LAST_BYTE},
+};
+
+static int phase_valid(const request_trace_t *trace, phase_t phase)
+{
+    uint64_t a = trace->ts_ns[phase_bounds[phase][0]];
+    uint64_t b = trace->ts_ns[phase_bounds[phase][1]];
+    return a != 0 && b != 0 && b >= a;
+}
+
+unsigned long long trace_phase_us(const request_trace_t *trace, phase_t phase)
+{
+    if (!phase_valid(trace, phase))
+    {
+        return 0;
+    }
+    return (trace->ts_ns[phase_bounds[phase][1]] - trace->ts_ns[phase_bounds[phase][0]]) / 1000ULL;
+}
+
+static void emit_slow_trace(const request_trace_t *trace, int client_fd, const char *path)
+{
+    char line[512];
+    int len = snprintf(line, sizeof(line), "[slow] fd=%d path=%s total=%.3fms",
+                       client_fd, path ? path : "-",
+                       (trace->ts_ns[TRACE_LAST_BYTE] - trace->ts_ns[TRACE_ACCEPT]) / 1e6);
+
+    uint64_t prev = trace->ts_ns[TRACE_ACCEPT];
+    for (int i = TRACE_ENQUEUE; i < TRACE_POINT_COUNT && len < (int)sizeof(line); i++)
+    {
+        if (trace->ts_ns[i] == 0)
+        {
+            continue;
+        }
+        len += snprintf(line + len, sizeof(line) - (size_t)len, " %s=+%.3fms",
+                        point_names[i], (trace->ts_ns[i] - prev) / 1e6);
+        prev = trace->ts_ns[i];
+    }
+    if (len >= (int)sizeof(line))
+    {
+        len = (int)sizeof(line) - 1;
+    }
+    line[len++] = '\n';
+    log_write(STDERR_FILENO, line, (size_t)len);
+}
+
+void trace_finish(const request_trace_t *trace, int client_fd, const char *path)
+{
+    for (int p = 0; p < PHASE_COUNT; p++)
+    {
+        if (phase_valid(trace, (phase_t)p))
+        {
+            add_phase_sample((phase_t)p, trace_phase_us(trace, (phase_t)p));
+        }
+    }
+
+    if (g_slow_threshold_ns == 0 || trace->ts_ns[TRACE_ACCEPT] == 0 || trace->ts_ns[TRACE_LAST_BYTE] == 0)
+    {
+        return;
+    }
+    if (trace->ts_ns[TRACE_LAST_BYTE] - trace->ts_ns[TRACE_ACCEPT] < g_slow_threshold_ns)
+    {
+        return;
+    }
+    if (atomic_fetch_add_explicit(&g_slow_seen, 1, memory_order_relaxed) % g_sample_every == 0)
+    {
+        emit_slow_trace(trace, client_fd, path);
+    }
+}
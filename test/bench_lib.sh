@@ -0,0 +1,98 @@
+#!/bin/bash
+
+# Piezas comunes de los test/*_bench.sh; se cargan con `source` desde la raíz del repo.
+#
+# Cada script define su tabla de casos con run_case y, si hace falta, reemplaza:
+#   bench_load [args...]  la carga de un caso (por defecto bin/replay sobre la captura)
+#   bench_report LABEL    el resumen de un caso (por defecto las líneas de REPORT_PATTERN)
+# Variables opcionales: PORT, SERVER_ARGS (antes de los argumentos de cada caso), REPLAY_THREADS,
+# REPORT_PATTERN y BENCH_FILES (archivos o globs que se borran al salir).
+
+PORT="${PORT:-8001}"
+SERVER_ARGS=()
+REPLAY_THREADS=64
+REPORT_PATTERN=""
+BENCH_FILES=""
+WORKDIR="$(mktemp -d)"
+CAPTURE="${WORKDIR}/capture.jsonl"
+declare -A SERVER_PIDS=()
+declare -A SERVER_CTLS=()
+
+bench_cleanup() {
+    [ ${#SERVER_PIDS[@]} -gt 0 ] && kill "${SERVER_PIDS[@]}" 2>/dev/null
+    [ -n "$BENCH_FILES" ] && rm -f $BENCH_FILES
+    rm -rf "$WORKDIR"
+}
+trap bench_cleanup EXIT
+
+# Una línea de captura para bin/replay: conexión, ruta (sin "/") y Range opcional.
+capture_line() {
+    printf '{"t_us":0,"gap_us":0,"conn":%d,"method":"GET","path":"/%s","range":"%s"}\n' "$1" "$2" "${3:-}"
+}
+
+# gen_capture CONEXIONES PETICIONES_POR_CONEXION ARCHIVO...: reparte los archivos en ronda.
+gen_capture() {
+    local connections="$1" per_conn="$2"
+    shift 2
+    local files=("$@")
+
+    echo "[*] Generando captura: ${connections} conexiones x ${per_conn} peticiones"
+    for c in $(seq 1 "$connections"); do
+        for r in $(seq 1 "$per_conn"); do
+            capture_line "$c" "${files[$(((c + r) % ${#files[@]}))]}"
+        done
+    done > "$CAPTURE"
+}
+
+# start_server NOMBRE ARGS...: el servidor lee "q" de un FIFO y escribe en ${WORKDIR}/NOMBRE.out.
+start_server() {
+    local name="$1" fd
+    shift
+
+    rm -f "${WORKDIR}/${name}.ctl"
+    mkfifo "${WORKDIR}/${name}.ctl"
+    ./bin/server "$@" < "${WORKDIR}/${name}.ctl" > "${WORKDIR}/${name}.out" 2>&1 &
+    SERVER_PIDS[$name]=$!
+    exec {fd}> "${WORKDIR}/${name}.ctl"
+    SERVER_CTLS[$name]=$fd
+    sleep 0.5
+}
+
+# stop_server NOMBRE: pide la salida ordenada para que imprima sus estadísticas.
+stop_server() {
+    local name="$1"
+    local fd="${SERVER_CTLS[$name]}"
+
+    echo q >&"$fd"
+    exec {fd}>&-
+    wait "${SERVER_PIDS[$name]}" || true
+    unset "SERVER_PIDS[$name]" "SERVER_CTLS[$name]"
+}
+
+bench_load() {
+    [ $# -gt 0 ] || set -- -p "$PORT"
+    ./bin/replay -s max -t "$REPLAY_THREADS" "$@" "$CAPTURE" | sed 's/^/      /'
+}
+
+bench_report() {
+    [ -n "$REPORT_PATTERN" ] && grep -E "$REPORT_PATTERN" "${WORKDIR}/bench.out" | sed 's/^/    /'
+    return 0
+}
+
+# run_case ETIQUETA [ARGS_SERVIDOR...] [-- ARGS_CARGA...]
+run_case() {
+    local label="$1"
+    shift
+    local server_args=()
+    while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+        server_args+=("$1")
+        shift
+    done
+    [ "${1:-}" = "--" ] && shift
+
+    start_server bench "${SERVER_ARGS[@]}" "${server_args[@]}"
+    echo "[*] ${label}"
+    bench_load "$@"
+    stop_server bench
+    bench_report "$label"
+}
@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# Muchos espectadores piden rangos solapados de 1 MB de un mismo video "caliente" mientras otras
+# conexiones recorren de punta a punta un archivo grande (un scan). Compara el camino normal, el
+# drop-behind (--uncached) y el drop-behind con la caché de bloques, y muestra la tasa de aciertos:
+# el scan no debería desalojar los bloques del video caliente.
+#
+# Uso: test/block_cache_bench.sh [MB_cache] [espectadores] [peticiones_por_espectador] [MB_scan]
+
+set -e
+source "$(dirname "$0")/bench_lib.sh"
+
+CACHE_MB="${1:-64}"
+VIEWERS="${2:-200}"
+PER_VIEWER="${3:-20}"
+SCAN_MB="${4:-512}"
+HOT_MB=32
+SCANNERS=2
+SERVER_ARGS=(-n 8)
+REPLAY_THREADS=32
+REPORT_PATTERN="Block Cache|Syscalls"
+BENCH_FILES="www/bench_hot.mp4 www/bench_scan.mp4"
+
+make -s bin/server bin/replay
+
+echo "[*] Generando video caliente de ${HOT_MB} MB y archivo de scan de ${SCAN_MB} MB"
+head -c "$((HOT_MB * 1024 * 1024))" /dev/urandom > www/bench_hot.mp4
+head -c "$((SCAN_MB * 1024 * 1024))" /dev/urandom > www/bench_scan.mp4
+
+MB=$((1024 * 1024))
+for c in $(seq 1 "$VIEWERS"); do
+    for r in $(seq 1 "$PER_VIEWER"); do
+        start=$(((RANDOM % ((HOT_MB - 1) * 4)) * MB / 4))
+        capture_line "$c" bench_hot.mp4 "bytes=${start}-$((start + MB - 1))"
+    done
+done > "$CAPTURE"
+for s in $(seq 1 "$SCANNERS"); do
+    for m in $(seq 0 $((SCAN_MB - 1))); do
+        capture_line "$((VIEWERS + s))" bench_scan.mp4 "bytes=$((m * MB))-$(((m + 1) * MB - 1))"
+    done
+done >> "$CAPTURE"
+
+run_case "page cache (sendfile)"
+run_case "drop-behind" --uncached 1024
+run_case "drop-behind + caché de bloques ${CACHE_MB} MB" --uncached 1024 --block-cache "$CACHE_MB"
+echo "[*] Benchmark terminado."
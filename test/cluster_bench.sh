@@ -0,0 +1,65 @@
+#!/bin/bash
+
+# Levanta varias instancias en localhost formando un clúster (cada una con su caché de bloques) y
+# reparte entre ellas los espectadores de unos pocos videos, pidiendo rangos de 1 MB. Cada bloque
+# debería leerse del disco una vez en su dueño y llegar al resto por la red; los videos más pedidos
+# se replican en varias instancias (--peer-hot). Al final muestra las líneas Cluster y Block Cache.
+#
+# Uso: test/cluster_bench.sh [instancias] [MB_caché] [espectadores] [peticiones_por_espectador]
+
+set -e
+source "$(dirname "$0")/bench_lib.sh"
+
+INSTANCES="${1:-3}"
+CACHE_MB="${2:-64}"
+VIEWERS="${3:-60}"
+PER_VIEWER="${4:-20}"
+VIDEOS=4
+VIDEO_MB=16
+REPLAY_THREADS=16
+BENCH_FILES="www/cluster_bench_*.mp4"
+PORTS=($(seq "$PORT" $((PORT + INSTANCES - 1))))
+
+make -s bin/server bin/replay
+
+echo "[*] Generando ${VIDEOS} videos de ${VIDEO_MB} MB"
+for v in $(seq 1 "$VIDEOS"); do
+    head -c "$((VIDEO_MB * 1024 * 1024))" /dev/urandom > "www/cluster_bench_${v}.mp4"
+done
+
+# El primer video se lleva la mitad de las peticiones, así supera el umbral de --peer-hot.
+MB=$((1024 * 1024))
+for c in $(seq 1 "$VIEWERS"); do
+    for r in $(seq 1 "$PER_VIEWER"); do
+        if [ $((RANDOM % 2)) -eq 0 ]; then
+            v=1
+        else
+            v=$((RANDOM % VIDEOS + 1))
+        fi
+        start=$(((RANDOM % ((VIDEO_MB - 1) * 4)) * MB / 4))
+        capture_line "$c" "cluster_bench_${v}.mp4" "bytes=${start}-$((start + MB - 1))"
+    done
+done > "$CAPTURE"
+
+PEERS=$(printf '127.0.0.1:%s,' "${PORTS[@]}")
+SECRET=$(head -c 24 /dev/urandom | od -An -tx1 | tr -d ' \n')
+for port in "${PORTS[@]}"; do
+    start_server "$port" -n 4 -G 256 -i "$port" -Y "$CACHE_MB" -E "${PEERS%,}" -I "127.0.0.1:${port}" \
+        -W "$SECRET" -J 20
+done
+
+echo "[*] ${INSTANCES} instancias, ${VIEWERS} espectadores repartidos entre todas"
+REPLAYS=()
+for port in "${PORTS[@]}"; do
+    bench_load -p "$port" > "${WORKDIR}/replay.${port}" &
+    REPLAYS+=($!)
+done
+wait "${REPLAYS[@]}" || true
+
+for port in "${PORTS[@]}"; do
+    stop_server "$port"
+    echo "[*] Instancia ${port}"
+    cat "${WORKDIR}/replay.${port}"
+    grep -E "Block Cache|Cluster:" "${WORKDIR}/${port}.out" | sed 's/^/    /'
+done
+echo "[*] Benchmark terminado."
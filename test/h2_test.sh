@@ -0,0 +1,76 @@
+#!/bin/bash
+
+# Verifica HTTP/2 en claro: prior knowledge, Upgrade h2c, un cuerpo grande, un rango y que un
+# WINDOW_UPDATE con incremento 0 se rechace (GOAWAY en el stream 0, RST_STREAM en un stream), igual
+# que un SETTINGS_INITIAL_WINDOW_SIZE que desborda la ventana de un stream abierto.
+
+set -e
+
+PORT="${1:-8001}"
+WORKDIR="$(mktemp -d)"
+trap 'kill "$SERVER_PID" 2>/dev/null || true; rm -f www/h2_test_big.bin; rm -rf "$WORKDIR"' EXIT
+
+make -s bin/server
+
+head -c $((8 * 1024 * 1024)) /dev/urandom > www/h2_test_big.bin
+
+mkfifo "${WORKDIR}/ctl"
+./bin/server -n 2 -i "$PORT" < "${WORKDIR}/ctl" > "${WORKDIR}/server.out" 2>&1 &
+SERVER_PID=$!
+exec 3> "${WORKDIR}/ctl"
+sleep 0.5
+
+URL="http://127.0.0.1:${PORT}"
+
+echo "[*] Prior knowledge"
+VERSION=$(curl -s --http2-prior-knowledge -w '%{http_version}' -o "${WORKDIR}/index.html" "${URL}/index.html")
+[ "$VERSION" = "2" ] && cmp -s "${WORKDIR}/index.html" www/index.html && echo "    cuerpo OK" \
+    || { echo "    falló (versión ${VERSION})"; exit 1; }
+
+echo "[*] Upgrade h2c"
+VERSION=$(curl -s --http2 -w '%{http_version}' -o "${WORKDIR}/styles.css" "${URL}/styles.css")
+[ "$VERSION" = "2" ] && cmp -s "${WORKDIR}/styles.css" www/styles.css && echo "    cuerpo OK" \
+    || { echo "    falló (versión ${VERSION})"; exit 1; }
+
+echo "[*] Cuerpo de 8 MB (control de flujo)"
+curl -s --http2-prior-knowledge -o "${WORKDIR}/big.bin" "${URL}/h2_test_big.bin"
+cmp -s "${WORKDIR}/big.bin" www/h2_test_big.bin && echo "    cuerpo OK" || { echo "    cuerpo distinto"; exit 1; }
+
+echo "[*] Rango"
+curl -s --http2-prior-knowledge -r 1000000-3000000 -o "${WORKDIR}/range.bin" "${URL}/h2_test_big.bin"
+tail -c +1000001 www/h2_test_big.bin | head -c 2000001 | cmp -s - "${WORKDIR}/range.bin" && echo "    rango OK" \
+    || { echo "    rango incorrecto"; exit 1; }
+
+# Manda el prefacio, un SETTINGS vacío y los frames dados; devuelve la respuesta en hex.
+raw_h2() {
+    printf 'PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n\x00\x00\x00\x04\x00\x00\x00\x00\x00'"$1" > "${WORKDIR}/frames"
+    exec 5<>"/dev/tcp/127.0.0.1/${PORT}"
+    cat "${WORKDIR}/frames" >&5
+    timeout 1 cat <&5 | od -An -tx1 -v | tr -d ' \n' || true
+    exec 5>&-
+}
+
+echo "[*] WINDOW_UPDATE 0 en la conexión"
+REPLY=$(raw_h2 '\x00\x00\x04\x08\x00\x00\x00\x00\x00\x00\x00\x00\x00')
+echo "$REPLY" | grep -qE '000008070000000000[0-9a-f]{8}00000001' && echo "    GOAWAY PROTOCOL_ERROR" \
+    || { echo "    sin GOAWAY"; exit 1; }
+
+echo "[*] WINDOW_UPDATE 0 en un stream"
+HEADERS='\x00\x00\x03\x01\x05\x00\x00\x00\x01\x82\x86\x84'
+REPLY=$(raw_h2 "${HEADERS}"'\x00\x00\x04\x08\x00\x00\x00\x00\x01\x00\x00\x00\x00')
+echo "$REPLY" | grep -qE '00000403000000000100000001' && echo "    RST_STREAM PROTOCOL_ERROR" \
+    || { echo "    sin RST_STREAM"; exit 1; }
+
+# El stream del archivo grande queda abierto esperando ventana; se lleva a 2^31-1 y luego se sube
+# INITIAL_WINDOW_SIZE, lo que lo desbordaría.
+echo "[*] INITIAL_WINDOW_SIZE que desborda un stream"
+HEADERS='\x00\x00\x14\x01\x05\x00\x00\x00\x01\x82\x86\x44\x10/h2_test_big.bin'
+WINDOW='\x00\x00\x04\x08\x00\x00\x00\x00\x01\x7f\xff\x00\x00'
+SETTINGS='\x00\x00\x06\x04\x00\x00\x00\x00\x00\x00\x04\x7f\xff\xff\xff'
+REPLY=$(raw_h2 "${HEADERS}${WINDOW}${SETTINGS}")
+echo "$REPLY" | grep -qE '000008070000000000[0-9a-f]{8}00000003' && echo "    GOAWAY FLOW_CONTROL_ERROR" \
+    || { echo "    sin GOAWAY"; exit 1; }
+
+echo q >&3
+wait "$SERVER_PID" || true
+echo "[*] Test HTTP/2 terminado."
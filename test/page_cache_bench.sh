@@ -0,0 +1,68 @@
+#!/bin/bash
+
+# Mide la latencia de archivos chicos mientras se transmiten varios archivos grandes a la vez,
+# con el camino normal (page cache), con drop-behind (--uncached) y con O_DIRECT (--odirect).
+# Al final de cada corrida muestra cuánto de los archivos grandes quedó en el page cache.
+#
+# Uso: test/page_cache_bench.sh [archivos_grandes] [MB_por_archivo] [peticiones_chicas]
+
+set -e
+source "$(dirname "$0")/bench_lib.sh"
+
+LARGE_COUNT="${1:-4}"
+LARGE_MB="${2:-256}"
+SMALL_REQUESTS="${3:-200}"
+SMALL_FILES=(index.html styles.css image.jpeg favicon.ico prueba.txt)
+SERVER_ARGS=(-n 8)
+BENCH_FILES="www/bench_large_*.mp4"
+
+make -s bin/server
+
+echo "[*] Generando ${LARGE_COUNT} archivos de ${LARGE_MB} MB"
+for i in $(seq 1 "$LARGE_COUNT"); do
+    head -c "$((LARGE_MB * 1024 * 1024))" /dev/urandom > "www/bench_large_${i}.mp4"
+done
+
+drop_caches() {
+    sync
+    echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
+}
+
+bench_load() {
+    drop_caches
+
+    # Los archivos chicos quedan calientes antes de empezar
+    for f in "${SMALL_FILES[@]}"; do
+        curl -s -o /dev/null "http://127.0.0.1:${PORT}/${f}"
+    done
+
+    local pids=""
+    for i in $(seq 1 "$LARGE_COUNT"); do
+        curl -s -o /dev/null "http://127.0.0.1:${PORT}/bench_large_${i}.mp4" &
+        pids="$pids $!"
+    done
+
+    : > "${WORKDIR}/small.txt"
+    for n in $(seq 1 "$SMALL_REQUESTS"); do
+        f="${SMALL_FILES[$((n % ${#SMALL_FILES[@]}))]}"
+        curl -s -o /dev/null -w "%{time_total}\n" "http://127.0.0.1:${PORT}/${f}" >> "${WORKDIR}/small.txt"
+    done
+    wait $pids
+}
+
+bench_report() {
+    sort -n "${WORKDIR}/small.txt" | awk '
+        { t[NR] = $1 * 1000 }
+        END { printf "    chicos p50 %7.3f ms  p99 %7.3f ms  max %7.3f ms\n",
+                     t[int(NR * 0.50)], t[int(NR * 0.99)], t[NR] }'
+    if command -v fincore > /dev/null; then
+        fincore -n -o RES,FILE www/bench_large_*.mp4 "${SMALL_FILES[@]/#/www/}" | sed 's/^/      /'
+    fi
+}
+
+echo "[*] ${LARGE_COUNT} descargas grandes en paralelo + ${SMALL_REQUESTS} peticiones chicas"
+[ -w /proc/sys/vm/drop_caches ] || echo "    (sin permisos para vaciar el page cache; cada caso parte del estado anterior)"
+run_case "page cache"
+run_case "drop-behind" --uncached 1024
+run_case "O_DIRECT" --uncached 1024 --odirect
+echo "[*] Benchmark terminado."
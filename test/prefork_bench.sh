@@ -0,0 +1,23 @@
+#!/bin/bash
+
+# Compara el modo con hilos (un proceso, P*N workers) contra el modo prefork (P procesos de N workers)
+# con la misma cantidad total de workers. La carga es una captura sintética reproducida con bin/replay
+# a velocidad máxima; al final de cada corrida se muestran las estadísticas agregadas del servidor.
+#
+# Uso: test/prefork_bench.sh [procesos] [workers_por_proceso] [conexiones] [peticiones_por_conexion]
+
+set -e
+source "$(dirname "$0")/bench_lib.sh"
+
+PROCESSES="${1:-4}"
+WORKERS="${2:-4}"
+CONNECTIONS="${3:-2000}"
+PER_CONN="${4:-10}"
+REPORT_PATTERN="Processes|Total Requests|Requests/sec|Avg Turnaround"
+
+make -s bin/server bin/replay
+gen_capture "$CONNECTIONS" "$PER_CONN" index.html styles.css image.jpeg favicon.ico prueba.txt
+
+run_case "hilos: -n $((PROCESSES * WORKERS))" -n "$((PROCESSES * WORKERS))"
+run_case "prefork: -p ${PROCESSES} -n ${WORKERS}" -p "$PROCESSES" -n "$WORKERS"
+echo "[*] Benchmark terminado."
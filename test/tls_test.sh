@@ -0,0 +1,41 @@
+#!/bin/bash
+
+# Levanta el servidor con un listener TLS usando un certificado autofirmado
+# y verifica la respuesta, la reanudación de sesión y el uso de kTLS.
+
+set -e
+
+TLS_PORT="${1:-8443}"
+WORKDIR="$(mktemp -d)"
+trap 'kill "$SERVER_PID" 2>/dev/null || true; rm -rf "$WORKDIR"' EXIT
+
+echo "[*] Generando certificado autofirmado en ${WORKDIR}"
+openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj "/CN=localhost" \
+    -keyout "${WORKDIR}/key.pem" -out "${WORKDIR}/cert.pem" 2>/dev/null
+
+make -s bin/server
+
+mkfifo "${WORKDIR}/ctl"
+./bin/server -n 2 --tls-port "$TLS_PORT" --cert "${WORKDIR}/cert.pem" --key "${WORKDIR}/key.pem" \
+    < "${WORKDIR}/ctl" > "${WORKDIR}/server.out" 2>&1 &
+SERVER_PID=$!
+exec 3> "${WORKDIR}/ctl"
+sleep 0.5
+
+echo "[*] GET https://localhost:${TLS_PORT}/index.html"
+curl -sk "https://localhost:${TLS_PORT}/index.html" -o "${WORKDIR}/index.html"
+cmp -s "${WORKDIR}/index.html" www/index.html && echo "    cuerpo OK" || { echo "    cuerpo distinto"; exit 1; }
+
+echo "[*] Rango sobre TLS"
+BODY=$(curl -sk -r 0-4 "https://localhost:${TLS_PORT}/prueba.txt")
+[ "$BODY" = "$(head -c 5 www/prueba.txt)" ] && echo "    rango OK" || { echo "    rango incorrecto"; exit 1; }
+
+echo "[*] Reanudación de sesión (TLS 1.2 session id)"
+echo | openssl s_client -connect "localhost:${TLS_PORT}" -tls1_2 -sess_out "${WORKDIR}/sess" >/dev/null 2>&1
+REUSED=$(echo | openssl s_client -connect "localhost:${TLS_PORT}" -tls1_2 -sess_in "${WORKDIR}/sess" 2>/dev/null | grep -c "^Reused" || true)
+[ "$REUSED" -ge 1 ] && echo "    sesión reanudada" || { echo "    la sesión no se reanudó"; exit 1; }
+
+echo q >&3
+wait "$SERVER_PID" || true
+grep "TLS Handshakes" "${WORKDIR}/server.out"
+echo "[*] Test TLS terminado."
@@ -0,0 +1,24 @@
+#!/bin/bash
+
+# Compara la tasa de peticiones por TCP loopback contra un socket Unix, y el socket Unix con una
+# cabecera PROXY v1 por conexión (lo que enviaría un proxy local). Misma captura sintética y mismo
+# servidor para los tres casos, reproducida con bin/replay a velocidad máxima.
+#
+# Uso: test/uds_bench.sh [conexiones] [peticiones_por_conexion] [workers]
+
+set -e
+source "$(dirname "$0")/bench_lib.sh"
+
+CONNECTIONS="${1:-2000}"
+PER_CONN="${2:-10}"
+WORKERS="${3:-8}"
+SOCKET="${WORKDIR}/server.sock"
+SERVER_ARGS=(-n "$WORKERS" -i "$PORT" -u "$SOCKET")
+
+make -s bin/server bin/replay
+gen_capture "$CONNECTIONS" "$PER_CONN" index.html styles.css image.jpeg favicon.ico prueba.txt
+
+run_case "TCP loopback" -- -p "$PORT"
+run_case "Unix socket" -- -u "$SOCKET"
+run_case "Unix socket + PROXY v1" -X unix -- -u "$SOCKET" -x
+echo "[*] Benchmark terminado."
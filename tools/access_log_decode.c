@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "accesslog.h"
+
+typedef enum
+{
+    FORMAT_TEXT,
+    FORMAT_CSV,
+    FORMAT_JSON
+} output_format_t;
+
+typedef struct
+{
+    uint32_t id;
+    char *path;
+} path_entry_t;
+
+static path_entry_t *g_paths = NULL;
+static size_t g_path_count = 0;
+
+static const char *phase_keys[PHASE_COUNT] = {
+    "enqueue_us", "queue_wait_us", "read_parse_us", "open_us", "first_byte_us", "transfer_us", "total_us"};
+
+static void load_paths(const char *file)
+{
+    FILE *f = fopen(file, "r");
+    if (!f)
+    {
+        return;
+    }
+    size_t capacity = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), f))
+    {
+        char *tab = strchr(line, '\t');
+        if (!tab)
+        {
+            continue;
+        }
+        *tab = '\0';
+        char *path = tab + 1;
+        path[strcspn(path, "\n")] = '\0';
+
+        if (g_path_count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            g_paths = realloc(g_paths, capacity * sizeof(*g_paths));
+            if (!g_paths)
+            {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        g_paths[g_path_count].id = (uint32_t)strtoul(line, NULL, 16);
+        g_paths[g_path_count].path = strdup(path);
+        g_path_count++;
+    }
+    fclose(f);
+}
+
+static const char *lookup_path(uint32_t id, char *fallback, size_t len)
+{
+    for (size_t i = 0; i < g_path_count; i++)
+    {
+        if (g_paths[i].id == id)
+        {
+            return g_paths[i].path;
+        }
+    }
+    snprintf(fallback, len, "#%08x", id);
+    return fallback;
+}
+
+static void format_peer(const access_record_t *r, char *out, size_t len)
+{
+    if (r->peer_family == AF_INET || r->peer_family == AF_INET6)
+    {
+        inet_ntop(r->peer_family, r->peer_addr, out, (socklen_t)len);
+    }
+    else
+    {
+        snprintf(out, len, "-");
+    }
+}
+
+static void format_time(uint64_t timestamp_us, char *out, size_t len)
+{
+    time_t secs = (time_t)(timestamp_us / 1000000ULL);
+    struct tm tm_info;
+    localtime_r(&secs, &tm_info);
+    size_t n = strftime(out, len, "%Y-%m-%d %H:%M:%S", &tm_info);
+    snprintf(out + n, len - n, ".%06llu", (unsigned long long)(timestamp_us % 1000000ULL));
+}
+
+static void print_json_string(const char *s)
+{
+    putchar('"');
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+        {
+            putchar('\\');
+        }
+        if ((unsigned char)*s < 0x20)
+        {
+            printf("\\u%04x", *s);
+            continue;
+        }
+        putchar(*s);
+    }
+    putchar('"');
+}
+
+static void print_record(const access_record_t *r, output_format_t format, int first)
+{
+    char peer[INET6_ADDRSTRLEN];
+    char when[64];
+    char fallback[16];
+    format_peer(r, peer, sizeof(peer));
+    format_time(r->timestamp_us, when, sizeof(when));
+    const char *path = lookup_path(r->path_id, fallback, sizeof(fallback));
+
+    switch (format)
+    {
+    case FORMAT_TEXT:
+        printf("%s %s:%u fd=%d w=%u %u %s bytes=%llu", when, peer, r->peer_port, r->fd,
+               r->worker_id, r->status, path, (unsigned long long)r->bytes);
+        if (r->range_start >= 0)
+        {
+            printf(" range=%lld-%lld", (long long)r->range_start, (long long)r->range_end);
+        }
+        printf(" total=%.3fms queue=%.3fms\n", r->phase_us[PHASE_TOTAL] / 1000.0,
+               r->phase_us[PHASE_QUEUE_WAIT] / 1000.0);
+        break;
+    case FORMAT_CSV:
+        printf("%llu,%s,%u,%d,%u,%u,\"%s\",%llu,%lld,%lld", (unsigned long long)r->timestamp_us,
+               peer, r->peer_port, r->fd, r->worker_id, r->status, path,
+               (unsigned long long)r->bytes, (long long)r->range_start, (long long)r->range_end);
+        for (int p = 0; p < PHASE_COUNT; p++)
+        {
+            printf(",%u", r->phase_us[p]);
+        }
+        printf("\n");
+        break;
+    case FORMAT_JSON:
+        printf("%s{\"timestamp_us\":%llu,\"peer\":\"%s\",\"port\":%u,\"fd\":%d,\"worker\":%u,"
+               "\"status\":%u,\"path\":",
+               first ? "" : ",\n", (unsigned long long)r->timestamp_us, peer, r->peer_port, r->fd,
+               r->worker_id, r->status);
+        print_json_string(path);
+        printf(",\"bytes\":%llu,\"range_start\":%lld,\"range_end\":%lld",
+               (unsigned long long)r->bytes, (long long)r->range_start, (long long)r->range_end);
+        for (int p = 0; p < PHASE_COUNT; p++)
+        {
+            printf(",\"%s\":%u", phase_keys[p], r->phase_us[p]);
+        }
+        printf("}");
+        break;
+    }
+}
+
+static int decode_file(const char *file, output_format_t format, int *first)
+{
+    FILE *f = fopen(file, "rb");
+    if (!f)
+    {
+        perror(file);
+        return -1;
+    }
+
+    access_log_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.magic, ACCESS_LOG_MAGIC, sizeof(header.magic)) != 0)
+    {
+        fprintf(stderr, "%s: no es un access log binario\n", file);
+        fclose(f);
+        return -1;
+    }
+    if (header.version != ACCESS_LOG_VERSION || header.record_size != sizeof(access_record_t))
+    {
+        fprintf(stderr, "%s: versión %u / registro de %u bytes no soportado\n", file,
+                header.version, header.record_size);
+        fclose(f);
+        return -1;
+    }
+
+    access_record_t record;
+    while (fread(&record, sizeof(record), 1, f) == 1)
+    {
+        print_record(&record, format, *first);
+        *first = 0;
+    }
+    fclose(f);
+    return 0;
+}
+
+/* The dictionary is not rotated: access.log.3 still uses access.log.paths. */
+static void default_paths_for(const char *log, char *out, size_t len)
+{
+    snprintf(out, len, "%s.paths", log);
+    if (access(out, R_OK) == 0)
+    {
+        return;
+    }
+    const char *dot = strrchr(log, '.');
+    if (dot && dot[1] != '\0' && strspn(dot + 1, "0123456789") == strlen(dot + 1))
+    {
+        snprintf(out, len, "%.*s.paths", (int)(dot - log), log);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    output_format_t format = FORMAT_TEXT;
+    const char *paths_file = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:p:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f':
+            if (strcmp(optarg, "csv") == 0)
+                format = FORMAT_CSV;
+            else if (strcmp(optarg, "json") == 0)
+                format = FORMAT_JSON;
+            else
+                format = FORMAT_TEXT;
+            break;
+        case 'p':
+            paths_file = optarg;
+            break;
+        default:
+            fprintf(stderr, "Uso: %s [-f text|csv|json] [-p archivo.paths] <access.log>...\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        fprintf(stderr, "Uso: %s [-f text|csv|json] [-p archivo.paths] <access.log>...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    char default_paths[1024];
+    if (!paths_file)
+    {
+        default_paths_for(argv[optind], default_paths, sizeof(default_paths));
+        paths_file = default_paths;
+    }
+    load_paths(paths_file);
+
+    if (format == FORMAT_CSV)
+    {
+        printf("timestamp_us,peer,port,fd,worker,status,path,bytes,range_start,range_end");
+        for (int p = 0; p < PHASE_COUNT; p++)
+        {
+            printf(",%s", phase_keys[p]);
+        }
+        printf("\n");
+    }
+    if (format == FORMAT_JSON)
+    {
+        printf("[\n");
+    }
+
+    int first = 1;
+    int rc = EXIT_SUCCESS;
+    for (int i = optind; i < argc; i++)
+    {
+        if (decode_file(argv[i], format, &first) != 0)
+        {
+            rc = EXIT_FAILURE;
+        }
+    }
+
+    if (format == FORMAT_JSON)
+    {
+        printf("\n]\n");
+    }
+    return rc;
+}
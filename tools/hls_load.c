@@ -0,0 +1,768 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#define PATH_LEN 1024
+#define HEAD_BUFFER 4096
+#define RECV_BUFFER 65536
+#define PLAYLIST_MAX (4 * 1024 * 1024)
+#define TICK_MS 20
+#define RETRY_DELAY_US 500000
+#define MAX_EVENTS 256
+
+typedef struct
+{
+    char *uri;
+    double duration_s;
+} segment_t;
+
+typedef enum
+{
+    IO_IDLE = 0,
+    IO_CONNECTING,
+    IO_SENDING,
+    IO_HEAD,
+    IO_BODY
+} viewer_io_t;
+
+/* One emulated player: a keep-alive connection plus a playback buffer drained in real time. */
+typedef struct
+{
+    int id;
+    int fd;
+    viewer_io_t io;
+    int reused;
+
+    char request[PATH_LEN + 256];
+    size_t request_len;
+    size_t request_sent;
+    char head[HEAD_BUFFER];
+    size_t head_len;
+    long long body_left;
+    int keep_alive;
+    int status;
+    long long range_total;
+
+    int init_done;
+    int fetching_init;
+    unsigned long next_segment;
+    long long segment_offset;
+
+    uint64_t join_us;
+    uint64_t retry_at_us;
+    double buffer_s;
+    int playing;
+    int stalled;
+    uint64_t stall_start_us;
+
+    int64_t startup_us;
+    unsigned stalls;
+    uint64_t stall_us;
+    unsigned long segments;
+    unsigned long long bytes;
+    unsigned errors;
+} viewer_t;
+
+typedef struct
+{
+    viewer_t *viewers;
+    int count;
+    int epfd;
+} sim_thread_t;
+
+static const char *g_host = "127.0.0.1";
+static const char *g_port = "8001";
+static struct addrinfo *g_addr = NULL;
+static segment_t *g_segments = NULL;
+static size_t g_segment_count = 0;
+static char *g_init_uri = NULL;
+static double g_playlist_s = 0.0;
+
+static int g_viewer_count = 100;
+static double g_duration_s = 60.0;
+static double g_ramp_s = 5.0;
+static double g_target_s = 10.0;
+static double g_startup_s = 2.0;
+static long long g_range_chunk = 0;
+static uint64_t g_start_us = 0;
+static uint64_t g_end_us = 0;
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static int compare_i64(const void *a, const void *b)
+{
+    int64_t la = *(const int64_t *)a, lb = *(const int64_t *)b;
+    return la < lb ? -1 : la > lb;
+}
+
+static void resolve_server(void)
+{
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    if (getaddrinfo(g_host, g_port, &hints, &g_addr) != 0 || !g_addr)
+    {
+        fprintf(stderr, "No se pudo resolver %s:%s\n", g_host, g_port);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Blocking GET used once for the playlist. Returns the body (caller frees) or NULL. */
+static char *fetch_blocking(const char *path)
+{
+    int fd = socket(g_addr->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, g_addr->ai_addr, g_addr->ai_addrlen) != 0)
+    {
+        perror("connect");
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+
+    char request[PATH_LEN + 128];
+    int len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
+                       path, g_host);
+    if (send(fd, request, (size_t)len, MSG_NOSIGNAL) != len)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    char *buf = malloc(PLAYLIST_MAX + 1);
+    size_t have = 0;
+    ssize_t n;
+    while (buf && have < PLAYLIST_MAX && (n = recv(fd, buf + have, PLAYLIST_MAX - have, 0)) > 0)
+    {
+        have += (size_t)n;
+    }
+    close(fd);
+    if (!buf)
+        return NULL;
+    buf[have] = '\0';
+
+    int status = 0;
+    char *body = strstr(buf, "\r\n\r\n");
+    if (sscanf(buf, "HTTP/%*s %d", &status) != 1 || status != 200 || !body)
+    {
+        fprintf(stderr, "GET %s: respuesta inválida (status %d)\n", path, status);
+        free(buf);
+        return NULL;
+    }
+    memmove(buf, body + 4, strlen(body + 4) + 1);
+    return buf;
+}
+
+/* Segment URIs are relative to the playlist; absolute URLs keep only their path. */
+static char *resolve_uri(const char *base, const char *uri)
+{
+    char out[PATH_LEN];
+    if (strncmp(uri, "http://", 7) == 0 || strncmp(uri, "https://", 8) == 0)
+    {
+        const char *path = strchr(uri + (uri[4] == 's' ? 8 : 7), '/');
+        snprintf(out, sizeof(out), "%s", path ? path : "/");
+    }
+    else if (uri[0] == '/')
+    {
+        snprintf(out, sizeof(out), "%s", uri);
+    }
+    else
+    {
+        const char *slash = strrchr(base, '/');
+        int dir_len = slash ? (int)(slash - base) : 0;
+        snprintf(out, sizeof(out), "%.*s/%s", dir_len, base, uri);
+    }
+    return strdup(out);
+}
+
+static void add_segment(char *uri, double duration_s)
+{
+    static size_t capacity = 0;
+    if (g_segment_count == capacity)
+    {
+        capacity = capacity ? capacity * 2 : 256;
+        g_segments = realloc(g_segments, capacity * sizeof(*g_segments));
+        if (!g_segments)
+        {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    g_segments[g_segment_count].uri = uri;
+    g_segments[g_segment_count].duration_s = duration_s;
+    g_segment_count++;
+    g_playlist_s += duration_s;
+}
+
+/* Media playlists only; a master playlist is followed to its first variant. */
+static void load_playlist(const char *path, int depth)
+{
+    char *body = fetch_blocking(path);
+    if (!body)
+        exit(EXIT_FAILURE);
+
+    double pending_duration = -1.0;
+    int pending_variant = 0;
+    for (char *line = strtok(body, "\r\n"); line; line = strtok(NULL, "\r\n"))
+    {
+        if (strncmp(line, "#EXTINF:", 8) == 0)
+        {
+            pending_duration = atof(line + 8);
+        }
+        else if (strncmp(line, "#EXT-X-STREAM-INF", 17) == 0)
+        {
+            pending_variant = 1;
+        }
+        else if (strncmp(line, "#EXT-X-MAP:", 11) == 0)
+        {
+            char *uri = strstr(line, "URI=\"");
+            char *end = uri ? strchr(uri + 5, '"') : NULL;
+            if (end && !g_init_uri)
+            {
+                *end = '\0';
+                g_init_uri = resolve_uri(path, uri + 5);
+            }
+        }
+        else if (line[0] != '#' && line[0] != '\0')
+        {
+            if (pending_variant && depth == 0)
+            {
+                char *variant = resolve_uri(path, line);
+                free(body);
+                load_playlist(variant, depth + 1);
+                free(variant);
+                return;
+            }
+            if (pending_duration >= 0)
+            {
+                add_segment(resolve_uri(path, line), pending_duration);
+            }
+            pending_duration = -1.0;
+        }
+    }
+    free(body);
+
+    if (g_segment_count == 0 || g_playlist_s <= 0)
+    {
+        fprintf(stderr, "%s no contiene segmentos\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void viewer_close(sim_thread_t *t, viewer_t *v)
+{
+    if (v->fd >= 0)
+    {
+        epoll_ctl(t->epfd, EPOLL_CTL_DEL, v->fd, NULL);
+        close(v->fd);
+    }
+    v->fd = -1;
+    v->io = IO_IDLE;
+}
+
+static void viewer_watch(sim_thread_t *t, viewer_t *v, uint32_t events)
+{
+    struct epoll_event ev = {.events = events, .data.ptr = v};
+    epoll_ctl(t->epfd, EPOLL_CTL_MOD, v->fd, &ev);
+}
+
+static void viewer_fail(sim_thread_t *t, viewer_t *v, uint64_t now)
+{
+    v->errors++;
+    viewer_close(t, v);
+    v->retry_at_us = now + RETRY_DELAY_US;
+}
+
+static void buffer_added(viewer_t *v, double seconds, uint64_t now)
+{
+    v->buffer_s += seconds;
+    if (!v->playing && v->buffer_s >= g_startup_s)
+    {
+        v->playing = 1;
+        v->startup_us = (int64_t)(now - v->join_us);
+    }
+    else if (v->stalled && v->buffer_s >= g_startup_s)
+    {
+        v->stalled = 0;
+        v->stall_us += now - v->stall_start_us;
+    }
+}
+
+static void response_done(sim_thread_t *t, viewer_t *v, uint64_t now)
+{
+    if (v->status < 200 || v->status >= 300)
+    {
+        viewer_fail(t, v, now);
+        return;
+    }
+
+    if (v->fetching_init)
+    {
+        v->init_done = 1;
+    }
+    else
+    {
+        const segment_t *seg = &g_segments[v->next_segment % g_segment_count];
+        int complete = 1;
+        if (g_range_chunk > 0 && v->status == 206 && v->range_total > 0)
+        {
+            v->segment_offset += g_range_chunk;
+            complete = v->segment_offset >= v->range_total;
+        }
+        if (complete)
+        {
+            v->segment_offset = 0;
+            v->next_segment++;
+            v->segments++;
+            buffer_added(v, seg->duration_s, now);
+        }
+    }
+
+    v->io = IO_IDLE;
+    v->reused = 1;
+    if (!v->keep_alive)
+    {
+        viewer_close(t, v);
+    }
+    else
+    {
+        viewer_watch(t, v, 0);
+    }
+}
+
+static int parse_head(viewer_t *v)
+{
+    char *end = strstr(v->head, "\r\n\r\n");
+    if (!end)
+        return 0;
+
+    if (sscanf(v->head, "HTTP/%*s %d", &v->status) != 1)
+        return -1;
+    const char *cl = strcasestr(v->head, "\r\nContent-Length:");
+    const char *conn = strcasestr(v->head, "\r\nConnection:");
+    const char *cr = strcasestr(v->head, "\r\nContent-Range:");
+    if (!cl)
+        return -1;
+    v->body_left = atoll(cl + strlen("\r\nContent-Length:"));
+    v->keep_alive = !(conn && strncasecmp(conn + strlen("\r\nConnection:") + 1, "close", 5) == 0);
+    v->range_total = -1;
+    if (cr)
+    {
+        const char *slash = strchr(cr + 2, '/');
+        if (slash)
+            v->range_total = atoll(slash + 1);
+    }
+
+    size_t head_len = (size_t)(end + 4 - v->head);
+    long long extra = (long long)(v->head_len - head_len);
+    v->body_left -= extra;
+    v->bytes += (unsigned long long)extra;
+    return 1;
+}
+
+static void start_request(sim_thread_t *t, viewer_t *v, uint64_t now)
+{
+    const char *uri;
+    v->fetching_init = g_init_uri && !v->init_done;
+    uri = v->fetching_init ? g_init_uri : g_segments[v->next_segment % g_segment_count].uri;
+
+    int len = snprintf(v->request, sizeof(v->request), "GET %s HTTP/1.1\r\nHost: %s\r\n", uri, g_host);
+    if (g_range_chunk > 0 && !v->fetching_init)
+    {
+        len += snprintf(v->request + len, sizeof(v->request) - (size_t)len, "Range: bytes=%lld-%lld\r\n",
+                        v->segment_offset, v->segment_offset + g_range_chunk - 1);
+    }
+    len += snprintf(v->request + len, sizeof(v->request) - (size_t)len, "\r\n");
+    v->request_len = (size_t)len;
+    v->request_sent = 0;
+    v->head_len = 0;
+
+    if (v->fd >= 0)
+    {
+        v->io = IO_SENDING;
+        viewer_watch(t, v, EPOLLOUT);
+        return;
+    }
+
+    v->reused = 0;
+    v->fd = socket(g_addr->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (v->fd < 0)
+    {
+        viewer_fail(t, v, now);
+        return;
+    }
+    int one = 1;
+    setsockopt(v->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct epoll_event ev = {.events = EPOLLOUT, .data.ptr = v};
+    epoll_ctl(t->epfd, EPOLL_CTL_ADD, v->fd, &ev);
+
+    if (connect(v->fd, g_addr->ai_addr, g_addr->ai_addrlen) != 0 && errno != EINPROGRESS)
+    {
+        viewer_fail(t, v, now);
+        return;
+    }
+    v->io = IO_CONNECTING;
+}
+
+/* A kept-alive connection the server already closed is not an error: reconnect and resend. */
+static void connection_lost(sim_thread_t *t, viewer_t *v, uint64_t now)
+{
+    if (v->reused && v->head_len == 0)
+    {
+        viewer_close(t, v);
+        start_request(t, v, now);
+        return;
+    }
+    viewer_fail(t, v, now);
+}
+
+static void viewer_event(sim_thread_t *t, viewer_t *v, char *scratch, uint64_t now)
+{
+    if (v->io == IO_CONNECTING)
+    {
+        int err = 0;
+        socklen_t err_len = sizeof(err);
+        if (getsockopt(v->fd, SOL_SOCKET, SO_ERROR, &err, &err_len) != 0 || err != 0)
+        {
+            viewer_fail(t, v, now);
+            return;
+        }
+        v->io = IO_SENDING;
+    }
+
+    if (v->io == IO_SENDING)
+    {
+        ssize_t n = send(v->fd, v->request + v->request_sent, v->request_len - v->request_sent, MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n <= 0)
+        {
+            connection_lost(t, v, now);
+            return;
+        }
+        v->request_sent += (size_t)n;
+        if (v->request_sent == v->request_len)
+        {
+            v->io = IO_HEAD;
+            viewer_watch(t, v, EPOLLIN);
+        }
+        return;
+    }
+
+    while (v->io == IO_HEAD || v->io == IO_BODY)
+    {
+        ssize_t n;
+        if (v->io == IO_HEAD)
+            n = recv(v->fd, v->head + v->head_len, sizeof(v->head) - 1 - v->head_len, 0);
+        else
+            n = recv(v->fd, scratch, RECV_BUFFER, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n <= 0)
+        {
+            connection_lost(t, v, now);
+            return;
+        }
+
+        if (v->io == IO_HEAD)
+        {
+            v->head_len += (size_t)n;
+            v->head[v->head_len] = '\0';
+            int parsed = parse_head(v);
+            if (parsed < 0 || (parsed == 0 && v->head_len == sizeof(v->head) - 1))
+            {
+                viewer_fail(t, v, now);
+                return;
+            }
+            if (parsed == 0)
+                continue;
+            v->io = IO_BODY;
+        }
+        else
+        {
+            v->body_left -= n;
+            v->bytes += (unsigned long long)n;
+        }
+
+        if (v->body_left <= 0)
+        {
+            response_done(t, v, now);
+            return;
+        }
+    }
+}
+
+/* Drains every joined viewer's buffer by the elapsed wall time and issues the next fetch once
+ * the buffer is below target, which is how real players pace segment requests. */
+static void advance_viewers(sim_thread_t *t, uint64_t prev, uint64_t now)
+{
+    double elapsed_s = (double)(now - prev) / 1e6;
+    for (int i = 0; i < t->count; i++)
+    {
+        viewer_t *v = &t->viewers[i];
+        if (now < v->join_us)
+            continue;
+
+        if (v->playing && !v->stalled)
+        {
+            v->buffer_s -= elapsed_s;
+            if (v->buffer_s <= 0)
+            {
+                v->buffer_s = 0;
+                v->stalled = 1;
+                v->stalls++;
+                v->stall_start_us = now;
+            }
+        }
+
+        if (v->io == IO_IDLE && now >= v->retry_at_us && v->buffer_s < g_target_s)
+        {
+            start_request(t, v, now);
+        }
+    }
+}
+
+static void *sim_thread(void *arg)
+{
+    sim_thread_t *t = arg;
+    char *scratch = malloc(RECV_BUFFER);
+    struct epoll_event events[MAX_EVENTS];
+    if (!scratch)
+        return NULL;
+
+    uint64_t prev = now_us();
+    while (1)
+    {
+        int n = epoll_wait(t->epfd, events, MAX_EVENTS, TICK_MS);
+        uint64_t now = now_us();
+        if (now >= g_end_us)
+            break;
+        for (int i = 0; i < n; i++)
+        {
+            viewer_event(t, events[i].data.ptr, scratch, now);
+        }
+        advance_viewers(t, prev, now);
+        prev = now;
+    }
+
+    for (int i = 0; i < t->count; i++)
+    {
+        viewer_t *v = &t->viewers[i];
+        if (v->stalled)
+            v->stall_us += g_end_us - v->stall_start_us;
+        if (v->fd >= 0)
+            close(v->fd);
+    }
+    free(scratch);
+    return NULL;
+}
+
+static void raise_fd_limit(int needed)
+{
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < (rlim_t)needed)
+    {
+        rl.rlim_cur = rl.rlim_max < (rlim_t)needed ? rl.rlim_max : (rlim_t)needed;
+        setrlimit(RLIMIT_NOFILE, &rl);
+        if (rl.rlim_cur < (rlim_t)needed)
+            fprintf(stderr, "Aviso: límite de descriptores %lu < %d viewers\n", (unsigned long)rl.rlim_cur, needed);
+    }
+}
+
+static void write_csv(const char *file, const viewer_t *viewers)
+{
+    FILE *f = fopen(file, "w");
+    if (!f)
+    {
+        perror(file);
+        return;
+    }
+    fprintf(f, "viewer,startup_ms,stalls,stall_ms,segments,bytes,errors\n");
+    for (int i = 0; i < g_viewer_count; i++)
+    {
+        const viewer_t *v = &viewers[i];
+        fprintf(f, "%d,%.3f,%u,%.3f,%lu,%llu,%u\n", v->id, v->startup_us >= 0 ? v->startup_us / 1000.0 : -1.0,
+                v->stalls, v->stall_us / 1000.0, v->segments, v->bytes, v->errors);
+    }
+    fclose(f);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Uso: %s [-H host] [-p puerto] [-n viewers] [-d segundos] [-r rampa_s] [-b buffer_s] "
+            "[-s arranque_s] [-R bytes_por_rango] [-t hilos] [-o viewers.csv] </ruta/index.m3u8>\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    int thread_count = 4;
+    const char *csv_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "H:p:n:d:r:b:s:R:t:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'H':
+            g_host = optarg;
+            break;
+        case 'p':
+            g_port = optarg;
+            break;
+        case 'n':
+            g_viewer_count = atoi(optarg);
+            break;
+        case 'd':
+            g_duration_s = atof(optarg);
+            break;
+        case 'r':
+            g_ramp_s = atof(optarg);
+            break;
+        case 'b':
+            g_target_s = atof(optarg);
+            break;
+        case 's':
+            g_startup_s = atof(optarg);
+            break;
+        case 'R':
+            g_range_chunk = atoll(optarg);
+            break;
+        case 't':
+            thread_count = atoi(optarg);
+            break;
+        case 'o':
+            csv_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind >= argc || g_viewer_count < 1 || g_duration_s <= 0)
+        usage(argv[0]);
+    if (thread_count < 1)
+        thread_count = 1;
+    if (thread_count > g_viewer_count)
+        thread_count = g_viewer_count;
+    if (g_target_s < g_startup_s)
+        g_target_s = g_startup_s;
+
+    resolve_server();
+    load_playlist(argv[optind], 0);
+    raise_fd_limit(g_viewer_count + 64);
+
+    viewer_t *viewers = calloc((size_t)g_viewer_count, sizeof(viewer_t));
+    sim_thread_t *threads = calloc((size_t)thread_count, sizeof(sim_thread_t));
+    pthread_t *tids = calloc((size_t)thread_count, sizeof(pthread_t));
+    if (!viewers || !threads || !tids)
+    {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+
+    g_start_us = now_us();
+    g_end_us = g_start_us + (uint64_t)(g_duration_s * 1e6);
+    for (int i = 0; i < g_viewer_count; i++)
+    {
+        viewers[i].id = i;
+        viewers[i].fd = -1;
+        viewers[i].startup_us = -1;
+        viewers[i].join_us = g_start_us + (uint64_t)(g_ramp_s * 1e6 * i / g_viewer_count);
+    }
+
+    int per_thread = g_viewer_count / thread_count;
+    for (int i = 0, first = 0; i < thread_count; i++)
+    {
+        threads[i].viewers = &viewers[first];
+        threads[i].count = per_thread + (i < g_viewer_count % thread_count);
+        first += threads[i].count;
+        threads[i].epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (threads[i].epfd < 0 || pthread_create(&tids[i], NULL, sim_thread, &threads[i]) != 0)
+        {
+            perror("hilo de simulación");
+            return EXIT_FAILURE;
+        }
+    }
+    for (int i = 0; i < thread_count; i++)
+    {
+        pthread_join(tids[i], NULL);
+        close(threads[i].epfd);
+    }
+    double elapsed = (double)(now_us() - g_start_us) / 1e6;
+
+    int64_t *startup = malloc((size_t)g_viewer_count * sizeof(int64_t));
+    int64_t *stall = malloc((size_t)g_viewer_count * sizeof(int64_t));
+    if (!startup || !stall)
+    {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    int started = 0, stalled_viewers = 0;
+    unsigned long long bytes = 0, stall_total_us = 0;
+    unsigned long segments = 0, errors = 0, stalls = 0;
+    for (int i = 0; i < g_viewer_count; i++)
+    {
+        const viewer_t *v = &viewers[i];
+        if (v->startup_us >= 0)
+            startup[started++] = v->startup_us;
+        stall[i] = (int64_t)v->stall_us;
+        stalled_viewers += v->stalls > 0;
+        stalls += v->stalls;
+        stall_total_us += v->stall_us;
+        bytes += v->bytes;
+        segments += v->segments;
+        errors += v->errors;
+    }
+    qsort(startup, (size_t)started, sizeof(*startup), compare_i64);
+    qsort(stall, (size_t)g_viewer_count, sizeof(*stall), compare_i64);
+
+    printf("Playlist:     %s (%zu segmentos, %.1f s%s)\n", argv[optind], g_segment_count, g_playlist_s,
+           g_init_uri ? ", fMP4" : "");
+    printf("Viewers:      %d en %d hilos, rampa %.1f s, buffer %.1f s, arranque %.1f s%s\n", g_viewer_count,
+           thread_count, g_ramp_s, g_target_s, g_startup_s, g_range_chunk > 0 ? ", rangos" : "");
+    printf("Duración:     %.2f s\n", elapsed);
+    printf("Segmentos:    %lu  errores: %lu\n", segments, errors);
+    printf("Throughput:   %.2f MB/s (%.1f Mbps)\n", bytes / elapsed / (1024.0 * 1024.0), bytes * 8.0 / elapsed / 1e6);
+    if (started > 0)
+    {
+        printf("Arranque ms:  p50 %.1f  p95 %.1f  p99 %.1f  max %.1f  (sin arrancar: %d)\n",
+               startup[started * 50 / 100] / 1000.0, startup[started * 95 / 100] / 1000.0,
+               startup[started * 99 / 100] / 1000.0, startup[started - 1] / 1000.0, g_viewer_count - started);
+    }
+    else
+    {
+        printf("Arranque ms:  ningún viewer arrancó\n");
+    }
+    printf("Stalls:       %lu en %d viewers (%.1f%%), %.2f s en total\n", stalls, stalled_viewers,
+           100.0 * stalled_viewers / g_viewer_count, stall_total_us / 1e6);
+    printf("Stall ms/viewer: p50 %.1f  p95 %.1f  max %.1f\n", stall[g_viewer_count * 50 / 100] / 1000.0,
+           stall[g_viewer_count * 95 / 100] / 1000.0, stall[g_viewer_count - 1] / 1000.0);
+
+    if (csv_path)
+        write_csv(csv_path, viewers);
+
+    free(startup);
+    free(stall);
+    free(tids);
+    free(threads);
+    free(viewers);
+    freeaddrinfo(g_addr);
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,59 @@
+#!/bin/bash
+
+# Registra las sondas USDT con perf y graba una ventana de tráfico: eventos de petición más cambios
+# de contexto con pila, para ver a la vez los límites de cada petición y dónde se bloquean los workers.
+# Imprime un histograma de latencia (dequeue -> último byte, del argumento de `done`) y deja
+# perf.data listo para `perf report` / `perf script`.
+#
+# Uso: sudo tools/probes/perf_probes.sh [segundos] [binario]
+
+set -e
+
+SECONDS_TO_RECORD="${1:-10}"
+BINARY="${2:-bin/server}"
+
+if ! readelf -n "$BINARY" 2>/dev/null | grep -q happytree; then
+    echo "$BINARY no tiene sondas: instala <sys/sdt.h> (systemtap-sdt-dev) y recompila" >&2
+    exit 1
+fi
+
+perf buildid-cache --add "$BINARY"
+perf probe --del 'sdt_happytree:*' > /dev/null 2>&1 || true
+for probe in accept enqueue dequeue parse open first_byte send_chunk handoff done abort; do
+    perf probe -q -x "$BINARY" "sdt_happytree:${probe}"
+done
+
+echo "[*] Grabando ${SECONDS_TO_RECORD}s"
+perf record -q -g -e 'sdt_happytree:*' -e sched:sched_switch -a -- sleep "$SECONDS_TO_RECORD"
+
+echo "[*] Eventos por sonda"
+perf script -F event 2>/dev/null | sort | uniq -c | sort -rn
+
+echo "[*] Latencia dequeue -> último byte (us)"
+perf script -F event,trace 2>/dev/null | awk '
+    function num(s,    v, i, c) {
+        if (s !~ /^0x/) return s + 0
+        v = 0
+        for (i = 3; i <= length(s); i++) {
+            c = index("0123456789abcdef", tolower(substr(s, i, 1))) - 1
+            v = v * 16 + c
+        }
+        return v
+    }
+    /sdt_happytree:done/ {
+        for (i = 1; i <= NF; i++)
+            if ($i ~ /^arg4=/) {
+                ns = num(substr($i, 6))
+                b = 0
+                for (us = ns / 1000; us >= 1; us /= 2) b++
+                count[b]++
+                if (b > max) max = b
+            }
+    }
+    END {
+        for (b = 0; b <= max; b++)
+            printf "  < %8d us  %d\n", 2 ^ b, count[b]
+    }'
+
+perf probe --del 'sdt_happytree:*' > /dev/null 2>&1 || true
+echo "[*] perf report --no-children --sort comm,sym    para el tiempo fuera de CPU por pila"
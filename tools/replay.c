@@ -0,0 +1,484 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define LINE_MAX_LEN 2048
+#define RESPONSE_BUFFER 65536
+#define LATE_THRESHOLD_US 10000
+
+typedef struct
+{
+    uint64_t t_us;
+    unsigned long conn;
+    char method[16];
+    char *path;
+    char *range;
+} replay_request_t;
+
+typedef struct
+{
+    size_t first;
+    size_t count;
+} replay_conn_t;
+
+static replay_request_t *g_requests = NULL;
+static size_t g_request_count = 0;
+static replay_conn_t *g_conns = NULL;
+static size_t g_conn_count = 0;
+static int64_t *g_latency_us = NULL;
+
+static const char *g_host = "127.0.0.1";
+static const char *g_port = "8001";
+static const char *g_unix_path = NULL;
+static int g_proxy_header = 0;
+static double g_speed = 1.0;
+static uint64_t g_start_us = 0;
+
+static atomic_size_t g_next_conn;
+static atomic_ullong g_bytes;
+static atomic_ulong g_errors;
+static atomic_ulong g_late;
+static atomic_ulong g_status[6];
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/* Extracts one field from the flat objects written by the server's --capture; 0 when null/missing. */
+static int json_field(const char *line, const char *key, char *out, size_t cap)
+{
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char *p = strstr(line, pattern);
+    if (!p)
+    {
+        return 0;
+    }
+    p += strlen(pattern);
+
+    size_t n = 0;
+    if (*p != '"')
+    {
+        if (strncmp(p, "null", 4) == 0)
+        {
+            return 0;
+        }
+        while (*p && *p != ',' && *p != '}' && n + 1 < cap)
+        {
+            out[n++] = *p++;
+        }
+        out[n] = '\0';
+        return 1;
+    }
+
+    for (p++; *p && *p != '"' && n + 1 < cap; p++)
+    {
+        if (*p == '\\' && p[1] == 'u')
+        {
+            out[n++] = (char)strtol((char[]){p[4], p[5], '\0'}, NULL, 16);
+            p += 5;
+        }
+        else if (*p == '\\' && p[1])
+        {
+            out[n++] = *++p;
+        }
+        else
+        {
+            out[n++] = *p;
+        }
+    }
+    out[n] = '\0';
+    return 1;
+}
+
+static int compare_requests(const void *a, const void *b)
+{
+    const replay_request_t *ra = a, *rb = b;
+    if (ra->conn != rb->conn)
+        return ra->conn < rb->conn ? -1 : 1;
+    if (ra->t_us != rb->t_us)
+        return ra->t_us < rb->t_us ? -1 : 1;
+    return 0;
+}
+
+static int compare_conns(const void *a, const void *b)
+{
+    uint64_t ta = g_requests[((const replay_conn_t *)a)->first].t_us;
+    uint64_t tb = g_requests[((const replay_conn_t *)b)->first].t_us;
+    return ta < tb ? -1 : ta > tb;
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+    int64_t la = *(const int64_t *)a, lb = *(const int64_t *)b;
+    return la < lb ? -1 : la > lb;
+}
+
+static void load_capture(const char *file)
+{
+    FILE *f = fopen(file, "r");
+    if (!f)
+    {
+        perror(file);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t capacity = 0;
+    char line[LINE_MAX_LEN];
+    char value[LINE_MAX_LEN];
+    while (fgets(line, sizeof(line), f))
+    {
+        if (!json_field(line, "path", value, sizeof(value)))
+        {
+            continue;
+        }
+        if (g_request_count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1024;
+            g_requests = realloc(g_requests, capacity * sizeof(*g_requests));
+            if (!g_requests)
+            {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        replay_request_t *req = &g_requests[g_request_count++];
+        memset(req, 0, sizeof(*req));
+        req->path = strdup(value);
+        if (json_field(line, "range", value, sizeof(value)))
+            req->range = strdup(value);
+        if (!json_field(line, "method", req->method, sizeof(req->method)))
+            strcpy(req->method, "GET");
+        if (json_field(line, "t_us", value, sizeof(value)))
+            req->t_us = strtoull(value, NULL, 10);
+        if (json_field(line, "conn", value, sizeof(value)))
+            req->conn = strtoul(value, NULL, 10);
+    }
+    fclose(f);
+
+    qsort(g_requests, g_request_count, sizeof(*g_requests), compare_requests);
+
+    g_conns = calloc(g_request_count ? g_request_count : 1, sizeof(*g_conns));
+    g_latency_us = calloc(g_request_count ? g_request_count : 1, sizeof(*g_latency_us));
+    if (!g_conns || !g_latency_us)
+    {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < g_request_count; i++)
+    {
+        if (i == 0 || g_requests[i].conn != g_requests[i - 1].conn)
+        {
+            g_conns[g_conn_count++].first = i;
+        }
+        g_conns[g_conn_count - 1].count++;
+    }
+    qsort(g_conns, g_conn_count, sizeof(*g_conns), compare_conns);
+}
+
+static int connect_unix(void)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", g_unix_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/* What a local proxy would prepend: a PROXY v1 line naming a loopback client. */
+static int send_proxy_header(int fd, unsigned long conn)
+{
+    char line[128];
+    int len = snprintf(line, sizeof(line), "PROXY TCP4 127.0.0.1 127.0.0.1 %lu %s\r\n",
+                       1024 + conn % 60000, g_port);
+    return send(fd, line, (size_t)len, MSG_NOSIGNAL) == len ? 0 : -1;
+}
+
+static int connect_server(unsigned long conn)
+{
+    if (g_unix_path)
+    {
+        int fd = connect_unix();
+        if (fd >= 0 && g_proxy_header && send_proxy_header(fd, conn) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+        return fd;
+    }
+
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(g_host, g_port, &hints, &res) != 0)
+    {
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd >= 0)
+    {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (g_proxy_header && send_proxy_header(fd, conn) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    return fd;
+}
+
+static int send_request(int fd, const replay_request_t *req)
+{
+    char buf[LINE_MAX_LEN + 256];
+    int len = snprintf(buf, sizeof(buf), "%s %s HTTP/1.1\r\nHost: %s\r\n", req->method, req->path, g_host);
+    if (req->range)
+        len += snprintf(buf + len, sizeof(buf) - (size_t)len, "Range: %s\r\n", req->range);
+    len += snprintf(buf + len, sizeof(buf) - (size_t)len, "\r\n");
+
+    return send(fd, buf, (size_t)len, MSG_NOSIGNAL) == len ? 0 : -1;
+}
+
+/* Reads one response. Returns the status code, or -1 on error; *keep_alive tells if fd is reusable. */
+static int read_response(int fd, int head_only, char *buf, unsigned long long *bytes, int *keep_alive)
+{
+    size_t len = 0;
+    char *body = NULL;
+    while (!body)
+    {
+        if (len == RESPONSE_BUFFER - 1)
+            return -1;
+        ssize_t n = recv(fd, buf + len, RESPONSE_BUFFER - 1 - len, 0);
+        if (n <= 0)
+            return -1;
+        len += (size_t)n;
+        buf[len] = '\0';
+        body = strstr(buf, "\r\n\r\n");
+    }
+    body += 4;
+
+    int status = 0;
+    if (sscanf(buf, "HTTP/%*s %d", &status) != 1)
+        return -1;
+
+    const char *cl = strcasestr(buf, "\r\nContent-Length:");
+    const char *conn = strcasestr(buf, "\r\nConnection:");
+    long long content_length = cl ? atoll(cl + strlen("\r\nContent-Length:")) : -1;
+    *keep_alive = cl != NULL && !(conn && strncasecmp(conn + strlen("\r\nConnection:") + 1, "close", 5) == 0);
+    if (head_only)
+        content_length = 0;
+
+    long long have = (long long)(len - (size_t)(body - buf));
+    while (content_length < 0 || have < content_length)
+    {
+        ssize_t n = recv(fd, buf, RESPONSE_BUFFER, 0);
+        if (n < 0)
+            return -1;
+        if (n == 0)
+        {
+            if (content_length >= 0)
+                return -1;
+            break;
+        }
+        have += n;
+    }
+    *bytes += (unsigned long long)have;
+    return status;
+}
+
+static void *replay_thread(void *arg)
+{
+    (void)arg;
+    char *buf = malloc(RESPONSE_BUFFER);
+    if (!buf)
+        return NULL;
+
+    size_t idx;
+    while ((idx = atomic_fetch_add(&g_next_conn, 1)) < g_conn_count)
+    {
+        const replay_conn_t *c = &g_conns[idx];
+        int fd = -1;
+        for (size_t i = c->first; i < c->first + c->count; i++)
+        {
+            const replay_request_t *req = &g_requests[i];
+            g_latency_us[i] = -1;
+
+            if (g_speed > 0)
+            {
+                uint64_t target = g_start_us + (uint64_t)(req->t_us / g_speed);
+                uint64_t now = now_us();
+                if (now < target)
+                    usleep((useconds_t)(target - now));
+                else if (now - target > LATE_THRESHOLD_US)
+                    atomic_fetch_add(&g_late, 1);
+            }
+
+            if (fd < 0 && (fd = connect_server(req->conn)) < 0)
+            {
+                atomic_fetch_add(&g_errors, 1);
+                continue;
+            }
+
+            uint64_t sent_at = now_us();
+            unsigned long long bytes = 0;
+            int keep_alive = 0;
+            int status = -1;
+            if (send_request(fd, req) == 0)
+                status = read_response(fd, strcmp(req->method, "HEAD") == 0, buf, &bytes, &keep_alive);
+
+            if (status < 0)
+            {
+                atomic_fetch_add(&g_errors, 1);
+            }
+            else
+            {
+                g_latency_us[i] = (int64_t)(now_us() - sent_at);
+                atomic_fetch_add(&g_bytes, bytes);
+                atomic_fetch_add(&g_status[status / 100 <= 5 ? status / 100 : 0], 1);
+            }
+
+            if (status < 0 || !keep_alive)
+            {
+                close(fd);
+                fd = -1;
+            }
+        }
+        if (fd >= 0)
+            close(fd);
+    }
+    free(buf);
+    return NULL;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Uso: %s [-H host] [-p puerto] [-u socket_unix] [-x] [-s velocidad|max] [-t hilos] <captura.jsonl>\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    int thread_count = 32;
+    const char *speed_label = "1";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "H:p:u:xs:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'H':
+            g_host = optarg;
+            break;
+        case 'p':
+            g_port = optarg;
+            break;
+        case 'u':
+            g_unix_path = optarg;
+            break;
+        case 'x':
+            g_proxy_header = 1;
+            break;
+        case 's':
+            g_speed = strcmp(optarg, "max") == 0 ? 0.0 : atof(optarg);
+            speed_label = optarg;
+            break;
+        case 't':
+            thread_count = atoi(optarg);
+            if (thread_count < 1)
+                thread_count = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind >= argc)
+        usage(argv[0]);
+
+    load_capture(argv[optind]);
+    if (g_request_count == 0)
+    {
+        fprintf(stderr, "La captura no contiene peticiones\n");
+        return EXIT_FAILURE;
+    }
+
+    pthread_t *threads = malloc((size_t)thread_count * sizeof(pthread_t));
+    if (!threads)
+    {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+
+    g_start_us = now_us();
+    for (int i = 0; i < thread_count; i++)
+    {
+        if (pthread_create(&threads[i], NULL, replay_thread, NULL) != 0)
+        {
+            perror("pthread_create");
+            return EXIT_FAILURE;
+        }
+    }
+    for (int i = 0; i < thread_count; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = (double)(now_us() - g_start_us) / 1e6;
+
+    size_t ok = 0;
+    for (size_t i = 0; i < g_request_count; i++)
+    {
+        if (g_latency_us[i] >= 0)
+            g_latency_us[ok++] = g_latency_us[i];
+    }
+    qsort(g_latency_us, ok, sizeof(*g_latency_us), compare_latency);
+
+    unsigned long long bytes = atomic_load(&g_bytes);
+    printf("Peticiones:   %zu en %zu conexiones (velocidad %s%s)\n", g_request_count, g_conn_count,
+           g_speed > 0 ? speed_label : "max", g_speed > 0 ? "x" : "");
+    printf("Completadas:  %zu  errores: %lu  tarde: %lu\n", ok, atomic_load(&g_errors), atomic_load(&g_late));
+    printf("Status:       2xx %lu  3xx %lu  4xx %lu  5xx %lu\n", atomic_load(&g_status[2]),
+           atomic_load(&g_status[3]), atomic_load(&g_status[4]), atomic_load(&g_status[5]));
+    printf("Duración:     %.2f s\n", elapsed);
+    printf("Throughput:   %.1f req/s, %.2f MB/s\n", ok / elapsed, bytes / elapsed / (1024.0 * 1024.0));
+    if (ok > 0)
+    {
+        printf("Latencia ms:  p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+               g_latency_us[ok * 50 / 100] / 1000.0, g_latency_us[ok * 90 / 100] / 1000.0,
+               g_latency_us[ok * 99 / 100] / 1000.0, g_latency_us[ok - 1] / 1000.0);
+    }
+
+    free(threads);
+    return g_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}